@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../lib_cmd/cmd.h"
+#include "../lib_cmd/cmd_expr.h"
+
+// heap allocations made since the start of the process
+static std::atomic<uint64_t> num_allocs(0);
+
+void* operator new(size_t size)
+{
+    num_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+namespace {
+
+// the original full matrix levenshtein, kept as a baseline
+uint32_t levenshtein_classic(const char* s1, const char* s2)
+{
+#define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
+    uint32_t x, y, lastdiag, olddiag;
+    const size_t s1len = strlen(s1);
+    const size_t s2len = strlen(s2);
+    uint32_t* column = (uint32_t*)alloca((s1len + 1) * sizeof(uint32_t));
+    for (y = 1; y <= s1len; y++) {
+        column[y] = y;
+    }
+    for (x = 1; x <= s2len; x++) {
+        column[0] = x;
+        for (y = 1, lastdiag = x - 1; y <= s1len; y++) {
+            olddiag = column[y];
+            column[y] = MIN3(column[y] + 1,
+                column[y - 1] + 1,
+                lastdiag + (s1[y - 1] == s2[x - 1] ? 0 : 1));
+            lastdiag = olddiag;
+        }
+    }
+    return column[s1len];
+#undef MIN3
+}
+
+// stop the optimizer discarding results
+volatile uint32_t sink;
+
+// one measured benchmark
+struct result_t {
+    std::string name_;
+    size_t ops_; // per trial
+    double ns_per_op_;
+    double allocs_per_op_;
+};
+
+// command line options
+struct options_t {
+    const char* filter_ = nullptr;
+    const char* json_ = nullptr;
+    int trials_ = 5;
+    int repeat_ = 200;
+};
+
+options_t options;
+std::vector<result_t> results;
+
+// time func, which performs ops operations per call, reporting the fastest
+// of several trials so that results are comparable between runs.  slow
+// functions are repeated fewer times so each trial lasts about TRIAL_NS.
+template <typename func_t>
+void bench(const char* name, size_t ops, func_t func)
+{
+    typedef std::chrono::steady_clock clock_t;
+    const double TRIAL_NS = 20e6;
+    if (options.filter_ && !strstr(name, options.filter_)) {
+        return;
+    }
+    // warm up
+    auto start = clock_t::now();
+    func();
+    const double once = std::chrono::duration<double, std::nano>(clock_t::now() - start).count();
+    const int repeat = std::max(1, std::min(options.repeat_, int(TRIAL_NS / std::max(once, 1.0))));
+    double best = 0.0;
+    const uint64_t allocs = num_allocs.load(std::memory_order_relaxed);
+    for (int trial = 0; trial < options.trials_; ++trial) {
+        start = clock_t::now();
+        for (int i = 0; i < repeat; ++i) {
+            func();
+        }
+        const auto end = clock_t::now();
+        const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        if (trial == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    const double calls = double(options.trials_) * double(repeat);
+    result_t result;
+    result.name_ = name;
+    result.ops_ = ops * size_t(repeat);
+    result.ns_per_op_ = best / (double(ops) * double(repeat));
+    result.allocs_per_op_ = double(num_allocs.load(std::memory_order_relaxed) - allocs) / (calls * double(ops));
+    printf("%-36s %10.2f ns/op %8.2f allocs/op %14.0f ops/s\n",
+        name,
+        result.ns_per_op_,
+        result.allocs_per_op_,
+        1e9 / result.ns_per_op_);
+    results.push_back(result);
+}
+
+bool write_json(const char* path)
+{
+    FILE* fd = fopen(path, "wb");
+    if (!fd) {
+        return false;
+    }
+    fprintf(fd, "{\"trials\":%d,\"benchmarks\":[", options.trials_);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const result_t& result = results[i];
+        fprintf(fd, "%s\n{\"name\":\"%s\",\"ops\":%zu,\"ns_per_op\":%.3f,\"allocs_per_op\":%.3f,\"ops_per_sec\":%.0f}",
+            i ? "," : "",
+            result.name_.c_str(),
+            result.ops_,
+            result.ns_per_op_,
+            result.allocs_per_op_,
+            1e9 / result.ns_per_op_);
+    }
+    fprintf(fd, "\n]}\n");
+    return fclose(fd) == 0;
+}
+
+void bench_levenshtein()
+{
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < 4096; ++i) {
+        names.push_back("register_" + std::to_string((i * 7919) % 10000));
+    }
+    std::vector<const char*> ptrs;
+    for (const std::string& name : names) {
+        ptrs.push_back(name.c_str());
+    }
+    std::vector<uint32_t> dist(ptrs.size());
+    const char* query = "registr_123";
+
+    bench("levenshtein classic", ptrs.size(), [&]() {
+        uint32_t sum = 0;
+        for (const char* name : ptrs) {
+            sum += levenshtein_classic(query, name) < 3;
+        }
+        sink = sum;
+    });
+    bench("levenshtein bit parallel", ptrs.size(), [&]() {
+        uint32_t sum = 0;
+        for (const char* name : ptrs) {
+            sum += cmd_util_t::levenshtein(query, name) < 3;
+        }
+        sink = sum;
+    });
+    bench("levenshtein bounded (max 3)", ptrs.size(), [&]() {
+        uint32_t sum = 0;
+        for (const char* name : ptrs) {
+            sum += cmd_util_t::levenshtein(query, name, 3) < 3;
+        }
+        sink = sum;
+    });
+    bench("levenshtein batch (max 3)", ptrs.size(), [&]() {
+        cmd_util_t::levenshtein(query, ptrs.data(), ptrs.size(), 3, dist.data());
+        sink = dist[0];
+    });
+}
+
+void bench_tokenize()
+{
+    const std::vector<std::string> lines = {
+        "echo hello",
+        "stat leaf 1234 -v --name=value",
+        "expr eval 0x10 + 20 * ( 3 - 1 )",
+        "  padded   with\tmixed \r whitespace  ",
+        "alias add ll list long form of a much longer command line with many arguments",
+    };
+    cmd_tokens_t tokens(nullptr);
+    bench("tokenize", lines.size(), [&]() {
+        size_t sum = 0;
+        for (const std::string& line : lines) {
+            sum += tokens.tokenize(line, nullptr, 0);
+        }
+        sink = uint32_t(sum);
+    });
+}
+
+void bench_strtoll()
+{
+    const std::vector<const char*> inputs = {
+        "0", "42", "-17", "1234567890", "0x1f", "0xdeadbeef", "-0x8000", "18446744073709551615",
+    };
+    bench("strtoll", inputs.size(), [&]() {
+        uint64_t sum = 0;
+        for (const char* in : inputs) {
+            uint64_t value;
+            bool neg;
+            if (cmd_util_t::strtoll(in, value, neg)) {
+                sum += neg ? 0 - value : value;
+            }
+        }
+        sink = uint32_t(sum);
+    });
+}
+
+struct cmd_node_t : public cmd_t {
+    cmd_node_t(const char* name, cmd_parser_t& cli)
+        : cmd_t(name, cli, nullptr, nullptr)
+    {
+    }
+};
+
+// resolve names and prefixes in lists of 10 to 100k commands
+void bench_find()
+{
+    cmd_parser_t parser;
+    for (size_t size = 10; size <= 100000; size *= 10) {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < size; ++i) {
+            names.push_back("node_" + std::to_string((i * 7919) % size));
+        }
+        cmd_list_t list;
+        for (const std::string& name : names) {
+            list.push_back(std::unique_ptr<cmd_t>(new cmd_node_t(name.c_str(), parser)));
+        }
+        // query a fixed spread of the names, and the same names less their
+        // last character which matches as a prefix
+        const size_t QUERIES = 64;
+        std::vector<std::string> exact, prefix;
+        for (size_t i = 0; i < QUERIES; ++i) {
+            exact.push_back(names[(i * 104729) % size]);
+            prefix.push_back(exact.back().substr(0, exact.back().size() - 1));
+        }
+        std::vector<cmd_t*> found;
+        found.reserve(size);
+        const std::string suffix = " (" + std::to_string(size) + " nodes)";
+        bench(("find exact" + suffix).c_str(), QUERIES, [&]() {
+            size_t sum = 0;
+            for (const std::string& name : exact) {
+                found.clear();
+                sum += list.find(name, found);
+            }
+            sink = uint32_t(sum);
+        });
+        bench(("find prefix" + suffix).c_str(), QUERIES, [&]() {
+            size_t sum = 0;
+            for (const std::string& name : prefix) {
+                found.clear();
+                list.find(name, found);
+                sum += found.size();
+            }
+            sink = uint32_t(sum);
+        });
+    }
+}
+
+// cmd_expr_imp_t is private to cmd_expr.cpp so the evaluator is measured
+// through a prepared "expr eval", which skips tokenizing and resolving
+void bench_expr()
+{
+    cmd_parser_t parser;
+    parser.add_command<cmd_expr_t>();
+    cmd_output_t* output = cmd_output_t::create_output_dummy();
+    const std::vector<const char*> exprs = {
+        "expr eval 1 + 2",
+        "expr eval ( 0x10 + 20 ) * 3 - 7 / 2",
+        "expr eval 1 << 4 | 0xff & ~3 ^ 12",
+    };
+    std::vector<cmd_prepared_t> prepared(exprs.size());
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        parser.prepare(exprs[i], prepared[i], output);
+    }
+    bench("expr evaluate", prepared.size(), [&]() {
+        for (cmd_prepared_t& prep : prepared) {
+            parser.execute(prep, output, nullptr);
+        }
+    });
+    delete output;
+}
+
+// the cost of printing through each cmd_output_t sink
+void bench_output()
+{
+    const size_t LINES = 1000;
+    FILE* null = fopen("/dev/null", "wb");
+    if (!null) {
+        return;
+    }
+    cmd_output_t* stdio = cmd_output_t::create_output_stdio(null);
+    cmd_output_t* buffered = cmd_output_t::create_output_buffered(null);
+    cmd_output_t* async = cmd_output_t::create_output_async(null);
+    cmd_output_t* dummy = cmd_output_t::create_output_dummy();
+    const auto print = [](cmd_output_t* out) {
+        for (size_t i = 0; i < LINES; ++i) {
+            out->println("%s = 0x%llx", "value", (unsigned long long)i);
+        }
+    };
+    bench("output stdio println", LINES, [&]() { print(stdio); });
+    bench("output buffered println", LINES, [&]() {
+        const auto guard = buffered->guard();
+        print(buffered);
+    });
+    bench("output async println", LINES, [&]() {
+        const auto guard = async->guard();
+        print(async);
+    });
+    // the same lines through the compile time checked format path
+    const auto format = [](cmd_output_t* out) {
+        for (size_t i = 0; i < LINES; ++i) {
+            out->println(CMD_FMT("{} = 0x{x}"), "value", i);
+        }
+    };
+    bench("output stdio println fmt", LINES, [&]() { format(stdio); });
+    bench("output buffered println fmt", LINES, [&]() {
+        const auto guard = buffered->guard();
+        format(buffered);
+    });
+    bench("output async println fmt", LINES, [&]() {
+        const auto guard = async->guard();
+        format(async);
+    });
+    bench("output stdio println text", LINES, [&]() {
+        for (size_t i = 0; i < LINES; ++i) {
+            stdio->println("invalid command");
+        }
+    });
+    bench("output buffered println text", LINES, [&]() {
+        const auto guard = buffered->guard();
+        for (size_t i = 0; i < LINES; ++i) {
+            buffered->println("invalid command");
+        }
+    });
+    std::string text;
+    cmd_output_t* buffer = cmd_output_t::create_output_buffer(text, nullptr, false);
+    bench("output buffer println fmt", LINES, [&]() {
+        text.clear();
+        format(buffer);
+    });
+    delete buffer;
+    bench("output dummy println", LINES, [&]() { print(dummy); });
+    bench("output dummy println fmt", LINES, [&]() { format(dummy); });
+    delete dummy;
+    delete async;
+    delete buffered;
+    delete stdio;
+    fclose(null);
+}
+
+struct cmd_leaf_t : public cmd_t {
+    cmd_leaf_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("leaf", cli, parent, user)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        sink = uint32_t(tok.tokens.size());
+        return true;
+    }
+};
+
+struct cmd_stat_t : public cmd_t {
+    cmd_stat_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("stat", cli, parent, user)
+    {
+        add_sub_command<cmd_leaf_t>();
+    }
+};
+
+void bench_batch()
+{
+    const size_t LINES = 1000;
+    std::string buffer;
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < LINES; ++i) {
+        lines.push_back("st le " + std::to_string(i) + " -v");
+        buffer.append(lines.back()).append("\n");
+    }
+    cmd_output_t* output = cmd_output_t::create_output_dummy();
+
+    {
+        cmd_parser_t parser;
+        parser.add_command<cmd_stat_t>();
+        bench("execute per line", LINES, [&]() {
+            for (const std::string& line : lines) {
+                parser.execute(line, output, nullptr);
+            }
+            parser.history_.clear();
+        });
+    }
+    {
+        cmd_parser_t parser;
+        parser.add_command<cmd_stat_t>();
+        std::vector<bool> status;
+        bench("execute batch", LINES, [&]() {
+            parser.execute_batch(buffer, output, nullptr, &status);
+            parser.history_.clear();
+        });
+    }
+    delete output;
+}
+
+void usage()
+{
+    printf("usage: bench_cmd [--filter substr] [--json file] [--trials n] [--repeat n]\n");
+}
+} // namespace {}
+
+int main(int argc, char** args)
+{
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(args[i], "--filter") && has_value) {
+            options.filter_ = args[++i];
+        } else if (!strcmp(args[i], "--json") && has_value) {
+            options.json_ = args[++i];
+        } else if (!strcmp(args[i], "--trials") && has_value) {
+            options.trials_ = atoi(args[++i]);
+        } else if (!strcmp(args[i], "--repeat") && has_value) {
+            options.repeat_ = atoi(args[++i]);
+        } else {
+            return usage(), 1;
+        }
+    }
+    if (options.trials_ < 1 || options.repeat_ < 1) {
+        return usage(), 1;
+    }
+    bench_tokenize();
+    bench_strtoll();
+    bench_levenshtein();
+    bench_find();
+    bench_expr();
+    bench_output();
+    bench_batch();
+    if (options.json_ && !write_json(options.json_)) {
+        fprintf(stderr, "unable to open '%s'\n", options.json_);
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,39 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <limits.h>
 #include <mutex>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CMD_HAVE_MMAP 1
+#else
+#include <cstdio>
+#define CMD_HAVE_MMAP 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#include <unistd.h>
+#define CMD_HAVE_WRITEV 1
+#else
+#define CMD_HAVE_WRITEV 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CMD_HAVE_SSE2 1
+#else
+#define CMD_HAVE_SSE2 0
+#endif
+
 #include "cmd.h"
 
 // find a list of commands that match a substring
@@ -11,20 +42,7 @@ static bool find_matches(cmd_list_t& list,
     std::vector<cmd_t*>& vec)
 {
     assert(sub);
-    int32_t score = 0;
-    for (auto& item : list) {
-        int32_t val = cmd_util_t::str_match(item->name_, sub);
-        if (val > score) {
-            vec.clear();
-            vec.push_back(item.get());
-            score = val;
-        } else if (val == score) {
-            vec.push_back(item.get());
-        } else {
-            // drop on the floor
-        }
-    }
-    return vec.size() > 0;
+    return list.find(sub, vec);
 }
 
 template <typename type_t, size_t size>
@@ -96,356 +114,4543 @@ bool cmd_util_t::strtoll(const char* in, uint64_t& out, bool& neg)
     return out = accum, true;
 }
 
-uint32_t cmd_util_t::levenshtein(const char* s1, const char* s2)
+// banded dynamic programming levenshtein for strings too long for the bit
+// parallel kernel, stopping once every cell in a column reaches max
+static uint32_t levenshtein_dp(const char* s1, size_t s1len,
+    const char* s2, size_t s2len,
+    uint32_t max)
 {
 #define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
     uint32_t x, y, lastdiag, olddiag;
-    const size_t s1len = strlen(s1);
-    const size_t s2len = strlen(s2);
     uint32_t* column = (uint32_t*)alloca((s1len + 1) * sizeof(uint32_t));
     for (y = 1; y <= s1len; y++) {
         column[y] = y;
     }
     for (x = 1; x <= s2len; x++) {
         column[0] = x;
+        uint32_t low = x;
         for (y = 1, lastdiag = x - 1; y <= s1len; y++) {
             olddiag = column[y];
             column[y] = MIN3(column[y] + 1,
                 column[y - 1] + 1,
                 lastdiag + (s1[y - 1] == s2[x - 1] ? 0 : 1));
             lastdiag = olddiag;
+            low = std::min(low, column[y]);
+        }
+        if (low >= max) {
+            return max;
         }
     }
-    return column[s1len];
+    return std::min(column[s1len], max);
 #undef MIN3
 }
 
-// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_parser_t
-
-bool cmd_parser_t::execute(
-    const std::string& expr,
-    cmd_output_t* cmd_out,
-    cmd_baton_t user)
+// Myers/Hyyro bit parallel levenshtein of a pattern of 1..64 chars, described
+// by its match vectors, against a text
+static uint32_t levenshtein_bits(const uint64_t* peq, size_t m,
+    const char* text, size_t n,
+    uint32_t max)
 {
-    assert(cmd_out);
-    cmd_output_t& out = *cmd_out;
-    // aquire the output guard
-    const auto guard = out.guard();
-    const char delimiter = ';';
-    size_t ix = 0;
-    std::string cmd;
-    for (bool active = true; active;) {
-        cmd.clear();
-        // split by delimiter
-        const size_t next = expr.find(delimiter, ix);
-        if (next == expr.npos) {
-            cmd = expr.substr(ix);
-            active = false;
-        } else {
-            if (next > ix) {
-                cmd = expr.substr(ix, next - ix);
-            }
-            ix = next + 1;
-        }
-        // execute single command
-        if (!cmd.empty()) {
-            if (!execute_imp(cmd, cmd_out, user)) {
-                return cmd_locale_t::command_failed(out, cmd.c_str()), false;
-            }
+    assert(m > 0 && m <= 64);
+    const uint64_t last = 1ull << (m - 1);
+    uint64_t pv = ~0ull, mv = 0;
+    uint64_t score = m;
+    for (size_t j = 0; j < n; ++j) {
+        const uint64_t eq = peq[uint8_t(text[j])];
+        const uint64_t xv = eq | mv;
+        const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        score += (ph & last) ? 1 : 0;
+        score -= (mh & last) ? 1 : 0;
+        // the score can fall by at most one for each remaining char
+        if (score >= uint64_t(max) + (n - j - 1)) {
+            return max;
         }
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
     }
-    return true;
+    return uint32_t(std::min<uint64_t>(score, max));
 }
 
-bool cmd_parser_t::execute_imp(
-    const std::string& expr,
-    cmd_output_t* cmd_out,
-    cmd_baton_t user)
+#if CMD_HAVE_SSE2
+// levenshtein_bits for two texts at once, one per 64 bit SSE2 lane
+static void levenshtein_bits_x2(const uint64_t* peq, size_t m,
+    const char* const* text,
+    uint32_t max,
+    uint32_t* out)
 {
-    assert(cmd_out);
-    cmd_output_t& out = *cmd_out;
-    const std::string prev_cmd = last_cmd();
-    // add to history buffer
-    history_.push_back(expr);
-    // tokenize command string
-    cmd_tokens_t tokens(&idents_);
-    if (tokens.tokenize(expr.c_str()) == 0) {
-        if (!last_cmd().empty()) {
-            out.println("> %s", prev_cmd.c_str());
-            return execute_imp(prev_cmd, cmd_out, user);
-        } else {
-            // no commands entered
-            return false;
-        }
+    assert(m > 0 && m <= 64);
+    const size_t n0 = strlen(text[0]);
+    const size_t n1 = strlen(text[1]);
+    const __m128i ones = _mm_set1_epi64x(-1);
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128i shift = _mm_cvtsi32_si128(int(m - 1));
+    __m128i pv = ones;
+    __m128i mv = _mm_setzero_si128();
+    __m128i score = _mm_set1_epi64x(int64_t(m));
+    const size_t n = std::max(n0, n1);
+    for (size_t j = 0; j < n; ++j) {
+        // lanes whose text has ended contribute no more edits
+        const bool a0 = j < n0, a1 = j < n1;
+        const __m128i eq = _mm_set_epi64x(
+            int64_t(a1 ? peq[uint8_t(text[1][j])] : 0),
+            int64_t(a0 ? peq[uint8_t(text[0][j])] : 0));
+        const __m128i active = _mm_set_epi64x(a1 ? -1 : 0, a0 ? -1 : 0);
+        const __m128i xv = _mm_or_si128(eq, mv);
+        const __m128i eqpv = _mm_and_si128(eq, pv);
+        const __m128i xh = _mm_or_si128(_mm_xor_si128(_mm_add_epi64(eqpv, pv), pv), eq);
+        __m128i ph = _mm_or_si128(mv, _mm_andnot_si128(_mm_or_si128(xh, pv), ones));
+        __m128i mh = _mm_and_si128(pv, xh);
+        const __m128i pb = _mm_and_si128(_mm_srl_epi64(ph, shift), one);
+        const __m128i mb = _mm_and_si128(_mm_srl_epi64(mh, shift), one);
+        score = _mm_add_epi64(score, _mm_and_si128(_mm_sub_epi64(pb, mb), active));
+        ph = _mm_or_si128(_mm_slli_epi64(ph, 1), one);
+        mh = _mm_slli_epi64(mh, 1);
+        pv = _mm_or_si128(mh, _mm_andnot_si128(_mm_or_si128(xv, ph), ones));
+        mv = _mm_and_si128(ph, xv);
     }
-    cmd_list_t* list = &sub_;
-    std::vector<cmd_t*> cmd_vec;
-    // check for aliases
-    cmd_t* cmd = alias_find(tokens.tokens.front());
-    if (cmd) {
-        tokens.tokens.pop();
-        list = &(cmd->sub_);
+    uint64_t result[2];
+    _mm_storeu_si128((__m128i*)result, score);
+    out[0] = uint32_t(std::min<uint64_t>(result[0], max));
+    out[1] = uint32_t(std::min<uint64_t>(result[1], max));
+}
+#endif
+
+uint32_t cmd_util_t::levenshtein(const char* s1, const char* s2)
+{
+    return levenshtein(s1, s2, UINT32_MAX);
+}
+
+uint32_t cmd_util_t::levenshtein(const char* a, const char* b, uint32_t max)
+{
+    assert(a && b);
+    size_t alen = strlen(a);
+    size_t blen = strlen(b);
+    // the pattern is the shorter of the two strings
+    if (alen > blen) {
+        std::swap(a, b);
+        std::swap(alen, blen);
     }
-    while (!tokens.tokens.empty()) {
-        // find best matching sub command
-        cmd_vec.clear();
-        find_matches(*list, tokens.tokens.front().c_str(), cmd_vec);
-        if (cmd_vec.size() == 0) {
-            // no sub commands to match
-            break;
-        } else if (cmd_vec.size() == 1) {
-            cmd = cmd_vec.front();
-            list = &cmd->sub_;
-            // remove front item
-            tokens.tokens.pop();
-        } else {
-            // ambiguous matches (show possible matches)
-            cmd = nullptr;
-            cmd_locale_t::possible_completions(out);
-            auto indent = out.indent(4);
-            for (auto c : cmd_vec) {
-                out.println("%s", c->name_);
-            }
-            break;
-        }
+    if (blen - alen >= max) {
+        return max;
     }
-    if (!cmd) {
-        if (parent_) {
-            //XXX: we need to pass the entire thing to the parent ??
-        }
-//      else {
-            cmd_locale_t::invalid_command(out);
-//      }
-        return false;
+    if (alen == 0) {
+        return uint32_t(blen);
     }
-    if (!tokens.tokens.empty()) {
-        if (tokens.tokens.back() == "?") {
-            return cmd->on_usage(out, user);
+    if (alen > 64) {
+        return levenshtein_dp(a, alen, b, blen, max);
+    }
+    // only the entries for chars in either string are ever read
+    uint64_t peq[256];
+    for (size_t i = 0; i < blen; ++i) {
+        peq[uint8_t(b[i])] = 0;
+    }
+    for (size_t i = 0; i < alen; ++i) {
+        peq[uint8_t(a[i])] = 0;
+    }
+    for (size_t i = 0; i < alen; ++i) {
+        peq[uint8_t(a[i])] |= 1ull << i;
+    }
+    return levenshtein_bits(peq, alen, b, blen, max);
+}
+
+void cmd_util_t::levenshtein(const char* query,
+    const char* const* names,
+    size_t count,
+    uint32_t max,
+    uint32_t* out)
+{
+    assert(query && (names || !count) && (out || !count));
+    const size_t m = strlen(query);
+    if (m == 0 || m > 64) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = levenshtein(query, names[i], max);
         }
+        return;
+    }
+    // build the query match vectors once for the whole batch
+    uint64_t peq[256] = {};
+    for (size_t i = 0; i < m; ++i) {
+        peq[uint8_t(query[i])] |= 1ull << i;
+    }
+    size_t i = 0;
+#if CMD_HAVE_SSE2
+    for (; i + 2 <= count; i += 2) {
+        levenshtein_bits_x2(peq, m, names + i, max, out + i);
+    }
+#endif
+    for (; i < count; ++i) {
+        const size_t n = strlen(names[i]);
+        out[i] = (std::max(n, m) - std::min(n, m) >= max) ? max : levenshtein_bits(peq, m, names[i], n, max);
     }
-    return cmd->on_execute(tokens, out, user);
 }
 
-bool cmd_parser_t::alias_add(cmd_t* cmd, const std::string& alias)
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_trie_t
+
+cmd_trie_t::cmd_trie_t()
+    : node_(1, node_t{ std::string(), {}, {}, 0, UINT32_MAX })
 {
-    assert(cmd && !alias.empty());
-    alias_[alias] = cmd;
-    return true;
 }
 
-bool cmd_parser_t::alias_remove(const std::string& alias)
+size_t cmd_trie_t::child_find(const node_t& node, char ch, bool& found) const
 {
-    auto itt = alias_.find(alias);
-    if (itt != alias_.end()) {
-        alias_.erase(itt);
-        return true;
-    } else {
-        return false;
-    }
+    const auto itt = std::lower_bound(node.child_.begin(), node.child_.end(), ch,
+        [&](uint32_t child, char c) { return node_[child].label_[0] < c; });
+    found = itt != node.child_.end() && node_[*itt].label_[0] == ch;
+    return size_t(itt - node.child_.begin());
 }
 
-bool cmd_parser_t::alias_remove(const cmd_t* cmd)
+void cmd_trie_t::insert(std::string_view key, uint32_t value)
 {
-    for (auto itt = alias_.begin(); itt != alias_.end();) {
-        assert(itt->second);
-        if (itt->second == cmd) {
-            itt = alias_.erase(itt);
+    uint32_t n = 0;
+    size_t i = 0;
+    for (;;) {
+        // account for this value in the subtree
+        node_[n].count_ += 1;
+        node_[n].first_ = std::min(node_[n].first_, value);
+        if (i == key.size()) {
+            node_[n].value_.push_back(value);
+            return;
+        }
+        bool found = false;
+        const size_t slot = child_find(node_[n], key[i], found);
+        if (!found) {
+            // add a new leaf holding the rest of the key
+            const uint32_t leaf = uint32_t(node_.size());
+            node_.push_back(node_t{ std::string(key.substr(i)), {}, { value }, 1, value });
+            node_[n].child_.insert(node_[n].child_.begin() + slot, leaf);
+            return;
+        }
+        const uint32_t c = node_[n].child_[slot];
+        const std::string& label = node_[c].label_;
+        size_t k = 0;
+        while (k < label.size() && i + k < key.size() && label[k] == key[i + k]) {
+            ++k;
+        }
+        if (k < label.size()) {
+            // split the edge where the key diverges from the label
+            const uint32_t mid = uint32_t(node_.size());
+            node_t split{ label.substr(0, k), { c }, {}, node_[c].count_, node_[c].first_ };
+            node_[c].label_.erase(0, k);
+            node_.push_back(std::move(split));
+            node_[n].child_[slot] = mid;
+            n = mid;
         } else {
-            ++itt;
+            n = c;
         }
+        i += k;
     }
-    return true;
 }
 
-// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_t
-
-bool cmd_t::on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user)
+bool cmd_trie_t::find(std::string_view prefix, match_t& out) const
 {
-    (void)user;
-    static const int FUZZYNESS = 3;
-    const bool have_subcomands = !sub_.empty();
-    if (!have_subcomands) {
-        // an empty terminal cmd is a bit weird
-        return false;
-    }
-    const bool have_tokens = !tok.tokens.empty();
-    if (have_tokens) {
-        const char* tok_front = tok.tokens.front().c_str();
-        std::vector<cmd_t*> list;
-        for (const auto& i : sub_) {
-            if (cmd_util_t::levenshtein(i->name_, tok.tokens.front().c_str()) < FUZZYNESS) {
-                list.push_back(i.get());
-            }
+    uint32_t n = 0;
+    size_t i = 0;
+    bool exact = true;
+    while (i < prefix.size()) {
+        bool found = false;
+        const size_t slot = child_find(node_[n], prefix[i], found);
+        if (!found) {
+            return false;
         }
-        cmd_locale_t::no_subcommand(out, tok_front);
-        if (!list.empty()) {
-            cmd_locale_t::did_you_meen(out);
-            auto indent = out.indent();
-            for (cmd_t* cmd : list) {
-                out.println("%s", cmd->name_);
+        n = node_[n].child_[slot];
+        const std::string& label = node_[n].label_;
+        size_t k = 0;
+        while (k < label.size() && i < prefix.size()) {
+            if (label[k] != prefix[i]) {
+                return false;
             }
+            ++k, ++i;
         }
-    } else {
-        print_sub_commands(out);
+        // prefix ended part way along this edge
+        exact = k == label.size();
     }
-    return true;
-};
+    const node_t& node = node_[n];
+    out.node_ = n;
+    out.exact_ = exact && !node.value_.empty();
+    out.count_ = out.exact_ ? uint32_t(node.value_.size()) : node.count_;
+    out.first_ = out.exact_ ? node.value_.front() : node.first_;
+    return out.count_ > 0;
+}
 
-bool cmd_t::alias_add(const std::string& name)
+void cmd_trie_t::collect(uint32_t n, std::vector<uint32_t>& out) const
 {
-    return parser_.alias_add(this, name);
+    const node_t& node = node_[n];
+    out.insert(out.end(), node.value_.begin(), node.value_.end());
+    for (const uint32_t c : node.child_) {
+        collect(c, out);
+    }
 }
 
-// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_stdio_t
+void cmd_trie_t::collect(const match_t& match, std::vector<uint32_t>& out) const
+{
+    const size_t base = out.size();
+    if (match.exact_) {
+        const auto& value = node_[match.node_].value_;
+        out.insert(out.end(), value.begin(), value.end());
+    } else {
+        collect(match.node_, out);
+    }
+    std::sort(out.begin() + base, out.end());
+}
 
-struct cmd_output_stdio_t : public cmd_output_t {
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_list_t
 
-    cmd_output_stdio_t(FILE* fd)
-        : fd_(fd)
-        , cmd_output_t()
-    {
+// position of an exact name in a static index, otherwise SIZE_MAX
+static size_t static_find(const cmd_static_index_t& index, std::string_view name)
+{
+    typedef cmd_static_index_t::entry_t entry_t;
+    if (index.size_ == 0) {
+        return SIZE_MAX;
+    }
+    const uint64_t hash = cmd_static_index_t::hash(name);
+    const entry_t* end = index.entry_ + index.size_;
+    const entry_t* itt = std::lower_bound(index.entry_, end, hash,
+        [](const entry_t& entry, uint64_t h) { return entry.hash_ < h; });
+    for (; itt != end && itt->hash_ == hash; ++itt) {
+        if (name == itt->name_) {
+            return itt->index_;
+        }
     }
+    return SIZE_MAX;
+}
 
-    virtual void lock() override
-    {
+static cmd_t* cmd_ptr(const std::unique_ptr<cmd_t>& cmd)
+{
+    return cmd.get();
+}
 
-        mux_.lock();
-    }
+static cmd_t* cmd_ptr(cmd_t* cmd)
+{
+    return cmd;
+}
 
-    virtual void unlock() override
-    {
-        mux_.unlock();
+// find the commands of an indexed list matching a name or prefix
+template <typename list_t>
+static bool find_in(const list_t& list,
+    const cmd_trie_t& trie,
+    const cmd_static_index_t& index,
+    size_t base,
+    std::string_view sub,
+    std::vector<cmd_t*>& out)
+{
+    // exact names of static commands resolve without walking the trie
+    const size_t ix = static_find(index, sub);
+    if (ix != SIZE_MAX) {
+        out.push_back(cmd_ptr(list[base + ix]));
+        return true;
     }
-
-    virtual void print(bool ind, const char* fmt, va_list& args) override
-    {
-        ind ? indent_apply() : (void)0;
-        vfprintf(fd_, fmt, args);
+    cmd_trie_t::match_t match;
+    if (!trie.find(sub, match)) {
+        return false;
     }
-
-    virtual void println(bool ind, const char* fmt, va_list& args) override
-    {
-        ind ? indent_apply() : (void)0;
-        vfprintf(fd_, fmt, args);
-        eol();
+    // unique matches need not walk the subtree
+    if (match.count_ == 1) {
+        out.push_back(cmd_ptr(list[match.first_]));
+        return true;
     }
+    std::vector<uint32_t> found;
+    trie.collect(match, found);
+    for (const uint32_t i : found) {
+        out.push_back(cmd_ptr(list[i]));
+    }
+    return true;
+}
 
-    virtual void eol() override
-    {
-        fputc('\n', fd_);
+void cmd_list_t::push_back(std::unique_ptr<cmd_t>&& cmd)
+{
+    assert(cmd && cmd->name_);
+    trie_.insert(cmd->name_, uint32_t(list_.size()));
+    list_.push_back(std::move(cmd));
+}
+
+bool cmd_list_t::find(std::string_view sub, std::vector<cmd_t*>& out) const
+{
+    return find_in(list_, trie_, static_, static_base_, sub, out);
+}
+
+void cmd_list_t::set_static(const cmd_static_index_t& index, size_t base)
+{
+    assert(static_.entry_ == nullptr && base + index.size_ <= list_.size());
+    for (size_t i = 0; i < index.size_; ++i) {
+        const auto& entry = index.entry_[i];
+        // NAME must match the name the command was constructed with
+        assert(strcmp(list_[base + entry.index_]->name_, entry.name_) == 0);
+        (void)entry;
     }
+    static_ = index;
+    static_base_ = base;
+}
 
-protected:
-    FILE* fd_;
-    std::mutex mux_;
+cmd_t* cmd_list_t::find_static(std::string_view name) const
+{
+    const size_t ix = static_find(static_, name);
+    return ix == SIZE_MAX ? nullptr : list_[static_base_ + ix].get();
+}
 
-    void indent_apply()
-    {
-        for (uint32_t i = 0; i < indent_; ++i) {
-            fputc(' ', fd_);
-        }
+cmd_t* cmd_list_t::find_exact(std::string_view name) const
+{
+    cmd_trie_t::match_t match;
+    if (trie_.find(name, match) && match.exact_) {
+        return list_[match.first_].get();
     }
-};
+    return nullptr;
+}
 
-cmd_output_t* cmd_output_t::create_output_stdio(FILE* fd)
+void cmd_list_t::snapshot(cmd_tree_t& out) const
 {
-    return new cmd_output_stdio_t(fd);
+    out.roots_.clear();
+    out.roots_.reserve(list_.size());
+    for (const auto& cmd : list_) {
+        out.roots_.push_back(cmd.get());
+    }
+    out.trie_ = trie_;
+    out.static_ = static_;
+    out.static_base_ = static_base_;
 }
 
-// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_dummy_t
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_tree_t
 
-struct cmd_output_dummy_t : public cmd_output_t {
+bool cmd_tree_t::find(std::string_view sub, std::vector<cmd_t*>& out) const
+{
+    return find_in(roots_, trie_, static_, static_base_, sub, out);
+}
 
-    cmd_output_dummy_t()
-        : cmd_output_t()
-    {
+cmd_t* cmd_tree_t::find_exact(std::string_view name) const
+{
+    cmd_trie_t::match_t match;
+    if (trie_.find(name, match) && match.exact_) {
+        return roots_[match.first_];
     }
+    return nullptr;
+}
 
-    virtual void lock() override
-    {
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_epoch_t
+
+cmd_epoch_t::cmd_epoch_t()
+    : epoch_(1)
+    , overflow_(0)
+{
+    for (auto& slot : slots_) {
+        slot.store(0);
     }
+}
 
-    virtual void unlock() override
-    {
+cmd_epoch_t::~cmd_epoch_t()
+{
+    for (const retired_t& retired : retired_) {
+        retired.free_(retired.ptr_);
     }
+}
 
-    virtual void print(bool ind, const char* fmt, va_list& args) override
-    {
+size_t cmd_epoch_t::enter()
+{
+    // spread threads over the slots to avoid contending for the same one
+    const size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t i = 0; i < MAX_READERS; ++i) {
+        const size_t slot = (start + i) % MAX_READERS;
+        uint64_t expect = 0;
+        if (slots_[slot].load(std::memory_order_relaxed) == 0 &&
+            slots_[slot].compare_exchange_strong(expect, epoch_.load())) {
+            return slot;
+        }
     }
+    // waiting for a slot could deadlock a thread already holding them all
+    overflow_.fetch_add(1);
+    return OVERFLOW_SLOT;
+}
 
-    virtual void println(bool ind, const char* fmt, va_list& args) override
+void cmd_epoch_t::retire(void* ptr, void (*free)(void*))
+{
+    assert(ptr && free);
     {
+        std::lock_guard<std::mutex> lock(mux_);
+        // readers entering after the epoch advances can not see the object
+        retired_.push_back(retired_t{ epoch_.fetch_add(1), ptr, free });
     }
+    reclaim();
+}
 
-    virtual void eol() override
+size_t cmd_epoch_t::reclaim()
+{
+    // objects retired during the scan are kept for the next pass
+    uint64_t oldest = epoch_.load();
+    if (overflow_.load()) {
+        // the epoch overflow sections entered at is unknown
+        return 0;
+    }
+    for (const auto& slot : slots_) {
+        const uint64_t epoch = slot.load();
+        if (epoch) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    std::vector<retired_t> expired;
     {
+        std::lock_guard<std::mutex> lock(mux_);
+        auto itt = std::partition(retired_.begin(), retired_.end(),
+            [oldest](const retired_t& retired) { return retired.epoch_ >= oldest; });
+        expired.assign(itt, retired_.end());
+        retired_.erase(itt, retired_.end());
     }
-};
+    for (const retired_t& retired : expired) {
+        retired.free_(retired.ptr_);
+    }
+    return expired.size();
+}
 
-cmd_output_t* cmd_output_t::create_output_dummy()
+size_t cmd_epoch_t::num_retired() const
 {
-    return new cmd_output_dummy_t;
+    std::lock_guard<std::mutex> lock(mux_);
+    return retired_.size();
 }
 
-// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_tokens_t
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_path_cache_t
 
-void cmd_tokens_t::push(std::string input)
+// extend a path hash with the next path token
+static uint64_t path_hash(uint64_t hash, std::string_view token)
 {
-    const char EXP_DELIM = '$';
-    /* flush when input is empty */
-    if (input.empty()) {
-        if (!stage_pair_.first.empty()) {
-            flags.flags_.insert(stage_pair_.first);
-            stage_pair_.first.clear();
-        }
-        return;
+    hash = (hash ^ uint8_t(' ')) * 0x100000001b3ull;
+    for (const char ch : token) {
+        hash = (hash ^ uint8_t(ch)) * 0x100000001b3ull;
     }
-    /* process identifier substitution */
-    if (idents_) {
-        if (input[0] == EXP_DELIM) {
-            const char* temp = input.c_str() + 1;
-            auto itt = idents_->find(temp);
-            if (itt != idents_->end()) {
-                const uint64_t val = itt->second;
-                // todo: convert to hex string
-                input = std::to_string(val);
-            }
+    return hash;
+}
+
+// check that a cached key matches the leading tokens of a token list
+static bool path_equal(std::string_view key,
+    const cmd_path_cache_t::token_list_t& tokens,
+    size_t depth)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < depth; ++i) {
+        const std::string_view token = tokens[i].get();
+        if (i && key.substr(pos++, 1) != " ") {
+            return false;
+        }
+        if (key.substr(pos, token.size()) != token) {
+            return false;
         }
+        pos += token.size();
     }
-    /* add to raw token set */
+    return pos == key.size();
+}
+
+cmd_t* cmd_path_cache_t::find(const token_list_t& tokens, size_t& depth)
+{
+    cmd_t* cmd = nullptr;
+    uint64_t hash = cmd_static_index_t::hash(std::string_view());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        hash = path_hash(hash, tokens[i].get());
+        auto itt = map_.find(hash);
+        if (itt == map_.end() || !path_equal(itt->second->key_, tokens, i + 1)) {
+            break;
+        }
+        // mark as most recently used
+        lru_.splice(lru_.begin(), lru_, itt->second);
+        cmd = itt->second->cmd_;
+        depth = i + 1;
+        // terminal commands cant be extended any further
+        if (cmd->sub_.empty()) {
+            break;
+        }
+    }
+    cmd ? ++hits_ : ++misses_;
+    return cmd;
+}
+
+void cmd_path_cache_t::insert(const token_list_t& tokens, size_t depth, cmd_t* cmd)
+{
+    assert(cmd && depth && depth <= tokens.size());
+    if (capacity_ == 0) {
+        return;
+    }
+    uint64_t hash = cmd_static_index_t::hash(std::string_view());
+    for (size_t i = 0; i < depth; ++i) {
+        hash = path_hash(hash, tokens[i].get());
+    }
+    auto itt = map_.find(hash);
+    if (itt != map_.end()) {
+        // replace an existing or colliding entry
+        lru_.splice(lru_.begin(), lru_, itt->second);
+    } else if (lru_.size() >= capacity_) {
+        // recycle the least recently used entry
+        map_.erase(lru_.back().hash_);
+        lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+        map_[hash] = lru_.begin();
+    } else {
+        lru_.push_front(entry_t());
+        map_[hash] = lru_.begin();
+    }
+    entry_t& entry = lru_.front();
+    entry.hash_ = hash;
+    entry.cmd_ = cmd;
+    entry.key_.clear();
+    for (size_t i = 0; i < depth; ++i) {
+        entry.key_.append(i ? " " : "");
+        entry.key_.append(tokens[i].get());
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_fuzzy_index_t
+
+void cmd_fuzzy_index_t::insert(const char* name, cmd_t* cmd, bool alias)
+{
+    assert(name && cmd);
+    const entry_t entry{ cmd, alias, order_++ };
+    if (node_.empty()) {
+        node_.push_back(node_t{ name, { entry }, {}, 0 });
+        return;
+    }
+    uint32_t n = 0;
+    for (;;) {
+        const uint32_t dist = cmd_util_t::levenshtein(node_[n].key_.c_str(), name);
+        if (dist == 0) {
+            node_[n].entry_.push_back(entry);
+            return;
+        }
+        // descend to the child at the same distance
+        bool found = false;
+        for (const auto& child : node_[n].child_) {
+            if (child.first == dist) {
+                n = child.second;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            const uint32_t leaf = uint32_t(node_.size());
+            node_.push_back(node_t{ name, { entry }, {}, 0 });
+            node_[n].child_.emplace_back(dist, leaf);
+            node_[n].reach_ = std::max(node_[n].reach_, dist);
+            return;
+        }
+    }
+}
+
+cmd_fuzzy_index_t::node_t* cmd_fuzzy_index_t::find_node(const char* name)
+{
+    uint32_t n = 0;
+    while (n < node_.size()) {
+        const uint32_t dist = cmd_util_t::levenshtein(node_[n].key_.c_str(), name);
+        if (dist == 0) {
+            return &node_[n];
+        }
+        uint32_t next = UINT32_MAX;
+        for (const auto& child : node_[n].child_) {
+            if (child.first == dist) {
+                next = child.second;
+                break;
+            }
+        }
+        n = next;
+    }
+    return nullptr;
+}
+
+void cmd_fuzzy_index_t::remove_alias(const char* name)
+{
+    // the node is kept so that the tree stays intact
+    if (node_t* node = find_node(name)) {
+        auto& entry = node->entry_;
+        entry.erase(std::remove_if(entry.begin(), entry.end(),
+                        [](const entry_t& e) { return e.alias_; }),
+            entry.end());
+    }
+}
+
+void cmd_fuzzy_index_t::remove_alias(const cmd_t* cmd)
+{
+    for (node_t& node : node_) {
+        auto& entry = node.entry_;
+        entry.erase(std::remove_if(entry.begin(), entry.end(),
+                        [=](const entry_t& e) { return e.alias_ && e.cmd_ == cmd; }),
+            entry.end());
+    }
+}
+
+size_t cmd_fuzzy_index_t::find(const char* query,
+    uint32_t max_distance,
+    size_t max_results,
+    std::vector<match_t>& out) const
+{
+    assert(query);
+    out.clear();
+    if (node_.empty() || max_distance == 0) {
+        return 0;
+    }
+    // names must be within this radius to match
+    const uint32_t radius = max_distance - 1;
+    std::vector<uint32_t> stack{ 0 };
+    while (!stack.empty()) {
+        const node_t& node = node_[stack.back()];
+        stack.pop_back();
+        // no child can be in range once the distance passes this bound
+        const uint32_t bound = radius + node.reach_ + 1;
+        const uint32_t dist = cmd_util_t::levenshtein(node.key_.c_str(), query, bound);
+        if (dist <= radius) {
+            for (const entry_t& e : node.entry_) {
+                out.push_back(match_t{ dist, e.cmd_, e.alias_ ? node.key_.c_str() : nullptr, e.order_ });
+            }
+        }
+        // triangle inequality bounds the children worth visiting
+        for (const auto& child : node.child_) {
+            if (child.first + radius >= dist && child.first <= dist + radius) {
+                stack.push_back(child.second);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const match_t& a, const match_t& b) {
+        return a.distance_ != b.distance_ ? a.distance_ < b.distance_ : a.order_ < b.order_;
+    });
+    if (out.size() > max_results) {
+        out.resize(max_results);
+    }
+    return out.size();
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_arena_t
+
+void* cmd_arena_t::alloc(size_t size, size_t align)
+{
+    assert(align && (align & (align - 1)) == 0);
+    for (;;) {
+        // try to fit into the current block
+        if (block_ < blocks_.size()) {
+            block_t& block = blocks_[block_];
+            const uintptr_t base = uintptr_t(block.data_.get());
+            const uintptr_t head = (base + used_ + align - 1) & ~uintptr_t(align - 1);
+            const size_t offset = size_t(head - base);
+            if (offset + size <= block.size_) {
+                used_ = offset + size;
+                return block.data_.get() + offset;
+            }
+            // move on to the next retained block
+            ++block_;
+            used_ = 0;
+            continue;
+        }
+        // grow by allocating a new block, doubling each time
+        const size_t shift = std::min<size_t>(blocks_.size(), 16);
+        const size_t bytes = std::max(block_size_ << shift, size + align);
+        blocks_.push_back(block_t{ std::unique_ptr<uint8_t[]>(new uint8_t[bytes]), bytes });
+        ++allocs_;
+        block_ = blocks_.size() - 1;
+        used_ = 0;
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_file_map_t
+
+bool cmd_file_map_t::open(const char* path)
+{
+    assert(path);
+    close();
+#if CMD_HAVE_MMAP
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    size_ = size_t(info.st_size);
+    // an empty file can not be mapped but is still valid
+    if (size_) {
+        void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            size_ = 0;
+            ::close(fd);
+            return false;
+        }
+        // scripts are read front to back
+        madvise(ptr, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(ptr);
+        mapped_ = true;
+    }
+    // the mapping remains valid after the descriptor is closed
+    ::close(fd);
+    return true;
+#else
+    FILE* fd = fopen(path, "rb");
+    if (!fd) {
+        return false;
+    }
+    bool ret = fseek(fd, 0, SEEK_END) == 0;
+    const long size = ret ? ftell(fd) : -1;
+    ret = ret && size >= 0 && fseek(fd, 0, SEEK_SET) == 0;
+    if (ret && size) {
+        char* data = new char[size_t(size)];
+        ret = fread(data, 1, size_t(size), fd) == size_t(size);
+        if (ret) {
+            data_ = data;
+            size_ = size_t(size);
+        } else {
+            delete[] data;
+        }
+    }
+    fclose(fd);
+    return ret;
+#endif
+}
+
+void cmd_file_map_t::close()
+{
+    if (data_) {
+#if CMD_HAVE_MMAP
+        if (mapped_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#else
+        delete[] data_;
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_state_t
+
+bool cmd_state_t::alias_add(cmd_t* cmd, const std::string& alias)
+{
+    assert(cmd && !alias.empty());
+    if (quota_.aliases_ && alias_.size() >= quota_.aliases_ && !alias_find(alias)) {
+        return false;
+    }
+    alias_[alias] = cmd;
+    return true;
+}
+
+bool cmd_state_t::alias_remove(const std::string& alias)
+{
+    return alias_.erase(alias) != 0;
+}
+
+void cmd_state_t::history_push(std::string_view expr)
+{
+    std::unique_lock<std::mutex> lock(history_mux_, std::defer_lock);
+    if (locked_) {
+        lock.lock();
+    }
+    history_.emplace_back(expr);
+    if (quota_.history_ == 0) {
+        return;
+    }
+    history_bytes_ += expr.size();
+    if (history_bytes_ <= quota_.history_) {
+        return;
+    }
+    // recount as history_ may have been changed directly
+    history_bytes_ = 0;
+    for (const std::string& entry : history_) {
+        history_bytes_ += entry.size();
+    }
+    // drop down to half the quota so trimming is amortized
+    size_t drop = 0;
+    while (drop + 1 < history_.size() && history_bytes_ > quota_.history_ / 2) {
+        history_bytes_ -= history_[drop++].size();
+    }
+    history_.erase(history_.begin(), history_.begin() + drop);
+}
+
+size_t cmd_state_t::memory_usage() const
+{
+    // heap storage of a string beyond its small buffer
+    static const size_t small = std::string().capacity();
+    auto heap = [](const std::string& str) {
+        return str.capacity() > small ? str.capacity() + 1 : 0;
+    };
+    // map nodes carry a color and three links
+    static const size_t node = 4 * sizeof(void*);
+    size_t size = sizeof(*this) + history_.capacity() * sizeof(std::string);
+    for (const std::string& entry : history_) {
+        size += heap(entry);
+    }
+    for (const auto& itt : alias_) {
+        size += node + sizeof(itt) + heap(itt.first);
+    }
+    for (const auto& itt : idents_) {
+        size += node + sizeof(itt) + heap(itt.first);
+    }
+    return size;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_parser_t
+
+struct cmd_parser_t::shared_t {
+
+    // state private to one read section
+    struct slot_t {
+        cmd_tokens_pool_t pool_;
+        cmd_path_cache_t cache_;
+        uint64_t version_ = 0;
+    };
+
+    ~shared_t()
+    {
+        delete tree_.load();
+    }
+
+    cmd_epoch_t epoch_;
+    std::atomic<const cmd_tree_t*> tree_{ nullptr };
+    std::array<slot_t, cmd_epoch_t::MAX_READERS> slot_;
+    // version of the last snapshot, guarded by write_mux_
+    uint64_t version_ = 0;
+};
+
+namespace {
+// registers an execution with the parsers watchdog until released
+struct watch_scope_t {
+    watch_scope_t(cmd_watchdog_t* watchdog, std::string_view expr, cmd_cancel_t* cancel)
+        : watchdog_(watchdog)
+        , cancel_(cancel)
+        , id_(0)
+    {
+        if (watchdog_) {
+            // a watched execution always has a token for the watchdog to cancel
+            cancel_ = cancel_ ? cancel_ : &own_;
+            id_ = watchdog_->watch(expr, *cancel_);
+        }
+    }
+
+    ~watch_scope_t()
+    {
+        release();
+    }
+
+    // stop watching, returns true if the watchdog cancelled the execution
+    bool release()
+    {
+        cmd_watchdog_t* watchdog = watchdog_;
+        watchdog_ = nullptr;
+        return watchdog ? watchdog->unwatch(id_) : false;
+    }
+
+    cmd_watchdog_t* watchdog_;
+    cmd_cancel_t* cancel_;
+    cmd_cancel_t own_;
+    uint64_t id_;
+};
+} // namespace {}
+
+struct cmd_parser_t::reader_t {
+
+    reader_t(cmd_parser_t& parser, cmd_state_t& state)
+        : parser_(parser)
+        , state_(state)
+        , shared_(parser.shared_.get())
+        , tree_(nullptr)
+        , slot_(0)
+        , pool_(&parser.tokens_pool_)
+        , cache_(&parser.path_cache_)
+        , cancel_(nullptr)
+        , overrun_(false)
+    {
+        if (shared_) {
+            slot_ = shared_->epoch_.enter();
+            if (slot_ == cmd_epoch_t::OVERFLOW_SLOT) {
+                // every shared slot is taken, use state of our own
+                own_.reset(new shared_t::slot_t);
+            }
+            pool_ = &slot().pool_;
+            cache_ = &slot().cache_;
+            refresh();
+        }
+    }
+
+    ~reader_t()
+    {
+        if (shared_) {
+            shared_->epoch_.exit(slot_);
+        }
+    }
+
+    // load the latest snapshot so that earlier expressions changes are seen
+    void refresh()
+    {
+        if (!shared_) {
+            return;
+        }
+        tree_ = shared_->tree_.load();
+        auto& state = slot();
+        if (state.version_ != tree_->version_) {
+            state.cache_.clear();
+            state.version_ = tree_->version_;
+        }
+    }
+
+    shared_t::slot_t& slot()
+    {
+        return own_ ? *own_ : shared_->slot_[slot_];
+    }
+
+    cmd_t* alias_find(std::string_view alias) const
+    {
+        return tree_ ? tree_->alias_find(alias) : parser_.alias_find(alias);
+    }
+
+    // aliases of a session, which are not cached as they are not shared
+    cmd_t* local_alias_find(std::string_view alias) const
+    {
+        if (&state_ == &parser_ || state_.alias_.empty()) {
+            return nullptr;
+        }
+        return state_.alias_find(alias);
+    }
+
+    bool find(std::string_view sub, std::vector<cmd_t*>& out) const
+    {
+        return tree_ ? tree_->find(sub, out) : parser_.sub_.find(sub, out);
+    }
+
+    cmd_parser_t& parser_;
+    cmd_state_t& state_;
+    shared_t* shared_;
+    const cmd_tree_t* tree_;
+    size_t slot_;
+    // slot state of a section entered while every shared slot was taken
+    std::unique_ptr<shared_t::slot_t> own_;
+    cmd_tokens_pool_t* pool_;
+    cmd_path_cache_t* cache_;
+    cmd_cancel_t* cancel_;
+    // watch of an asynchronous execution still running, see execute_imp()
+    std::unique_ptr<watch_scope_t> watch_;
+    // true if the watchdog cancelled the last execution
+    bool overrun_;
+};
+
+// true if a future has completed
+static bool is_ready(const std::future<bool>& result)
+{
+    return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// call a command, recording its execution statistics if enabled.  commands
+// started with on_execute_async() are only recorded if they completed at once.
+static bool invoke(bool record, cmd_tracer_t* tracer, cmd_t* cmd, cmd_tokens_t& tokens, cmd_output_t& out,
+    cmd_baton_t user, std::future<bool>* async)
+{
+    const cmd_tracer_t::span_t span(tracer, cmd->name_);
+    if (!record) {
+        return async ? (*async = cmd->on_execute_async(tokens, out, user), true) : cmd->on_execute(tokens, out, user);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    bool ok;
+    if (async) {
+        *async = cmd->on_execute_async(tokens, out, user);
+        if (async->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return true;
+        }
+        // take the result to record it and hand it back completed
+        ok = async->get();
+        std::promise<bool> done;
+        done.set_value(ok);
+        *async = done.get_future();
+    } else {
+        ok = cmd->on_execute(tokens, out, user);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    cmd->stats_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), ok);
+    return async ? true : ok;
+}
+
+cmd_parser_t::cmd_parser_t(cmd_baton_t user)
+    : user_(user)
+    , parent_(nullptr)
+    , watchdog_(nullptr)
+    , record_stats_(true)
+    , tracer_(nullptr)
+    , jobs_(new cmd_job_table_t(*this))
+    , publish_defer_(0)
+{
+}
+
+cmd_parser_t::~cmd_parser_t()
+{
+    // jobs may still be executing with the parser
+    jobs_.reset();
+}
+
+void cmd_parser_t::set_concurrent()
+{
+    const std::lock_guard<std::recursive_mutex> lock(write_mux_);
+    if (!shared_) {
+        shared_.reset(new shared_t);
+        locked_ = true;
+        publish();
+    }
+}
+
+void cmd_parser_t::publish()
+{
+    if (!shared_ || publish_defer_) {
+        return;
+    }
+    std::unique_ptr<cmd_tree_t> tree(new cmd_tree_t);
+    sub_.snapshot(*tree);
+    tree->alias_ = alias_;
+    tree->fuzzy_index_ = fuzzy_index_;
+    tree->version_ = ++shared_->version_;
+    const cmd_tree_t* old = shared_->tree_.exchange(tree.release());
+    if (old) {
+        shared_->epoch_.retire(old);
+    }
+}
+
+// strip a trailing '&' from a line, returning true if there was one
+static bool split_background(std::string_view& line)
+{
+    // lines may be nul terminated within a larger buffer, e.g. by the REPL
+    const std::string_view text = line.substr(0, line.find('\0'));
+    const size_t last = text.find_last_not_of(" \r\t");
+    if (last == text.npos || text[last] != '&') {
+        return false;
+    }
+    line = text.substr(0, last);
+    line = line.substr(0, line.find_last_not_of(" \r\t") + 1);
+    return true;
+}
+
+// split a line into its ';' delimited expressions, skipping empty ones.
+// fn(expr, trimmed) gets each expression as written and without surrounding
+// whitespace, and ends the split early by returning false.
+template <typename fn_t>
+static bool split_exprs(std::string_view line, fn_t&& fn)
+{
+    // the REPL passes its whole line buffer, which may hold an older line
+    // after the '\0'
+    const std::string_view text = line.substr(0, line.find('\0'));
+    if (text.empty() && !line.empty()) {
+        // a blank REPL line still repeats the last command
+        return fn(line, text);
+    }
+    line = text;
+    size_t ix = 0;
+    for (bool active = true; active;) {
+        std::string_view expr;
+        const size_t next = line.find(';', ix);
+        if (next == line.npos) {
+            expr = line.substr(ix);
+            active = false;
+        } else {
+            expr = line.substr(ix, next - ix);
+            ix = next + 1;
+        }
+        if (expr.empty()) {
+            continue;
+        }
+        std::string_view trimmed;
+        const size_t first = expr.find_first_not_of(" \r\t");
+        if (first != expr.npos) {
+            trimmed = expr.substr(first, expr.find_last_not_of(" \r\t") + 1 - first);
+        }
+        if (!fn(expr, trimmed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cmd_parser_t::execute(
+    const std::string& expr,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out);
+    std::string_view line = expr;
+    if (split_background(line)) {
+        if (!concurrent()) {
+            const auto guard = cmd_out->guard();
+            cmd_out->mark();
+            return cmd_locale_t::not_concurrent(*cmd_out), false;
+        }
+        const uint64_t id = jobs_->start(line, cmd_out, user);
+        const auto guard = cmd_out->guard();
+        cmd_out->mark();
+        cmd_locale_t::job_status(*cmd_out, id, "running", std::string(line).c_str());
+        return true;
+    }
+    // aquire the output guard
+    const auto guard = cmd_out->guard();
+    cmd_out->mark();
+    reader_t reader(*this, *this);
+    reader.cancel_ = cancel;
+    return execute_line(reader, expr, cmd_out, user);
+}
+
+// split a buffer into '\n' delimited lines
+static void split_lines(std::string_view buffer, std::vector<std::string_view>& lines)
+{
+    lines.reserve(std::count(buffer.begin(), buffer.end(), '\n') + 1);
+    size_t ix = 0;
+    while (ix < buffer.size()) {
+        size_t next = buffer.find('\n', ix);
+        next = (next == buffer.npos) ? buffer.size() : next;
+        lines.push_back(buffer.substr(ix, next - ix));
+        ix = next + 1;
+    }
+}
+
+bool cmd_parser_t::execute_batch(
+    const std::string_view* lines,
+    size_t num_lines,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::vector<bool>* status,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out && (lines || !num_lines));
+    // aquire the output guard once for the whole batch
+    const auto guard = cmd_out->guard();
+    reader_t reader(*this, *this);
+    reader.cancel_ = cancel;
+    return execute_lines(reader, lines, num_lines, *cmd_out, user, status);
+}
+
+bool cmd_parser_t::execute_batch(
+    std::string_view buffer,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::vector<bool>* status,
+    cmd_cancel_t* cancel)
+{
+    // split into lines up front so the batch runs under one guard
+    std::vector<std::string_view> lines;
+    split_lines(buffer, lines);
+    return execute_batch(lines.data(), lines.size(), cmd_out, user, status, cancel);
+}
+
+bool cmd_parser_t::execute_lines(
+    reader_t& reader,
+    const std::string_view* lines,
+    size_t num_lines,
+    cmd_output_t& out,
+    cmd_baton_t user,
+    std::vector<bool>* status)
+{
+    if (status) {
+        status->assign(num_lines, true);
+    }
+    bool ret = true;
+    for (size_t i = 0; i < num_lines; ++i) {
+        const std::string_view line = lines[i];
+        // every line is marked so that output offsets match line numbers
+        out.mark();
+        // blank lines would otherwise repeat the last command
+        if (line.find_first_not_of(" \r\t") == line.npos) {
+            continue;
+        }
+        // a cancelled batch fails its remaining lines without running them
+        if (reader.cancel_ && reader.cancel_->cancelled()) {
+            cmd_locale_t::command_cancelled(out, std::string(line).c_str());
+            if (status) {
+                std::fill(status->begin() + i, status->end(), false);
+            }
+            for (++i; i < num_lines; ++i) {
+                out.mark();
+            }
+            ret = false;
+            break;
+        }
+        if (!execute_line(reader, line, &out, user)) {
+            ret = false;
+            if (status) {
+                (*status)[i] = false;
+            }
+        }
+    }
+    const cmd_tracer_t::span_t span(tracer(), "flush");
+    out.flush();
+    return ret;
+}
+
+bool cmd_parser_t::execute_line(
+    std::string_view line,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    cmd_state_t* state,
+    cmd_cancel_t* cancel)
+{
+    reader_t reader(*this, state ? *state : *this);
+    reader.cancel_ = cancel;
+    return execute_line(reader, line, cmd_out, user);
+}
+
+bool cmd_parser_t::execute_line(
+    reader_t& reader,
+    std::string_view line,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user)
+{
+    assert(cmd_out);
+    return split_exprs(line, [&](std::string_view cmd, std::string_view) {
+        // execute single command
+        const cmd_cancel_t* cancel = reader.cancel_;
+        if (cancel && cancel->cancelled()) {
+            const std::string cancelled(cmd);
+            return cmd_locale_t::command_cancelled(*cmd_out, cancelled.c_str()), false;
+        }
+        if (!execute_imp(reader, cmd, cmd_out, user)) {
+            const std::string failed(cmd);
+            if (reader.overrun_) {
+                return cmd_locale_t::command_timeout(*cmd_out, failed.c_str()), false;
+            }
+            if (cancel && cancel->cancelled()) {
+                return cmd_locale_t::command_cancelled(*cmd_out, failed.c_str()), false;
+            }
+            return cmd_locale_t::command_failed(*cmd_out, failed.c_str()), false;
+        }
+        return true;
+    });
+}
+
+bool cmd_parser_t::execute_imp(
+    reader_t& reader,
+    std::string_view expr,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::future<bool>* async)
+{
+    assert(cmd_out);
+    cmd_output_t& out = *cmd_out;
+    cmd_tracer_t* tracer = tracer_.load(std::memory_order_acquire);
+    const cmd_tracer_t::span_t span(tracer, "execute");
+    reader.overrun_ = false;
+    // see commands and aliases added by earlier expressions
+    reader.refresh();
+    cmd_state_t& state = reader.state_;
+    // an empty expression is never a request to repeat
+    const bool empty = expr.empty();
+    // the REPL passes its whole line buffer, which is padded with '\0'
+    expr = expr.substr(0, expr.find('\0'));
+    // only copy the previous command when we need to repeat it
+    std::string prev_cmd;
+    const bool repeat = expr.find_first_not_of(" \r\t") == expr.npos;
+    {
+        std::unique_lock<std::mutex> lock(state.history_mux_, std::defer_lock);
+        if (state.locked_) {
+            lock.lock();
+        }
+        // note: last_cmd() makes sure there is always a previous command
+        if (repeat) {
+            prev_cmd = state.last_cmd();
+        }
+    }
+    // add to history buffer
+    state.history_push(expr);
+    // tokenize command string
+    const auto lease = reader.pool_->acquire(&state.idents_);
+    cmd_tokens_t& tokens = *lease;
+    tokens.state_ = &state;
+    tokens.cancel_ = reader.cancel_;
+    size_t num_tokens;
+    {
+        const cmd_tracer_t::span_t tokenize(tracer, "tokenize");
+        std::shared_lock<std::shared_mutex> lock(state.idents_mux_, std::defer_lock);
+        if (state.locked_) {
+            lock.lock();
+        }
+        num_tokens = tokens.tokenize(expr, nullptr, 0);
+    }
+    if (num_tokens == 0) {
+        if (!empty && !prev_cmd.empty()) {
+            out.println(CMD_FMT("> {}"), prev_cmd);
+            return execute_imp(reader, prev_cmd, cmd_out, user, async);
+        } else {
+            // no commands entered
+            return false;
+        }
+    }
+    cmd_t* cmd = resolve(reader, tokens, out);
+    if (!cmd) {
+        return false;
+    }
+    if (!tokens.tokens.empty()) {
+        if (tokens.tokens.back() == "?") {
+            return cmd->on_usage(out, user);
+        }
+    }
+    if (!async) {
+        watch_scope_t watch(watchdog_, expr, reader.cancel_);
+        tokens.cancel_ = watch.cancel_;
+        const bool ok = invoke(record_stats_.load(std::memory_order_relaxed), tracer, cmd, tokens, out, user, nullptr);
+        reader.overrun_ = watch.release();
+        return ok;
+    }
+    // asynchronous work stays watched until its result is ready
+    std::unique_ptr<watch_scope_t> watch(new watch_scope_t(watchdog_, expr, reader.cancel_));
+    tokens.cancel_ = watch->cancel_;
+    const bool ok = invoke(record_stats_.load(std::memory_order_relaxed), tracer, cmd, tokens, out, user, async);
+    if (async->valid() && !is_ready(*async)) {
+        reader.watch_ = std::move(watch);
+    } else {
+        reader.overrun_ = watch->release();
+    }
+    return ok;
+}
+
+cmd_t* cmd_parser_t::resolve(reader_t& reader, cmd_tokens_t& tokens, cmd_output_t& out)
+{
+    const cmd_tokens_t::token_list_t& args = tokens.tokens.tokens_;
+    assert(!args.empty());
+    std::vector<cmd_t*> cmd_vec;
+    cmd_tracer_t* tracer = tracer_.load(std::memory_order_acquire);
+    // try the cache of previously resolved paths
+    cmd_path_cache_t& path_cache = *reader.cache_;
+    size_t depth = 0;
+    cmd_t* cmd;
+    {
+        const cmd_tracer_t::span_t span(tracer, "alias");
+        cmd = reader.local_alias_find(args.front().get());
+        if (cmd) {
+            ++depth;
+        } else {
+            cmd = path_cache.find(args, depth);
+        }
+        if (!cmd) {
+            // check for aliases
+            cmd = reader.alias_find(args.front().get());
+            if (cmd) {
+                path_cache.insert(args, ++depth, cmd);
+            }
+        }
+    }
+    const cmd_tracer_t::span_t span(tracer, "walk");
+    // root commands are found through the reader
+    cmd_list_t* list = cmd ? &(cmd->sub_) : nullptr;
+    while (depth < args.size()) {
+        // find best matching sub command
+        cmd_vec.clear();
+        if (list) {
+            find_matches(*list, args[depth].c_str(), cmd_vec);
+        } else {
+            reader.find(args[depth].get(), cmd_vec);
+        }
+        if (cmd_vec.size() == 0) {
+            // no sub commands to match
+            break;
+        } else if (cmd_vec.size() == 1) {
+            cmd = cmd_vec.front();
+            list = &cmd->sub_;
+            path_cache.insert(args, ++depth, cmd);
+        } else {
+            // ambiguous matches (show possible matches)
+            cmd = nullptr;
+            cmd_locale_t::possible_completions(out);
+            auto indent = out.indent(4);
+            for (auto c : cmd_vec) {
+                out.println(CMD_FMT("{}"), c->name_);
+            }
+            break;
+        }
+    }
+    if (!cmd) {
+        if (parent_) {
+            //XXX: we need to pass the entire thing to the parent ??
+        }
+//      else {
+            cmd_locale_t::invalid_command(out);
+//      }
+        if (cmd_vec.empty()) {
+            suggest(args.front().c_str(), out);
+        }
+        return nullptr;
+    }
+    // remove the path tokens
+    for (; depth; --depth) {
+        tokens.tokens.pop();
+    }
+    return cmd;
+}
+
+bool cmd_parser_t::prepare(
+    std::string_view expr,
+    cmd_prepared_t& prepared,
+    cmd_output_t* cmd_out)
+{
+    reader_t reader(*this, *this);
+    return prepare_imp(reader, expr, prepared, cmd_out);
+}
+
+bool cmd_parser_t::prepare_imp(
+    reader_t& reader,
+    std::string_view expr,
+    cmd_prepared_t& prepared,
+    cmd_output_t* cmd_out)
+{
+    assert(cmd_out);
+    prepared = cmd_prepared_t();
+    // identifiers are left in place to be bound at execution
+    const auto lease = reader.pool_->acquire(nullptr);
+    cmd_tokens_t& tokens = *lease;
+    if (tokens.tokenize(expr, nullptr, 0) == 0) {
+        return false;
+    }
+    cmd_t* cmd = resolve(reader, tokens, *cmd_out);
+    if (!cmd) {
+        return false;
+    }
+    // keep everything after the path as the argument template
+    for (const cmd_token_t& token : tokens.tokens.raw_) {
+        prepared.args_.append(prepared.args_.empty() ? "" : " ");
+        prepared.args_.append(token.get());
+    }
+    prepared.expr_.assign(expr.data(), expr.size());
+    prepared.cmd_ = cmd;
+    return true;
+}
+
+bool cmd_parser_t::execute(
+    const cmd_prepared_t& prepared,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    const cmd_idents_t* binds,
+    const char* const* args,
+    size_t num_args,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out && prepared.valid());
+    // aquire the output guard
+    const auto guard = cmd_out->guard();
+    cmd_out->mark();
+    reader_t reader(*this, *this);
+    return execute_prepared(prepared, *reader.pool_, *this, *cmd_out, user, binds, args, num_args, cancel);
+}
+
+bool cmd_parser_t::execute_prepared(
+    const cmd_prepared_t& prepared,
+    cmd_tokens_pool_t& pool,
+    cmd_state_t& state,
+    cmd_output_t& out,
+    cmd_baton_t user,
+    const cmd_idents_t* binds,
+    const char* const* args,
+    size_t num_args,
+    cmd_cancel_t* cancel)
+{
+    const auto lease = pool.acquire(&state.idents_);
+    cmd_tokens_t& tokens = *lease;
+    tokens.state_ = &state;
+    tokens.cancel_ = cancel;
+    tokens.bind(binds);
+    {
+        std::shared_lock<std::shared_mutex> lock(state.idents_mux_, std::defer_lock);
+        if (state.locked_) {
+            lock.lock();
+        }
+        tokens.tokenize(prepared.args_, args, num_args);
+    }
+    cmd_t* cmd = prepared.cmd_;
+    bool ret;
+    bool overrun = false;
+    if (!tokens.tokens.empty() && tokens.tokens.back() == "?") {
+        ret = cmd->on_usage(out, user);
+    } else if (cancel && cancel->cancelled()) {
+        ret = false;
+    } else {
+        watch_scope_t watch(watchdog_, prepared.expr_, cancel);
+        tokens.cancel_ = watch.cancel_;
+        ret = invoke(record_stats_.load(std::memory_order_relaxed), tracer(), cmd, tokens, out, user, nullptr);
+        overrun = watch.release();
+    }
+    if (!ret) {
+        if (overrun) {
+            cmd_locale_t::command_timeout(out, prepared.expr_.c_str());
+        } else if (cancel && cancel->cancelled()) {
+            cmd_locale_t::command_cancelled(out, prepared.expr_.c_str());
+        } else {
+            cmd_locale_t::command_failed(out, prepared.expr_.c_str());
+        }
+    }
+    return ret;
+}
+
+bool cmd_parser_t::alias_add(cmd_t* cmd, const std::string& alias)
+{
+    assert(cmd && !alias.empty());
+    const auto lock = write_lock();
+    alias_[alias] = cmd;
+    path_cache_.clear();
+    fuzzy_index_.remove_alias(alias.c_str());
+    fuzzy_index_.insert(alias.c_str(), cmd, true);
+    publish();
+    return true;
+}
+
+bool cmd_parser_t::alias_remove(const std::string& alias)
+{
+    const auto lock = write_lock();
+    auto itt = alias_.find(alias);
+    if (itt != alias_.end()) {
+        alias_.erase(itt);
+        path_cache_.clear();
+        fuzzy_index_.remove_alias(alias.c_str());
+        publish();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool cmd_parser_t::alias_remove(const cmd_t* cmd)
+{
+    const auto lock = write_lock();
+    for (auto itt = alias_.begin(); itt != alias_.end();) {
+        assert(itt->second);
+        if (itt->second == cmd) {
+            itt = alias_.erase(itt);
+        } else {
+            ++itt;
+        }
+    }
+    path_cache_.clear();
+    fuzzy_index_.remove_alias(cmd);
+    publish();
+    return true;
+}
+
+void cmd_parser_t::command_added(cmd_t* cmd)
+{
+    assert(cmd);
+    const auto lock = write_lock();
+    path_cache_.clear();
+    fuzzy_index_.insert(cmd->name_, cmd, false);
+    publish();
+}
+
+// print the closest names to an unknown name
+static bool print_suggestions(
+    const cmd_fuzzy_index_t& index,
+    const char* name,
+    cmd_output_t& out)
+{
+    static const size_t MAX_SUGGESTIONS = 8;
+    std::vector<cmd_fuzzy_index_t::match_t> matches;
+    index.find(name, cmd_fuzzy_index_t::FUZZYNESS, MAX_SUGGESTIONS, matches);
+    if (matches.empty()) {
+        return false;
+    }
+    cmd_locale_t::did_you_meen(out);
+    auto indent = out.indent();
+    std::string path;
+    for (const auto& match : matches) {
+        path.clear();
+        match.cmd_->get_command_path(path);
+        if (match.alias_) {
+            out.println(CMD_FMT("{} - {}"), match.alias_, path);
+        } else {
+            out.println(CMD_FMT("{}"), path);
+        }
+    }
+    return true;
+}
+
+bool cmd_parser_t::suggest(const char* name, cmd_output_t& out) const
+{
+    if (!shared_) {
+        return print_suggestions(fuzzy_index_, name, out);
+    }
+    // the snapshot must outlive the matches, which point into its index
+    const size_t slot = shared_->epoch_.enter();
+    const bool ret = print_suggestions(shared_->tree_.load()->fuzzy_index_, name, out);
+    shared_->epoch_.exit(slot);
+    return ret;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_session_t
+
+bool cmd_session_t::execute(
+    const std::string& expr,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out);
+    const auto guard = cmd_out->guard();
+    cmd_out->mark();
+    cmd_parser_t::reader_t reader(parser_, *this);
+    reader.cancel_ = cancel;
+    return parser_.execute_line(reader, expr, cmd_out, user);
+}
+
+bool cmd_session_t::execute_batch(
+    std::string_view buffer,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::vector<bool>* status,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out);
+    std::vector<std::string_view> lines;
+    split_lines(buffer, lines);
+    const auto guard = cmd_out->guard();
+    cmd_parser_t::reader_t reader(parser_, *this);
+    reader.cancel_ = cancel;
+    return parser_.execute_lines(reader, lines.data(), lines.size(), *cmd_out, user, status);
+}
+
+bool cmd_session_t::prepare(
+    std::string_view expr,
+    cmd_prepared_t& prepared,
+    cmd_output_t* cmd_out)
+{
+    cmd_parser_t::reader_t reader(parser_, *this);
+    return parser_.prepare_imp(reader, expr, prepared, cmd_out);
+}
+
+bool cmd_session_t::execute(
+    const cmd_prepared_t& prepared,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    const cmd_idents_t* binds,
+    const char* const* args,
+    size_t num_args,
+    cmd_cancel_t* cancel)
+{
+    assert(cmd_out && prepared.valid());
+    const auto guard = cmd_out->guard();
+    cmd_out->mark();
+    cmd_parser_t::reader_t reader(parser_, *this);
+    return parser_.execute_prepared(prepared, *reader.pool_, *this, *cmd_out, user, binds, args, num_args, cancel);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_executor_t
+
+namespace {
+// append formatted text to a string
+void append_format(std::string& text, const char* fmt, va_list& args)
+{
+    std::array<char, 256> temp;
+    va_list copy;
+    va_copy(copy, args);
+    const int len = vsnprintf(temp.data(), temp.size(), fmt, copy);
+    va_end(copy);
+    if (len <= 0) {
+        return;
+    }
+    if (size_t(len) < temp.size()) {
+        text.append(temp.data(), size_t(len));
+    } else {
+        // format again directly into the string
+        const size_t old = text.size();
+        text.resize(old + size_t(len) + 1);
+        vsnprintf(&text[old], size_t(len) + 1, fmt, args);
+        text.resize(old + size_t(len));
+    }
+}
+
+// output stream appending to a string, used to render lines off thread
+struct cmd_output_string_t : public cmd_output_t {
+
+    cmd_output_string_t()
+        : text_(nullptr)
+    {
+    }
+
+    virtual void lock() override
+    {
+    }
+
+    virtual void unlock() override
+    {
+    }
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        append(fmt, args);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        append(fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        text_->push_back('\n');
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+        ind ? indent_apply() : (void)0;
+        text_->append(text, size);
+        eol ? text_->push_back('\n') : (void)0;
+    }
+
+    /// @brief string to append output to.
+    std::string* text_;
+
+protected:
+    void indent_apply()
+    {
+        text_->append(indent_, ' ');
+    }
+
+    void append(const char* fmt, va_list& args)
+    {
+        assert(text_);
+        append_format(*text_, fmt, args);
+    }
+};
+} // namespace {}
+
+struct cmd_executor_t::worker_t {
+    cmd_tokens_pool_t pool_;
+    cmd_output_string_t out_;
+};
+
+cmd_executor_t::cmd_executor_t(cmd_parser_t& parser, uint32_t num_threads)
+    : parser_(parser)
+    , num_units_(0)
+    , next_(0)
+    , user_(nullptr)
+    , marking_(false)
+    , marked_(0)
+    , num_edges_(0)
+    , finished_(0)
+    , generation_(0)
+    , open_(false)
+    , active_(0)
+    , quit_(false)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(new worker_t);
+    }
+    // the calling thread acts as the first worker
+    for (uint32_t i = 1; i < num_threads; ++i) {
+        worker_t& worker = *workers_[i];
+        threads_.emplace_back([this, &worker]() { thread_main(worker); });
+    }
+}
+
+cmd_executor_t::~cmd_executor_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(mux_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool cmd_executor_t::execute(
+    const std::string_view* lines,
+    size_t num_lines,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::vector<bool>* status)
+{
+    assert(cmd_out);
+    bool ret;
+    {
+        // aquire the output guard once for the whole script
+        const auto guard = cmd_out->guard();
+        marking_ = true;
+        ret = execute_lines(lines, num_lines, *cmd_out, user, status);
+        marking_ = false;
+        cmd_out->flush();
+    }
+    return ret;
+}
+
+bool cmd_executor_t::execute(
+    std::string_view buffer,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user,
+    std::vector<bool>* status)
+{
+    std::vector<std::string_view> lines;
+    split_lines(buffer, lines);
+    return execute(lines.data(), lines.size(), cmd_out, user, status);
+}
+
+bool cmd_executor_t::execute_lines(
+    const std::string_view* lines,
+    size_t num_lines,
+    cmd_output_t& out,
+    cmd_baton_t user,
+    std::vector<bool>* status,
+    const char* script)
+{
+    assert(lines || !num_lines);
+    if (status) {
+        status->assign(num_lines, true);
+    }
+    user_ = user;
+    num_units_ = 0;
+    marked_ = 0;
+    bool ret = true;
+    for (size_t i = 0; i < num_lines; ++i) {
+        const std::string_view line = lines[i];
+        // blank lines would otherwise repeat the last command
+        if (line.find_first_not_of(" \r\t") == line.npos) {
+            continue;
+        }
+        if (num_units_ == units_.size()) {
+            units_.emplace_back();
+        }
+        schedule_t type = schedule(line, units_[num_units_]);
+        if (type == e_flush) {
+            ret &= run_units(out, status, script);
+            type = schedule(line, units_[num_units_]);
+            assert(type != e_flush);
+        }
+        if (type == e_scheduled) {
+            units_[num_units_].line_ = i;
+            ++num_units_;
+            if (num_units_ == WINDOW) {
+                ret &= run_units(out, status, script);
+            }
+            continue;
+        }
+        // a barrier must observe every line before it
+        ret &= run_units(out, status, script);
+        mark_lines(out, i);
+        if (!parser_.execute_line(line, &out, user)) {
+            ret = false;
+            if (status) {
+                (*status)[i] = false;
+            }
+            if (script) {
+                cmd_locale_t::script_error(out, script, i + 1);
+            }
+        }
+    }
+    ret &= run_units(out, status, script);
+    if (num_lines) {
+        mark_lines(out, num_lines - 1);
+    }
+    return ret;
+}
+
+void cmd_executor_t::mark_lines(cmd_output_t& out, size_t line)
+{
+    for (; marking_ && marked_ <= line; ++marked_) {
+        out.mark();
+    }
+}
+
+cmd_executor_t::schedule_t cmd_executor_t::schedule(std::string_view line, unit_t& unit)
+{
+    // resolution errors are discarded, the line is then run as a barrier so
+    // that they are reported in order
+    worker_t& worker = *workers_[0];
+    unit.text_.clear();
+    unit.num_exprs_ = 0;
+    unit.pending_ = 0;
+    unit.dependents_.clear();
+    worker.out_.text_ = &unit.text_;
+    access_.clear();
+    const bool scheduled = split_exprs(line, [&](std::string_view expr, std::string_view trimmed) {
+        // empty expressions repeat the last command
+        if (trimmed.empty()) {
+            return false;
+        }
+        if (unit.num_exprs_ == unit.exprs_.size()) {
+            unit.exprs_.emplace_back();
+        }
+        cmd_prepared_t& prepared = unit.exprs_[unit.num_exprs_];
+        if (!parser_.prepare(expr, prepared, &worker.out_)) {
+            return false;
+        }
+        // ask the command what it will touch
+        const auto lease = worker.pool_.acquire(nullptr);
+        cmd_tokens_t& tokens = *lease;
+        tokens.tokenize(prepared.args_, nullptr, 0);
+        if (!prepared.cmd_->on_access(tokens, access_)) {
+            return false;
+        }
+        // identifier arguments are substituted when the tokens are bound
+        for (const cmd_token_t& token : tokens.tokens.raw_) {
+            const std::string_view str = token.get();
+            if (str.size() > 1 && str[0] == '$') {
+                access_.reads_.emplace_back(str.substr(1));
+            }
+        }
+        ++unit.num_exprs_;
+        return true;
+    });
+    if (!scheduled) {
+        return e_barrier;
+    }
+    unit.text_.clear();
+    const schedule_t type = add_access(num_units_, access_);
+    if (type != e_scheduled) {
+        return type;
+    }
+    // keep the history in program order
+    for (size_t i = 0; i < unit.num_exprs_; ++i) {
+        parser_.history_push(unit.exprs_[i].expr_);
+    }
+    return e_scheduled;
+}
+
+cmd_executor_t::schedule_t cmd_executor_t::add_access(size_t index, const cmd_access_t& access)
+{
+    // check everything before modifying any state
+    if (access.all_ && !writers_.empty()) {
+        return e_flush;
+    }
+    std::unique_lock<std::shared_mutex> lock(parser_.idents_mux_, std::defer_lock);
+    if (parser_.concurrent()) {
+        lock.lock();
+    }
+    for (const std::string& name : access.reads_) {
+        auto itt = idents_.find(name);
+        if (itt != idents_.end() && itt->second.fresh_) {
+            // a placeholder could be read in place of an undefined identifier
+            return e_flush;
+        }
+        if (parser_.idents_.find(name) == parser_.idents_.end()) {
+            // leave the error to serial execution
+            return e_barrier;
+        }
+    }
+    if (!all_readers_.empty()) {
+        for (const std::string& name : access.writes_) {
+            // a placeholder would be visible to readers of every identifier
+            if (parser_.idents_.find(name) == parser_.idents_.end()) {
+                return e_flush;
+            }
+        }
+    }
+    // add edges from earlier conflicting units
+    for (const std::string& name : access.reads_) {
+        ident_t& ident = idents_.try_emplace(name).first->second;
+        add_edge(ident.writer_, index);
+        ident.readers_.push_back(index);
+    }
+    if (access.all_) {
+        all_readers_.push_back(index);
+    }
+    for (const std::string& name : access.writes_) {
+        const auto added = idents_.try_emplace(name);
+        ident_t& ident = added.first->second;
+        if (added.second) {
+            // insert now so workers never change the map structure
+            ident.fresh_ = parser_.idents_.emplace(name, 0).second;
+        }
+        add_edge(ident.writer_, index);
+        for (size_t reader : ident.readers_) {
+            add_edge(reader, index);
+        }
+        for (size_t reader : all_readers_) {
+            add_edge(reader, index);
+        }
+        if (ident.fresh_) {
+            ident.defs_.push_back(index);
+        }
+        ident.writer_ = index;
+        ident.readers_.clear();
+        writers_.push_back(index);
+    }
+    return e_scheduled;
+}
+
+void cmd_executor_t::add_edge(size_t from, size_t to)
+{
+    // a unit can not wait on itself or an unwritten identifier
+    if (from == SIZE_MAX || from == to) {
+        return;
+    }
+    assert(from < to);
+    units_[from].dependents_.push_back(to);
+    ++units_[to].pending_;
+    ++num_edges_;
+}
+
+void cmd_executor_t::clean_idents()
+{
+    std::unique_lock<std::shared_mutex> lock(parser_.idents_mux_, std::defer_lock);
+    if (parser_.concurrent()) {
+        lock.lock();
+    }
+    for (const auto& itt : idents_) {
+        const ident_t& ident = itt.second;
+        if (!ident.fresh_) {
+            continue;
+        }
+        bool defined = false;
+        for (size_t def : ident.defs_) {
+            defined |= units_[def].ok_;
+        }
+        if (!defined) {
+            parser_.idents_.erase(itt.first);
+        }
+    }
+    idents_.clear();
+    all_readers_.clear();
+    writers_.clear();
+    num_edges_ = 0;
+}
+
+bool cmd_executor_t::run_units(cmd_output_t& out, std::vector<bool>* status, const char* script)
+{
+    if (num_units_ == 0) {
+        return true;
+    }
+    next_.store(0);
+    if (num_edges_) {
+        // seed the ready queue with units that have no dependencies
+        ready_.clear();
+        finished_ = 0;
+        for (size_t i = 0; i < num_units_; ++i) {
+            if (units_[i].pending_ == 0) {
+                ready_.push_back(i);
+            }
+        }
+    }
+    if (!threads_.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mux_);
+            ++generation_;
+            open_ = true;
+        }
+        wake_.notify_all();
+    }
+    work(*workers_[0]);
+    if (!threads_.empty()) {
+        // wait for any units still running on other threads
+        std::unique_lock<std::mutex> lock(mux_);
+        open_ = false;
+        idle_.wait(lock, [this]() { return active_ == 0; });
+    }
+    // emit output in line order
+    bool ret = true;
+    for (size_t i = 0; i < num_units_; ++i) {
+        const unit_t& unit = units_[i];
+        mark_lines(out, unit.line_);
+        if (!unit.text_.empty()) {
+            out.emit_text(false, unit.text_.data(), unit.text_.size(), false);
+        }
+        if (!unit.ok_) {
+            ret = false;
+            if (status) {
+                (*status)[unit.line_] = false;
+            }
+            if (script) {
+                cmd_locale_t::script_error(out, script, unit.line_ + 1);
+            }
+        }
+    }
+    clean_idents();
+    num_units_ = 0;
+    return ret;
+}
+
+void cmd_executor_t::work(worker_t& worker)
+{
+    if (num_edges_ == 0) {
+        // independent units are claimed in order
+        for (;;) {
+            const size_t i = next_.fetch_add(1);
+            if (i >= num_units_) {
+                break;
+            }
+            run_unit(worker, units_[i]);
+        }
+        return;
+    }
+    for (;;) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> lock(ready_mux_);
+            ready_cv_.wait(lock, [this]() { return !ready_.empty() || finished_ == num_units_; });
+            if (ready_.empty()) {
+                break;
+            }
+            i = ready_.front();
+            ready_.pop_front();
+        }
+        run_unit(worker, units_[i]);
+        {
+            // release the units that were waiting on this one
+            std::lock_guard<std::mutex> lock(ready_mux_);
+            ++finished_;
+            for (size_t dep : units_[i].dependents_) {
+                if (--units_[dep].pending_ == 0) {
+                    ready_.push_back(dep);
+                }
+            }
+        }
+        ready_cv_.notify_all();
+    }
+}
+
+void cmd_executor_t::run_unit(worker_t& worker, unit_t& unit)
+{
+    worker.out_.text_ = &unit.text_;
+    unit.ok_ = true;
+    for (size_t j = 0; j < unit.num_exprs_; ++j) {
+        const cmd_prepared_t& prepared = unit.exprs_[j];
+        if (!parser_.execute_prepared(prepared, worker.pool_, parser_, worker.out_, user_, nullptr, nullptr, 0, nullptr)) {
+            unit.ok_ = false;
+            break;
+        }
+    }
+}
+
+void cmd_executor_t::thread_main(worker_t& worker)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mux_);
+            wake_.wait(lock, [&]() { return quit_ || (open_ && generation_ != seen); });
+            if (quit_) {
+                return;
+            }
+            seen = generation_;
+            ++active_;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> lock(mux_);
+            --active_;
+        }
+        idle_.notify_all();
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_async_t
+
+struct cmd_async_t::task_t {
+    uint64_t id_;
+    std::string expr_;
+    std::string text_;
+    cmd_output_string_t out_;
+    // token the command observes, kept until the task is delivered
+    cmd_cancel_t cancel_;
+    // set if the command was started, once running it is ready only after
+    // the task delivered itself
+    std::future<bool> result_;
+    // watch of a command still running, released as soon as it completes
+    std::unique_ptr<watch_scope_t> watch_;
+    // true if the watchdog cancelled a command that was not started
+    bool overrun_;
+    // result if the command was not started
+    bool ok_;
+    // true if the command did not complete when started
+    bool async_;
+};
+
+cmd_async_t::cmd_async_t(cmd_parser_t& parser)
+    : parser_(parser)
+    , next_id_(1)
+{
+}
+
+cmd_async_t::~cmd_async_t()
+{
+    // stop commands still running, they may be writing to their buffers
+    for (auto& task : tasks_) {
+        task->cancel_.cancel();
+    }
+    for (auto& task : tasks_) {
+        if (task->result_.valid()) {
+            task->result_.wait();
+        }
+    }
+}
+
+uint64_t cmd_async_t::execute(
+    std::string_view line,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user)
+{
+    assert(cmd_out);
+    uint64_t id = 0;
+    if (split_background(line)) {
+        const uint64_t job = parser_.concurrent() ? parser_.jobs().start(line, cmd_out, user) : 0;
+        {
+            const auto guard = cmd_out->guard();
+            cmd_out->mark();
+            if (job) {
+                cmd_locale_t::job_status(*cmd_out, job, "running", std::string(line).c_str());
+            } else {
+                cmd_locale_t::not_concurrent(*cmd_out);
+            }
+        }
+        poll(cmd_out);
+        return id;
+    }
+    {
+        cmd_parser_t::reader_t reader(parser_, parser_);
+        split_exprs(line, [&](std::string_view expr, std::string_view trimmed) {
+            std::unique_ptr<task_t> task(new task_t);
+            task->id_ = id = next_id_++;
+            // name the task without the surrounding whitespace
+            task->expr_.assign(trimmed);
+            task->out_.text_ = &task->text_;
+            reader.cancel_ = &task->cancel_;
+            task->ok_ = parser_.execute_imp(reader, expr, &task->out_, user, &task->result_);
+            task->async_ = task->result_.valid() && !is_ready(task->result_);
+            task->watch_ = std::move(reader.watch_);
+            task->overrun_ = reader.overrun_;
+            if (task->async_) {
+                // deliver from the completing command rather than waiting
+                // for the next poll(), as cmd_job_table_t does
+                task_t& ref = *task;
+                std::future<bool> result = std::move(task->result_);
+                task->result_ = std::async(std::launch::async, [this, &ref, cmd_out, result = std::move(result)]() mutable {
+                    return deliver(ref, result.get(), *cmd_out);
+                });
+            }
+            tasks_.push_back(std::move(task));
+            return true;
+        });
+    }
+    poll(cmd_out);
+    return id;
+}
+
+size_t cmd_async_t::poll(cmd_output_t* cmd_out)
+{
+    assert(cmd_out);
+    size_t delivered = 0;
+    for (auto itt = tasks_.begin(); itt != tasks_.end();) {
+        task_t& task = **itt;
+        if (task.async_) {
+            // running tasks deliver themselves
+            if (!is_ready(task.result_)) {
+                ++itt;
+                continue;
+            }
+            task.result_.get();
+        } else {
+            deliver(task, task.result_.valid() ? task.result_.get() : task.ok_, *cmd_out);
+        }
+        itt = tasks_.erase(itt);
+        ++delivered;
+    }
+    return delivered;
+}
+
+bool cmd_async_t::wait(cmd_output_t* cmd_out)
+{
+    assert(cmd_out);
+    bool ret = true;
+    for (auto& task : tasks_) {
+        if (task->async_) {
+            // running tasks deliver themselves in the order they complete
+            ret &= task->result_.get();
+        } else {
+            ret &= deliver(*task, task->result_.valid() ? task->result_.get() : task->ok_, *cmd_out);
+        }
+    }
+    tasks_.clear();
+    return ret;
+}
+
+bool cmd_async_t::deliver(task_t& task, bool ok, cmd_output_t& out)
+{
+    const bool overrun = task.watch_ ? task.watch_->release() : task.overrun_;
+    if (!ok) {
+        if (overrun) {
+            cmd_locale_t::command_timeout(task.out_, task.expr_.c_str());
+        } else {
+            cmd_locale_t::command_failed(task.out_, task.expr_.c_str());
+        }
+    }
+    if (task.async_) {
+        cmd_locale_t::task_done(task.out_, task.id_, task.expr_.c_str(), ok);
+    }
+    // write the whole buffer at once so it can not interleave
+    const auto guard = out.guard();
+    out.mark();
+    out.emit_text(false, task.text_.data(), task.text_.size(), false);
+    const cmd_tracer_t::span_t span(parser_.tracer(), "flush");
+    out.flush();
+    return ok;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_job_table_t
+
+struct cmd_job_table_t::job_t {
+    uint64_t id_;
+    std::string line_;
+    cmd_output_t* output_;
+    cmd_baton_t user_;
+    cmd_cancel_t cancel_;
+    std::string text_;
+    cmd_output_string_t out_;
+    bool ok_;
+    // the following are guarded by mux_
+    bool done_;
+    bool killed_;
+    bool delivered_;
+    bool finished_;
+    std::thread thread_;
+};
+
+cmd_job_table_t::cmd_job_table_t(cmd_parser_t& parser)
+    : parser_(parser)
+    , next_id_(1)
+{
+}
+
+cmd_job_table_t::~cmd_job_table_t()
+{
+    std::list<std::unique_ptr<job_t>> jobs;
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        jobs.swap(jobs_);
+    }
+    // stop jobs still running rather than waiting for them to finish
+    for (auto& job : jobs) {
+        job->cancel_.cancel();
+    }
+    for (auto& job : jobs) {
+        job->thread_.join();
+    }
+}
+
+uint64_t cmd_job_table_t::start(
+    std::string_view line,
+    cmd_output_t* cmd_out,
+    cmd_baton_t user)
+{
+    assert(cmd_out);
+    // the job executes alongside the thread that started it
+    assert(parser_.concurrent());
+    reap();
+    std::unique_ptr<job_t> job(new job_t);
+    job->line_.assign(line);
+    job->output_ = cmd_out;
+    job->user_ = user;
+    job->out_.text_ = &job->text_;
+    job->ok_ = false;
+    job->done_ = false;
+    job->killed_ = false;
+    job->delivered_ = false;
+    job->finished_ = false;
+    job_t& ref = *job;
+    const std::lock_guard<std::mutex> lock(mux_);
+    job->id_ = next_id_++;
+    jobs_.push_back(std::move(job));
+    // the thread waits on mux_ before touching the list
+    ref.thread_ = std::thread(&cmd_job_table_t::run, this, std::ref(ref));
+    return ref.id_;
+}
+
+void cmd_job_table_t::run(job_t& job)
+{
+    {
+        // wait for start() to finish publishing the job
+        const std::lock_guard<std::mutex> lock(mux_);
+    }
+    job.ok_ = parser_.execute_line(job.line_, &job.out_, job.user_, nullptr, &job.cancel_);
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        const char* status = job.killed_ ? "killed" : (job.ok_ ? "done" : "failed");
+        cmd_locale_t::job_status(job.out_, job.id_, status, job.line_.c_str());
+        job.done_ = true;
+    }
+    cv_.notify_all();
+    // deliver unless a waiter got to it first, which may hold the guard
+    std::string text;
+    {
+        const auto guard = job.output_->guard();
+        {
+            const std::lock_guard<std::mutex> lock(mux_);
+            if (!job.delivered_) {
+                job.delivered_ = true;
+                text.swap(job.text_);
+            }
+        }
+        if (!text.empty()) {
+            job.output_->mark();
+            job.output_->emit_text(false, text.data(), text.size(), false);
+            const cmd_tracer_t::span_t span(parser_.tracer(), "flush");
+            job.output_->flush();
+        }
+    }
+    const std::lock_guard<std::mutex> lock(mux_);
+    job.finished_ = true;
+}
+
+bool cmd_job_table_t::wait(uint64_t id, cmd_output_t& out)
+{
+    std::string text;
+    bool ok;
+    {
+        std::unique_lock<std::mutex> lock(mux_);
+        auto itt = std::find_if(jobs_.begin(), jobs_.end(), [id](const std::unique_ptr<job_t>& job) {
+            return job->id_ == id;
+        });
+        if (itt == jobs_.end() || (*itt)->delivered_) {
+            lock.unlock();
+            return cmd_locale_t::no_job(out, id), false;
+        }
+        job_t& job = **itt;
+        if (job.thread_.get_id() == std::this_thread::get_id()) {
+            lock.unlock();
+            return cmd_locale_t::error(out, "a job can not wait for itself"), false;
+        }
+        cv_.wait(lock, [&job]() { return job.done_; });
+        ok = job.ok_ && !job.killed_;
+        if (job.delivered_) {
+            // delivered by its own thread or another waiter meanwhile
+            return ok;
+        }
+        job.delivered_ = true;
+        text.swap(job.text_);
+    }
+    out.emit_text(false, text.data(), text.size(), false);
+    const cmd_tracer_t::span_t span(parser_.tracer(), "flush");
+    out.flush();
+    return ok;
+}
+
+bool cmd_job_table_t::wait_all(cmd_output_t& out)
+{
+    std::vector<uint64_t> ids;
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        for (const auto& job : jobs_) {
+            if (!job->delivered_ && job->thread_.get_id() != std::this_thread::get_id()) {
+                ids.push_back(job->id_);
+            }
+        }
+    }
+    bool ret = true;
+    for (const uint64_t id : ids) {
+        ret &= wait(id, out);
+    }
+    return ret;
+}
+
+bool cmd_job_table_t::kill(uint64_t id)
+{
+    const std::lock_guard<std::mutex> lock(mux_);
+    for (auto& job : jobs_) {
+        if (job->id_ == id && !job->done_) {
+            job->killed_ = true;
+            job->cancel_.cancel();
+            return true;
+        }
+    }
+    return false;
+}
+
+void cmd_job_table_t::list(std::vector<status_t>& out)
+{
+    reap();
+    const std::lock_guard<std::mutex> lock(mux_);
+    for (const auto& job : jobs_) {
+        if (!job->delivered_) {
+            out.push_back(status_t{ job->id_, job->line_, job->done_, job->killed_ });
+        }
+    }
+}
+
+void cmd_job_table_t::reap()
+{
+    std::list<std::unique_ptr<job_t>> finished;
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        for (auto itt = jobs_.begin(); itt != jobs_.end();) {
+            auto next = std::next(itt);
+            if ((*itt)->finished_) {
+                finished.splice(finished.end(), jobs_, itt);
+            }
+            itt = next;
+        }
+    }
+    // finished threads have nothing left to do but return
+    for (auto& job : finished) {
+        job->thread_.join();
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_watchdog_t
+
+cmd_watchdog_t::cmd_watchdog_t(cmd_output_t* report, std::chrono::milliseconds limit)
+    : report_(report)
+    , limit_(limit)
+    , next_id_(1)
+    , stop_(false)
+    , overruns_(0)
+{
+    thread_ = std::thread(&cmd_watchdog_t::run, this);
+}
+
+cmd_watchdog_t::~cmd_watchdog_t()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    // a last attempt, reports are dropped if a command still holds the guard
+    report();
+}
+
+uint64_t cmd_watchdog_t::watch(std::string_view expr, cmd_cancel_t& cancel)
+{
+    entry_t entry;
+    entry.expr_ = expr;
+    entry.start_ = clock_t::now();
+    entry.deadline_ = cancel.deadline();
+    if (limit_.count() > 0) {
+        entry.deadline_ = std::min(entry.deadline_, entry.start_ + limit_);
+    }
+    entry.cancel_ = &cancel;
+    entry.reported_ = false;
+    const bool timed = entry.deadline_ != clock_t::time_point::max();
+    uint64_t id;
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        id = next_id_++;
+        watched_.emplace(id, std::move(entry));
+    }
+    // the thread only needs waking when it may have to wake up sooner
+    if (timed) {
+        cv_.notify_one();
+    }
+    return id;
+}
+
+bool cmd_watchdog_t::unwatch(uint64_t id)
+{
+    const std::lock_guard<std::mutex> lock(mux_);
+    const auto itt = watched_.find(id);
+    if (itt == watched_.end()) {
+        return false;
+    }
+    const bool reported = itt->second.reported_;
+    watched_.erase(itt);
+    return reported;
+}
+
+size_t cmd_watchdog_t::num_watched() const
+{
+    const std::lock_guard<std::mutex> lock(mux_);
+    return watched_.size();
+}
+
+bool cmd_watchdog_t::report()
+{
+    // never wait for the guard, a stuck command may be holding it
+    if (!report_ || !report_->try_lock()) {
+        const std::lock_guard<std::mutex> lock(mux_);
+        return !report_ || pending_.empty();
+    }
+    std::vector<std::pair<std::string, uint64_t>> overruns;
+    {
+        const std::lock_guard<std::mutex> lock(mux_);
+        overruns.swap(pending_);
+    }
+    for (const auto& overrun : overruns) {
+        cmd_locale_t::command_overrun(*report_, overrun.first.c_str(), overrun.second);
+    }
+    if (!overruns.empty()) {
+        report_->flush();
+    }
+    report_->unlock();
+    return true;
+}
+
+void cmd_watchdog_t::run()
+{
+    // how long to wait before trying a busy report stream again
+    const auto retry = std::chrono::milliseconds(10);
+    bool busy = false;
+    std::unique_lock<std::mutex> lock(mux_);
+    while (!stop_) {
+        const clock_t::time_point now = clock_t::now();
+        clock_t::time_point wake = clock_t::time_point::max();
+        for (auto& itt : watched_) {
+            entry_t& entry = itt.second;
+            if (entry.reported_) {
+                continue;
+            }
+            if (entry.deadline_ <= now) {
+                // cancel while locked, the token is valid until unwatched
+                entry.cancel_->cancel();
+                entry.reported_ = true;
+                const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - entry.start_);
+                if (report_) {
+                    pending_.emplace_back(entry.expr_, uint64_t(ms.count()));
+                }
+                ++overruns_;
+            } else {
+                wake = std::min(wake, entry.deadline_);
+            }
+        }
+        if (!pending_.empty()) {
+            // report unlocked so executions are not held up by the stream
+            lock.unlock();
+            busy = !report();
+            lock.lock();
+        }
+        if (busy) {
+            wake = std::min(wake, now + retry);
+        }
+        if (wake == clock_t::time_point::max()) {
+            cv_.wait(lock);
+        } else {
+            cv_.wait_until(lock, wake);
+        }
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_tracer_t
+
+struct cmd_tracer_t::ring_t {
+    struct event_t {
+        std::atomic<const char*> name_;
+        // nanoseconds since the epoch shifted up, low bit set for end events
+        std::atomic<uint64_t> stamp_;
+    };
+
+    ring_t(uint32_t tid, size_t capacity)
+        : tid_(tid)
+        , mask_(capacity - 1)
+        , events_(new event_t[capacity])
+        , head_(0)
+    {
+    }
+
+    const uint32_t tid_;
+    const size_t mask_;
+    std::unique_ptr<event_t[]> events_;
+    // number of events ever written, only advanced by the owning thread
+    std::atomic<uint64_t> head_;
+};
+
+struct cmd_tracer_t::rings_t {
+    std::mutex mux_;
+    std::vector<std::unique_ptr<ring_t>> all_;
+    // rings of threads that have exited, reused before creating new ones
+    std::vector<ring_t*> free_;
+};
+
+namespace {
+// items a thread holds from owners such as a tracer, handed back to each
+// owner still alive when the thread exits
+struct thread_held_t {
+    struct held_t {
+        uint64_t id_;
+        void* item_;
+        // expires with the owner, which may be destroyed first
+        std::weak_ptr<void> owner_;
+        void (*release_)(void* owner, void* item);
+    };
+
+    thread_held_t()
+        : id_(0)
+        , item_(nullptr)
+    {
+    }
+
+    ~thread_held_t()
+    {
+        for (const held_t& held : held_) {
+            if (const std::shared_ptr<void> owner = held.owner_.lock()) {
+                held.release_(owner.get(), held.item_);
+            }
+        }
+    }
+
+    // return the item held from an owner, otherwise nullptr
+    void* find(uint64_t id)
+    {
+        if (id_ == id) {
+            return item_;
+        }
+        for (const held_t& held : held_) {
+            if (held.id_ == id) {
+                id_ = id;
+                item_ = held.item_;
+                return item_;
+            }
+        }
+        return nullptr;
+    }
+
+    void hold(uint64_t id, void* item, const std::shared_ptr<void>& owner, void (*release)(void* owner, void* item))
+    {
+        // forget owners that have been destroyed
+        held_.erase(std::remove_if(held_.begin(), held_.end(), [](const held_t& held) {
+            return held.owner_.expired();
+        }), held_.end());
+        held_.push_back({ id, item, owner, release });
+        id_ = id;
+        item_ = item;
+    }
+
+    // owner of the item last found, so most lookups skip the search
+    uint64_t id_;
+    void* item_;
+    std::vector<held_t> held_;
+};
+thread_local thread_held_t trace_tls;
+std::atomic<uint64_t> trace_next_id(1);
+} // namespace {}
+
+cmd_tracer_t::cmd_tracer_t(size_t capacity)
+    : id_(trace_next_id.fetch_add(1))
+    , capacity_([capacity]() {
+        size_t pow2 = 2;
+        while (pow2 < capacity) {
+            pow2 <<= 1;
+        }
+        return pow2;
+    }())
+    , epoch_(clock_t::now())
+    , rings_(std::make_shared<rings_t>())
+{
+}
+
+cmd_tracer_t::~cmd_tracer_t()
+{
+}
+
+cmd_tracer_t::ring_t* cmd_tracer_t::ring()
+{
+    if (void* ring = trace_tls.find(id_)) {
+        return static_cast<ring_t*>(ring);
+    }
+    ring_t* found;
+    {
+        const std::lock_guard<std::mutex> lock(rings_->mux_);
+        if (!rings_->free_.empty()) {
+            found = rings_->free_.back();
+            rings_->free_.pop_back();
+        } else {
+            rings_->all_.emplace_back(new ring_t(uint32_t(rings_->all_.size() + 1), capacity_));
+            found = rings_->all_.back().get();
+        }
+    }
+    trace_tls.hold(id_, found, rings_, &cmd_tracer_t::release);
+    return found;
+}
+
+void cmd_tracer_t::release(void* rings, void* ring)
+{
+    rings_t& owner = *static_cast<rings_t*>(rings);
+    const std::lock_guard<std::mutex> lock(owner.mux_);
+    owner.free_.push_back(static_cast<ring_t*>(ring));
+}
+
+void cmd_tracer_t::record(const char* name, bool end)
+{
+    ring_t* ring = this->ring();
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - epoch_).count();
+    const uint64_t head = ring->head_.load(std::memory_order_relaxed);
+    ring_t::event_t& event = ring->events_[head & ring->mask_];
+    event.name_.store(name, std::memory_order_relaxed);
+    event.stamp_.store((ns << 1) | (end ? 1 : 0), std::memory_order_relaxed);
+    ring->head_.store(head + 1, std::memory_order_release);
+}
+
+// append a string as a JSON string literal
+static void json_string(std::string& out, const char* str)
+{
+    out.push_back('"');
+    for (; *str; ++str) {
+        const char ch = *str;
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if ((unsigned char)ch < 0x20) {
+            char temp[8];
+            snprintf(temp, sizeof(temp), "\\u%04x", ch);
+            out.append(temp);
+        } else {
+            out.push_back(ch);
+        }
+    }
+    out.push_back('"');
+}
+
+size_t cmd_tracer_t::dump(std::string& out) const
+{
+    const std::lock_guard<std::mutex> lock(rings_->mux_);
+    size_t num_events = 0;
+    out.append("{\"traceEvents\":[");
+    for (const auto& ring : rings_->all_) {
+        const uint64_t head = ring->head_.load(std::memory_order_acquire);
+        const uint64_t capacity = ring->mask_ + 1;
+        std::vector<std::pair<const char*, uint64_t>> events;
+        for (uint64_t ix = head > capacity ? head - capacity : 0; ix < head; ++ix) {
+            const ring_t::event_t& event = ring->events_[ix & ring->mask_];
+            events.emplace_back(event.name_.load(std::memory_order_relaxed), event.stamp_.load(std::memory_order_relaxed));
+        }
+        // drop events the owning thread may have overwritten while copying
+        const uint64_t after = ring->head_.load(std::memory_order_acquire);
+        const uint64_t valid = after + 1 > capacity ? after + 1 - capacity : 0;
+        const uint64_t first = head > capacity ? head - capacity : 0;
+        size_t skip = size_t(valid > first ? valid - first : 0);
+        // spans that began before the oldest event kept have no begin
+        uint32_t depth = 0;
+        for (size_t i = std::min(skip, events.size()); i < events.size(); ++i) {
+            const bool end = events[i].second & 1;
+            if (end && depth == 0) {
+                continue;
+            }
+            depth = end ? depth - 1 : depth + 1;
+            char temp[96];
+            snprintf(temp, sizeof(temp), "\"cat\":\"cmd\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                end ? 'E' : 'B', double(events[i].second >> 1) / 1e3, ring->tid_);
+            out.append(num_events++ ? ",\n{\"name\":" : "\n{\"name\":");
+            json_string(out, events[i].first ? events[i].first : "");
+            out.push_back(',');
+            out.append(temp);
+        }
+    }
+    out.append("\n],\"displayTimeUnit\":\"ns\"}\n");
+    return num_events;
+}
+
+bool cmd_tracer_t::dump(const char* path) const
+{
+    std::string json;
+    dump(json);
+    FILE* fd = fopen(path, "wb");
+    if (!fd) {
+        return false;
+    }
+    const bool ok = fwrite(json.data(), 1, json.size(), fd) == json.size();
+    return (fclose(fd) == 0) && ok;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_histogram_t
+
+uint64_t cmd_histogram_t::count() const
+{
+    uint64_t count = 0;
+    for (const auto& bucket : buckets_) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t cmd_histogram_t::percentile(double fraction) const
+{
+    std::array<uint32_t, NUM_BUCKETS> counts;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < NUM_BUCKETS; ++i) {
+        total += counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    // rank of the value sought, counting from 1
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * double(total))));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // the bucket bound may exceed anything actually recorded
+            return std::min(highest(i), max());
+        }
+    }
+    return max();
+}
+
+void cmd_histogram_t::reset()
+{
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    max_.store(0, std::memory_order_relaxed);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_t
+
+bool cmd_t::on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user)
+{
+    (void)user;
+    const bool have_subcomands = !sub_.empty();
+    if (!have_subcomands) {
+        // an empty terminal cmd is a bit weird
+        return false;
+    }
+    const bool have_tokens = !tok.tokens.empty();
+    if (have_tokens) {
+        const char* tok_front = tok.tokens.front().c_str();
+        cmd_locale_t::no_subcommand(out, tok_front);
+        parser_.suggest(tok_front, out);
+    } else {
+        print_sub_commands(out);
+    }
+    return true;
+};
+
+cmd_state_t& cmd_t::state(const cmd_tokens_t& tok) const
+{
+    return tok.state_ ? *tok.state_ : parser_;
+}
+
+bool cmd_t::alias_add(const std::string& name)
+{
+    return parser_.alias_add(this, name);
+}
+
+void cmd_t::sub_command_added(cmd_t* cmd)
+{
+    parser_.command_added(cmd);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_format_t
+
+char* cmd_format_t::buffer_t::reserve(size_t num)
+{
+    if (size_ + num > capacity_) {
+        capacity_ = std::max(capacity_ * 2, size_ + num);
+        if (data_ == inline_.data()) {
+            heap_.assign(data_, size_);
+        }
+        heap_.resize(capacity_);
+        data_ = &heap_[0];
+    }
+    return data_ + size_;
+}
+
+void cmd_format_t::render(buffer_t& out, const char* fmt, const spec_t* specs, size_t num, const arg_t* args)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const spec_t& spec = specs[i];
+        if (spec.arg_ == spec_t::NO_ARG) {
+            out.append(fmt + spec.offset_, spec.size_);
+            continue;
+        }
+        const arg_t& arg = args[spec.arg_];
+        std::array<char, 64> temp;
+        char* const first = temp.data();
+        char* const last = first + temp.size();
+        const char* text = first;
+        size_t size = 0;
+        std::to_chars_result res { first, std::errc() };
+        switch (arg.kind_) {
+        case e_int:
+            res = spec.hex_ ? std::to_chars(first, last, uint64_t(arg.int_), 16)
+                            : std::to_chars(first, last, arg.int_);
+            size = size_t(res.ptr - first);
+            break;
+        case e_uint:
+            res = std::to_chars(first, last, arg.uint_, spec.hex_ ? 16 : 10);
+            size = size_t(res.ptr - first);
+            break;
+        case e_double:
+            if (spec.precision_ >= 0) {
+                res = std::to_chars(first, last, arg.double_, std::chars_format::fixed, spec.precision_);
+                if (res.ec != std::errc()) {
+                    // too large to print in fixed notation
+                    res = std::to_chars(first, last, arg.double_, std::chars_format::general, spec.precision_);
+                }
+            } else {
+                res = std::to_chars(first, last, arg.double_);
+            }
+            size = res.ec == std::errc() ? size_t(res.ptr - first) : 0;
+            break;
+        case e_string:
+            text = arg.string_;
+            size = arg.size_;
+            break;
+        case e_bool:
+            text = arg.bool_ ? "true" : "false";
+            size = arg.bool_ ? 4 : 5;
+            break;
+        case e_char:
+            temp[0] = arg.char_;
+            size = 1;
+            break;
+        case e_none:
+            break;
+        }
+        const size_t pad = spec.width_ > size ? spec.width_ - size : 0;
+        if (!pad) {
+            out.append(text, size);
+            continue;
+        }
+        char* dst = out.reserve(size + pad);
+        if (spec.left_) {
+            memcpy(dst, text, size);
+            memset(dst + size, ' ', pad);
+        } else if (spec.zero_) {
+            // zeros go between the sign and the digits
+            const size_t sign = (size && text[0] == '-') ? 1 : 0;
+            memcpy(dst, text, sign);
+            memset(dst + sign, '0', pad);
+            memcpy(dst + sign + pad, text + sign, size - sign);
+        } else {
+            memset(dst, ' ', pad);
+            memcpy(dst + pad, text, size);
+        }
+        out.advance(size + pad);
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_stdio_t
+
+struct cmd_output_stdio_t : public cmd_output_t {
+
+    cmd_output_stdio_t(FILE* fd)
+        : fd_(fd)
+        , cmd_output_t()
+    {
+    }
+
+    virtual void lock() override
+    {
+
+        mux_.lock();
+    }
+
+    virtual bool try_lock() override
+    {
+        return mux_.try_lock();
+    }
+
+    virtual void unlock() override
+    {
+        mux_.unlock();
+    }
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        vfprintf(fd_, fmt, args);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        vfprintf(fd_, fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        fputc('\n', fd_);
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+        ind ? indent_apply() : (void)0;
+        fwrite(text, 1, size, fd_);
+        eol ? fputc('\n', fd_) : 0;
+    }
+
+    virtual void flush() override
+    {
+        fflush(fd_);
+    }
+
+protected:
+    FILE* fd_;
+    std::mutex mux_;
+
+    void indent_apply()
+    {
+        for (uint32_t i = 0; i < indent_; ++i) {
+            fputc(' ', fd_);
+        }
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_stdio(FILE* fd)
+{
+    return new cmd_output_stdio_t(fd);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_buffered_t
+
+namespace {
+// run of spaces that indentation is copied from
+const std::array<char, 64> indent_run = []() {
+    std::array<char, 64> run;
+    run.fill(' ');
+    return run;
+}();
+} // namespace {}
+
+struct cmd_output_buffered_t : public cmd_output_t {
+
+    // output is formatted into fixed size chunks that are kept between
+    // flushes, so a large output never reallocates or copies what it holds
+    static const size_t CHUNK_SIZE = 4096;
+    // flush early once this many chunks are full to bound memory use
+    static const size_t MAX_CHUNKS = 64;
+
+    cmd_output_buffered_t(FILE* fd)
+        : cmd_output_t()
+        , fd_(fd)
+        , used_(0)
+    {
+        chunks_.emplace_back(new chunk_t);
+        chunks_.back()->size_ = 0;
+    }
+
+    ~cmd_output_buffered_t()
+    {
+        write_out();
+    }
+
+    virtual void lock() override
+    {
+        mux_.lock();
+    }
+
+    virtual bool try_lock() override
+    {
+        return mux_.try_lock();
+    }
+
+    virtual void unlock() override
+    {
+        // write once when the command or batch holding the guard is done
+        write_out();
+        mux_.unlock();
+    }
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        format(fmt, args);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        ind ? indent_apply() : (void)0;
+        format(fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        append("\n", 1);
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+        ind ? indent_apply() : (void)0;
+        append(text, size);
+        eol ? append("\n", 1) : (void)0;
+    }
+
+    virtual void flush() override
+    {
+        write_out();
+    }
+
+protected:
+    struct chunk_t {
+        std::array<char, CHUNK_SIZE> data_;
+        size_t size_;
+    };
+
+    FILE* fd_;
+    std::mutex mux_;
+    // chunks holding output, chunks_[used_] is the one being filled
+    std::vector<std::unique_ptr<chunk_t>> chunks_;
+    size_t used_;
+
+    chunk_t& current()
+    {
+        return *chunks_[used_];
+    }
+
+    // move on to an empty chunk, reusing one from an earlier flush if possible
+    void next_chunk()
+    {
+        if (used_ + 1 >= MAX_CHUNKS) {
+            write_out();
+            return;
+        }
+        if (++used_ == chunks_.size()) {
+            chunks_.emplace_back(new chunk_t);
+        }
+        current().size_ = 0;
+    }
+
+    void append(const char* src, size_t size)
+    {
+        while (size) {
+            chunk_t& chunk = current();
+            const size_t num = std::min(size, CHUNK_SIZE - chunk.size_);
+            memcpy(chunk.data_.data() + chunk.size_, src, num);
+            chunk.size_ += num;
+            src += num;
+            size -= num;
+            if (chunk.size_ == CHUNK_SIZE) {
+                next_chunk();
+            }
+        }
+    }
+
+    void indent_apply()
+    {
+        for (uint32_t left = indent_; left;) {
+            const uint32_t num = std::min<uint32_t>(left, uint32_t(indent_run.size()));
+            append(indent_run.data(), num);
+            left -= num;
+        }
+    }
+
+    void format(const char* fmt, va_list& args)
+    {
+        // plain text needs no formatting
+        if (!strchr(fmt, '%')) {
+            append(fmt, strlen(fmt));
+            return;
+        }
+        chunk_t* chunk = &current();
+        size_t room = CHUNK_SIZE - chunk->size_;
+        va_list copy;
+        va_copy(copy, args);
+        int len = vsnprintf(chunk->data_.data() + chunk->size_, room, fmt, copy);
+        va_end(copy);
+        if (len <= 0) {
+            return;
+        }
+        // vsnprintf needs room for a terminator that is not kept
+        if (size_t(len) < room) {
+            chunk->size_ += size_t(len);
+            return;
+        }
+        if (size_t(len) < CHUNK_SIZE && chunk->size_) {
+            // did not fit, so format again at the start of an empty chunk
+            next_chunk();
+            chunk = &current();
+            va_copy(copy, args);
+            len = vsnprintf(chunk->data_.data(), CHUNK_SIZE, fmt, copy);
+            va_end(copy);
+            chunk->size_ = size_t(std::max(len, 0));
+            return;
+        }
+        // longer than a chunk, format aside and spread it over chunks
+        std::string temp(size_t(len) + 1, '\0');
+        va_copy(copy, args);
+        vsnprintf(&temp[0], temp.size(), fmt, copy);
+        va_end(copy);
+        append(temp.data(), size_t(len));
+    }
+
+    // write all of the buffered chunks with a single writev where available
+    void write_out()
+    {
+        if (used_ == 0 && chunks_[0]->size_ == 0) {
+            return;
+        }
+        // keep ordering with anything written through the FILE directly
+        fflush(fd_);
+#if CMD_HAVE_WRITEV
+        std::array<iovec, MAX_CHUNKS> iov;
+        size_t num = 0;
+        for (size_t i = 0; i <= used_; ++i) {
+            if (chunks_[i]->size_) {
+                iov[num].iov_base = chunks_[i]->data_.data();
+                iov[num].iov_len = chunks_[i]->size_;
+                ++num;
+            }
+        }
+        const int fd = fileno(fd_);
+        iovec* next = iov.data();
+        while (num) {
+            const ssize_t done = writev(fd, next, int(num));
+            if (done < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // the output is lost, as with a failing FILE
+                break;
+            }
+            // step over what was written, a partial write may end mid chunk
+            size_t left = size_t(done);
+            while (num && left >= next->iov_len) {
+                left -= next->iov_len;
+                ++next;
+                --num;
+            }
+            if (num) {
+                next->iov_base = static_cast<char*>(next->iov_base) + left;
+                next->iov_len -= left;
+            }
+        }
+#else
+        for (size_t i = 0; i <= used_; ++i) {
+            fwrite(chunks_[i]->data_.data(), 1, chunks_[i]->size_, fd_);
+        }
+        fflush(fd_);
+#endif
+        used_ = 0;
+        chunks_[0]->size_ = 0;
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_buffered(FILE* fd)
+{
+    return new cmd_output_buffered_t(fd);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_async_t
+
+namespace {
+// bounded lock free queue of pointers, safe for any number of producers and
+// consumers.  each cell carries a sequence number that tells a producer the
+// cell is free and a consumer that it has been filled.
+template <typename type_t>
+struct bounded_queue_t {
+
+    bounded_queue_t(size_t capacity)
+        : mask_([capacity]() {
+            size_t pow2 = 2;
+            while (pow2 < capacity) {
+                pow2 <<= 1;
+            }
+            return pow2 - 1;
+        }())
+        , cells_(new cell_t[mask_ + 1])
+        , head_(0)
+        , tail_(0)
+    {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].seq_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // return false if the queue is full
+    bool push(type_t* item)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell_t& cell = cells_[pos & mask_];
+            const size_t seq = cell.seq_.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item_ = item;
+                    cell.seq_.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only a hint while producers or consumers are active
+    bool empty() const
+    {
+        const size_t pos = tail_.load(std::memory_order_acquire);
+        return cells_[pos & mask_].seq_.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    // return false if the queue is empty
+    bool pop(type_t*& item)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell_t& cell = cells_[pos & mask_];
+            const size_t seq = cell.seq_.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = cell.item_;
+                    cell.seq_.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+protected:
+    struct cell_t {
+        std::atomic<size_t> seq_;
+        type_t* item_;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<cell_t[]> cells_;
+    // kept on their own cache lines as producers and the consumer race on them
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+// async output of the calling thread, see cmd_output_async_t::local()
+thread_local thread_held_t output_tls;
+std::atomic<uint64_t> output_next_id(1);
+} // namespace {}
+
+struct cmd_output_async_t : public cmd_output_t {
+
+    // a guarded command queues its output early past this size
+    static const size_t CHUNK_LIMIT = 64 * 1024;
+
+    cmd_output_async_t(FILE* fd, backpressure_t policy, size_t capacity)
+        : cmd_output_t()
+        , fd_(fd)
+        , policy_(policy)
+        , id_(output_next_id.fetch_add(1))
+        , locals_(std::make_shared<locals_t>())
+        , queue_(capacity)
+        , free_(capacity)
+        , overflowing_(false)
+        , sleeping_(false)
+        , waiting_(0)
+        , dropped_(0)
+        , quit_(false)
+    {
+        writer_ = std::thread([this]() { run(); });
+    }
+
+    ~cmd_output_async_t()
+    {
+        {
+            // threads exiting from here on no longer find their output
+            const std::lock_guard<std::mutex> lock(locals_->mux_);
+            for (const auto& local : locals_->all_) {
+                submit(*local);
+            }
+            locals_->all_.clear();
+        }
+        {
+            const std::lock_guard<std::mutex> lock(wake_mux_);
+            quit_ = true;
+        }
+        wake_cv_.notify_one();
+        writer_.join();
+        chunk_t* chunk;
+        while (free_.pop(chunk)) {
+            delete chunk;
+        }
+    }
+
+    virtual void lock() override
+    {
+        mux_.lock();
+        local().guarded_ = true;
+    }
+
+    virtual bool try_lock() override
+    {
+        if (!mux_.try_lock()) {
+            return false;
+        }
+        local().guarded_ = true;
+        return true;
+    }
+
+    virtual void unlock() override
+    {
+        local_t& local = this->local();
+        local.guarded_ = false;
+        submit(local);
+        mux_.unlock();
+    }
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        local_t& local = this->local();
+        if (ind) {
+            local.chunk().append(indent_, ' ');
+        }
+        append_format(local.chunk(), fmt, args);
+        done(local);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        local_t& local = this->local();
+        if (ind) {
+            local.chunk().append(indent_, ' ');
+        }
+        append_format(local.chunk(), fmt, args);
+        local.chunk().push_back('\n');
+        done(local);
+    }
+
+    virtual void eol() override
+    {
+        local_t& local = this->local();
+        local.chunk().push_back('\n');
+        done(local);
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+        local_t& local = this->local();
+        chunk_t& chunk = local.chunk();
+        if (ind) {
+            chunk.append(indent_, ' ');
+        }
+        chunk.append(text, size);
+        if (eol) {
+            chunk.push_back('\n');
+        }
+        done(local);
+    }
+
+    virtual void flush() override
+    {
+        // hand over to the writer without waiting for the I/O
+        submit(local());
+    }
+
+protected:
+    typedef std::string chunk_t;
+
+    // per thread output being formatted
+    struct local_t {
+        local_t(cmd_output_async_t& out)
+            : out_(out)
+            , chunk_(nullptr)
+            , guarded_(false)
+        {
+        }
+
+        ~local_t()
+        {
+            delete chunk_;
+        }
+
+        chunk_t& chunk()
+        {
+            if (!chunk_) {
+                chunk_ = out_.take();
+            }
+            return *chunk_;
+        }
+
+        cmd_output_async_t& out_;
+        chunk_t* chunk_;
+        // true while this thread holds the output guard
+        bool guarded_;
+    };
+
+    // outputs of the threads using this stream, shared with those threads
+    struct locals_t {
+        std::mutex mux_;
+        std::list<std::unique_ptr<local_t>> all_;
+    };
+
+    FILE* fd_;
+    const backpressure_t policy_;
+    const uint64_t id_;
+    const std::shared_ptr<locals_t> locals_;
+    // serializes guarded output, never held during I/O
+    std::mutex mux_;
+    // chunks waiting for the writer
+    bounded_queue_t<chunk_t> queue_;
+    // written chunks kept for reuse
+    bounded_queue_t<chunk_t> free_;
+    // e_grow chunks queued while queue_ was full, guarded by wake_mux_
+    std::deque<chunk_t*> overflow_;
+    // set while overflow_ is in use so that producers keep their order
+    std::atomic<bool> overflowing_;
+    std::thread writer_;
+    std::mutex wake_mux_;
+    // the writer waits for chunks, blocked producers for room
+    std::condition_variable wake_cv_;
+    std::condition_variable room_cv_;
+    std::atomic<bool> sleeping_;
+    std::atomic<uint32_t> waiting_;
+    // lines lost under e_drop
+    std::atomic<uint64_t> dropped_;
+    bool quit_;
+
+    local_t& local()
+    {
+        if (void* local = output_tls.find(id_)) {
+            return *static_cast<local_t*>(local);
+        }
+        local_t* found = new local_t(*this);
+        {
+            const std::lock_guard<std::mutex> lock(locals_->mux_);
+            locals_->all_.emplace_back(found);
+        }
+        output_tls.hold(id_, found, locals_, &cmd_output_async_t::release);
+        return *found;
+    }
+
+    // queue what an exiting thread wrote and forget its output
+    static void release(void* owner, void* item)
+    {
+        locals_t& locals = *static_cast<locals_t*>(owner);
+        const std::lock_guard<std::mutex> lock(locals.mux_);
+        for (auto itt = locals.all_.begin(); itt != locals.all_.end(); ++itt) {
+            if (itt->get() == item) {
+                local_t& local = **itt;
+                local.out_.submit(local);
+                locals.all_.erase(itt);
+                return;
+            }
+        }
+    }
+
+    // an empty chunk, reused if possible
+    chunk_t* take()
+    {
+        chunk_t* chunk;
+        if (free_.pop(chunk)) {
+            return chunk;
+        }
+        return new chunk_t;
+    }
+
+    // output written without the guard is queued a call at a time
+    void done(local_t& local)
+    {
+        if (!local.guarded_ || local.chunk_->size() >= CHUNK_LIMIT) {
+            submit(local);
+        }
+    }
+
+    void submit(local_t& local)
+    {
+        if (local.chunk_ && !local.chunk_->empty()) {
+            push(local.chunk_);
+            local.chunk_ = nullptr;
+        }
+    }
+
+    void push(chunk_t* chunk)
+    {
+        if (!chunk) {
+            return;
+        }
+        if (!overflowing_.load(std::memory_order_acquire) && queue_.push(chunk)) {
+            return wake();
+        }
+        switch (policy_) {
+        case e_block: {
+            waiting_.fetch_add(1);
+            std::unique_lock<std::mutex> lock(wake_mux_);
+            while (!queue_.push(chunk)) {
+                wake_cv_.notify_one();
+                room_cv_.wait(lock);
+            }
+            waiting_.fetch_sub(1);
+            break;
+        }
+        case e_drop:
+            dropped_.fetch_add(std::count(chunk->begin(), chunk->end(), '\n'));
+            recycle(chunk);
+            break;
+        case e_grow: {
+            const std::lock_guard<std::mutex> lock(wake_mux_);
+            overflowing_.store(true, std::memory_order_release);
+            overflow_.push_back(chunk);
+            break;
+        }
+        }
+        wake();
+    }
+
+    void wake()
+    {
+        // pairs with the fence in run() so either the writer sees the chunk
+        // or this sees the writer sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed)) {
+            const std::lock_guard<std::mutex> lock(wake_mux_);
+            wake_cv_.notify_one();
+        }
+    }
+
+    void recycle(chunk_t* chunk)
+    {
+        chunk->clear();
+        if (!free_.push(chunk)) {
+            delete chunk;
+        }
+    }
+
+    void write(chunk_t* chunk)
+    {
+        fwrite(chunk->data(), 1, chunk->size(), fd_);
+        recycle(chunk);
+    }
+
+    // drain everything queued, return true if anything was written
+    bool drain()
+    {
+        bool any = false;
+        chunk_t* chunk;
+        while (queue_.pop(chunk)) {
+            write(chunk);
+            any = true;
+            if (waiting_.load()) {
+                const std::lock_guard<std::mutex> lock(wake_mux_);
+                room_cv_.notify_all();
+            }
+        }
+        if (overflowing_.load(std::memory_order_acquire)) {
+            std::deque<chunk_t*> chunks;
+            {
+                const std::lock_guard<std::mutex> lock(wake_mux_);
+                chunks.swap(overflow_);
+            }
+            for (chunk_t* chunk : chunks) {
+                write(chunk);
+                any = true;
+            }
+            const std::lock_guard<std::mutex> lock(wake_mux_);
+            // producers go back to the queue once the backlog is written
+            if (overflow_.empty()) {
+                overflowing_.store(false, std::memory_order_release);
+            }
+        }
+        const uint64_t dropped = dropped_.exchange(0);
+        if (dropped) {
+            fprintf(fd_, "... %llu lines dropped\n", (unsigned long long)dropped);
+        }
+        return any;
+    }
+
+    void run()
+    {
+        for (;;) {
+            if (drain()) {
+                continue;
+            }
+            // deliver what was written once idle
+            fflush(fd_);
+            std::unique_lock<std::mutex> lock(wake_mux_);
+            if (quit_) {
+                lock.unlock();
+                if (!drain()) {
+                    break;
+                }
+                continue;
+            }
+            sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (queue_.empty() && !overflowing_.load() && !dropped_.load()) {
+                wake_cv_.wait(lock);
+            }
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+        fflush(fd_);
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_async(FILE* fd, backpressure_t policy, size_t capacity)
+{
+    return new cmd_output_async_t(fd, policy, capacity);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_structured_t
+
+const char* cmd_output_t::error_name(error_t code)
+{
+    switch (code) {
+    case e_invalid_command:
+        return "invalid_command";
+    case e_no_subcommand:
+        return "no_subcommand";
+    case e_unable_to_find_cmd:
+        return "unable_to_find_cmd";
+    case e_command_failed:
+        return "command_failed";
+    case e_command_cancelled:
+        return "command_cancelled";
+    case e_command_overrun:
+        return "command_overrun";
+    case e_not_val_or_ident:
+        return "not_val_or_ident";
+    case e_unknown_ident:
+        return "unknown_ident";
+    case e_malformed_exp:
+        return "malformed_exp";
+    case e_bad_expression:
+        return "bad_expression";
+    case e_unable_to_open:
+        return "unable_to_open";
+    case e_script_error:
+        return "script_error";
+    case e_no_job:
+        return "no_job";
+    case e_command_timeout:
+        return "command_timeout";
+    case e_not_concurrent:
+        return "not_concurrent";
+    case e_error:
+        return "error";
+    }
+    return "unknown";
+}
+
+// base of the outputs writing typed records rather than text, which write
+// straight to the file without allocating
+struct cmd_output_structured_t : public cmd_output_t {
+
+    static const size_t MAX_DEPTH = 16;
+
+    cmd_output_structured_t(FILE* fd)
+        : cmd_output_t()
+        , fd_(fd)
+        , size_(0)
+        , depth_(0)
+    {
+    }
+
+    virtual void lock() override
+    {
+        mux_.lock();
+    }
+
+    virtual bool try_lock() override
+    {
+        return mux_.try_lock();
+    }
+
+    virtual void unlock() override
+    {
+        mux_.unlock();
+    }
+
+    // text is collected into a line, indentation only applies to text outputs
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        (void)ind;
+        append(fmt, args);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        (void)ind;
+        append(fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        write_text(line_.data(), size_);
+        size_ = 0;
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+        (void)ind;
+        if (size < line_.size() - size_) {
+            memcpy(line_.data() + size_, text, size);
+            size_ += size;
+            eol ? this->eol() : (void)0;
+            return;
+        }
+        // too long for the line, write it out as a text record of its own
+        pending();
+        write_text(text, size);
+    }
+
+    virtual void flush() override
+    {
+        pending();
+        fflush(fd_);
+    }
+
+    virtual void emit_value(const cmd_field_t& field, const char* fmt, va_list& args) override
+    {
+        (void)fmt, (void)args;
+        pending();
+        write_value(field);
+    }
+
+    virtual void emit_row(const char* name, const cmd_field_t* fields, size_t num, const char* fmt, va_list& args) override
+    {
+        (void)fmt, (void)args;
+        pending();
+        write_row(name, fields, num);
+    }
+
+    virtual void emit_list_begin(const char* name, const char* fmt, va_list& args) override
+    {
+        (void)fmt, (void)args;
+        pending();
+        if (depth_ < MAX_DEPTH) {
+            write_list_begin(name);
+            ++depth_;
+        }
+    }
+
+    virtual void emit_list_end() override
+    {
+        pending();
+        if (depth_) {
+            --depth_;
+            write_list_end();
+        }
+    }
+
+    virtual void emit_error(error_t code, const char* fmt, va_list& args) override
+    {
+        pending();
+        std::array<char, 1024> message;
+        int len = vsnprintf(message.data(), message.size(), fmt, args);
+        len = std::min(std::max(len, 0), int(message.size()) - 1);
+        // leading space is text layout rather than part of the message
+        const char* start = message.data();
+        while (*start == ' ') {
+            ++start;
+        }
+        write_error(code, start, size_t(message.data() + len - start));
+    }
+
+protected:
+    FILE* fd_;
+    std::mutex mux_;
+    // text printed without an end of line yet
+    std::array<char, 1024> line_;
+    size_t size_;
+    // lists begun and not yet ended
+    uint32_t depth_;
+
+    virtual void write_text(const char* text, size_t size) = 0;
+    virtual void write_value(const cmd_field_t& field) = 0;
+    virtual void write_row(const char* name, const cmd_field_t* fields, size_t num) = 0;
+    virtual void write_list_begin(const char* name) = 0;
+    virtual void write_list_end() = 0;
+    virtual void write_error(error_t code, const char* message, size_t size) = 0;
+
+    // write out text left without an end of line before a record
+    void pending()
+    {
+        if (size_) {
+            eol();
+        }
+    }
+
+    void append(const char* fmt, va_list& args)
+    {
+        const size_t room = line_.size() - size_;
+        va_list copy;
+        va_copy(copy, args);
+        const int len = vsnprintf(line_.data() + size_, room, fmt, copy);
+        va_end(copy);
+        if (len <= 0) {
+            return;
+        }
+        if (size_t(len) < room) {
+            size_ += size_t(len);
+            return;
+        }
+        // too long for the line, write it out as a text record of its own
+        pending();
+        std::string temp;
+        append_format(temp, fmt, args);
+        write_text(temp.data(), temp.size());
+    }
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_json_t
+
+struct cmd_output_json_t : public cmd_output_structured_t {
+
+    cmd_output_json_t(FILE* fd)
+        : cmd_output_structured_t(fd)
+    {
+        first_.fill(true);
+    }
+
+protected:
+    // true until a list at each depth holds an item
+    std::array<bool, MAX_DEPTH + 1> first_;
+
+    void item_begin()
+    {
+        if (depth_) {
+            if (!first_[depth_]) {
+                fputc(',', fd_);
+            }
+            first_[depth_] = false;
+        }
+    }
+
+    // top level items are one object per line
+    void item_end()
+    {
+        if (!depth_) {
+            fputc('\n', fd_);
+        }
+    }
+
+    void string(const char* str, size_t size)
+    {
+        fputc('"', fd_);
+        const char* run = str;
+        for (const char* end = str + size; str != end; ++str) {
+            const unsigned char ch = *str;
+            if (ch != '"' && ch != '\\' && ch >= 0x20) {
+                continue;
+            }
+            fwrite(run, 1, str - run, fd_);
+            run = str + 1;
+            switch (ch) {
+            case '"':
+                fputs("\\\"", fd_);
+                break;
+            case '\\':
+                fputs("\\\\", fd_);
+                break;
+            case '\n':
+                fputs("\\n", fd_);
+                break;
+            case '\t':
+                fputs("\\t", fd_);
+                break;
+            default:
+                fprintf(fd_, "\\u%04x", ch);
+                break;
+            }
+        }
+        fwrite(run, 1, str - run, fd_);
+        fputc('"', fd_);
+    }
+
+    void string(const char* str)
+    {
+        string(str, strlen(str));
+    }
+
+    void field(const cmd_field_t& field)
+    {
+        string(field.key_);
+        fputc(':', fd_);
+        switch (field.type_) {
+        case cmd_field_t::e_uint:
+            fprintf(fd_, "%llu", (unsigned long long)field.uint_);
+            break;
+        case cmd_field_t::e_int:
+            fprintf(fd_, "%lld", (long long)field.int_);
+            break;
+        case cmd_field_t::e_double:
+            // JSON has no representation of inf or nan
+            std::isfinite(field.double_) ? fprintf(fd_, "%.15g", field.double_) : fputs("null", fd_);
+            break;
+        case cmd_field_t::e_string:
+            string(field.string_);
+            break;
+        case cmd_field_t::e_bool:
+            fputs(field.bool_ ? "true" : "false", fd_);
+            break;
+        }
+    }
+
+    virtual void write_text(const char* text, size_t size) override
+    {
+        item_begin();
+        fputs("{\"text\":", fd_);
+        string(text, size);
+        fputc('}', fd_);
+        item_end();
+    }
+
+    virtual void write_value(const cmd_field_t& value) override
+    {
+        item_begin();
+        fputc('{', fd_);
+        field(value);
+        fputc('}', fd_);
+        item_end();
+    }
+
+    virtual void write_row(const char* name, const cmd_field_t* fields, size_t num) override
+    {
+        item_begin();
+        fputs("{\"row\":", fd_);
+        string(name);
+        for (size_t i = 0; i < num; ++i) {
+            fputc(',', fd_);
+            field(fields[i]);
+        }
+        fputc('}', fd_);
+        item_end();
+    }
+
+    virtual void write_list_begin(const char* name) override
+    {
+        item_begin();
+        fputs("{\"list\":", fd_);
+        string(name);
+        fputs(",\"items\":[", fd_);
+        first_[depth_ + 1] = true;
+    }
+
+    virtual void write_list_end() override
+    {
+        fputs("]}", fd_);
+        item_end();
+    }
+
+    virtual void write_error(error_t code, const char* message, size_t size) override
+    {
+        item_begin();
+        fputs("{\"error\":", fd_);
+        string(error_name(code));
+        fputs(",\"message\":", fd_);
+        string(message, size);
+        fputc('}', fd_);
+        item_end();
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_json(FILE* fd)
+{
+    return new cmd_output_json_t(fd);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_binary_t
+
+// records are a kind byte and a little endian uint32 payload size followed by
+// the payload.  strings are a uint32 size and their bytes, and a field is a
+// type byte (cmd_field_t::type_t), its key string and its value.  integers
+// and doubles take 8 bytes, bools one.
+//
+//   e_text        string text
+//   e_value       field
+//   e_row         string name, uint32 count, fields
+//   e_list_begin  string name
+//   e_list_end    nothing
+//   e_error       uint32 code (cmd_output_t::error_t), string message
+//
+struct cmd_output_binary_t : public cmd_output_structured_t {
+
+    enum kind_t {
+        e_text = 1,
+        e_value,
+        e_row,
+        e_list_begin,
+        e_list_end,
+        e_error,
+    };
+
+    cmd_output_binary_t(FILE* fd)
+        : cmd_output_structured_t(fd)
+    {
+    }
+
+protected:
+    void u8(uint8_t value)
+    {
+        fputc(value, fd_);
+    }
+
+    void u32(uint32_t value)
+    {
+        const uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+        fwrite(bytes, 1, sizeof(bytes), fd_);
+    }
+
+    void u64(uint64_t value)
+    {
+        u32(uint32_t(value));
+        u32(uint32_t(value >> 32));
+    }
+
+    void string(const char* str, size_t size)
+    {
+        u32(uint32_t(size));
+        fwrite(str, 1, size, fd_);
+    }
+
+    static size_t string_size(const char* str)
+    {
+        return 4 + strlen(str);
+    }
+
+    static size_t field_size(const cmd_field_t& field)
+    {
+        const size_t size = 1 + string_size(field.key_);
+        switch (field.type_) {
+        case cmd_field_t::e_string:
+            return size + string_size(field.string_);
+        case cmd_field_t::e_bool:
+            return size + 1;
+        default:
+            return size + 8;
+        }
+    }
+
+    void header(kind_t kind, size_t size)
+    {
+        u8(uint8_t(kind));
+        u32(uint32_t(size));
+    }
+
+    void field(const cmd_field_t& field)
+    {
+        u8(uint8_t(field.type_));
+        string(field.key_, strlen(field.key_));
+        switch (field.type_) {
+        case cmd_field_t::e_uint:
+            u64(field.uint_);
+            break;
+        case cmd_field_t::e_int:
+            u64(uint64_t(field.int_));
+            break;
+        case cmd_field_t::e_double: {
+            uint64_t bits;
+            memcpy(&bits, &field.double_, sizeof(bits));
+            u64(bits);
+            break;
+        }
+        case cmd_field_t::e_string:
+            string(field.string_, strlen(field.string_));
+            break;
+        case cmd_field_t::e_bool:
+            u8(field.bool_ ? 1 : 0);
+            break;
+        }
+    }
+
+    virtual void write_text(const char* text, size_t size) override
+    {
+        header(e_text, 4 + size);
+        string(text, size);
+    }
+
+    virtual void write_value(const cmd_field_t& value) override
+    {
+        header(e_value, field_size(value));
+        field(value);
+    }
+
+    virtual void write_row(const char* name, const cmd_field_t* fields, size_t num) override
+    {
+        size_t size = string_size(name) + 4;
+        for (size_t i = 0; i < num; ++i) {
+            size += field_size(fields[i]);
+        }
+        header(e_row, size);
+        string(name, strlen(name));
+        u32(uint32_t(num));
+        for (size_t i = 0; i < num; ++i) {
+            field(fields[i]);
+        }
+    }
+
+    virtual void write_list_begin(const char* name) override
+    {
+        header(e_list_begin, string_size(name));
+        string(name, strlen(name));
+    }
+
+    virtual void write_list_end() override
+    {
+        header(e_list_end, 0);
+    }
+
+    virtual void write_error(error_t code, const char* message, size_t size) override
+    {
+        header(e_error, 4 + 4 + size);
+        u32(uint32_t(code));
+        string(message, size);
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_binary(FILE* fd)
+{
+    return new cmd_output_binary_t(fd);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_dummy_t
+
+struct cmd_output_dummy_t : public cmd_output_t {
+
+    cmd_output_dummy_t()
+        : cmd_output_t()
+    {
+    }
+
+    virtual void lock() override
+    {
+    }
+
+    virtual void unlock() override
+    {
+    }
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+    }
+
+    virtual void eol() override
+    {
+    }
+
+    virtual void emit_text(bool ind, const char* text, size_t size, bool eol) override
+    {
+    }
+};
+
+cmd_output_t* cmd_output_t::create_output_dummy()
+{
+    return new cmd_output_dummy_t;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_output_buffer_t
+
+struct cmd_output_buffer_t : public cmd_output_string_t {
+
+    cmd_output_buffer_t(std::string& text, std::vector<size_t>* offsets, bool locking)
+        : cmd_output_string_t()
+        , offsets_(offsets)
+        , locking_(locking)
+    {
+        text_ = &text;
+    }
+
+    virtual void lock() override
+    {
+        locking_ ? mux_.lock() : (void)0;
+    }
+
+    virtual bool try_lock() override
+    {
+        return locking_ ? mux_.try_lock() : true;
+    }
+
+    virtual void unlock() override
+    {
+        locking_ ? mux_.unlock() : (void)0;
+    }
+
+    virtual void mark() override
+    {
+        offsets_ ? offsets_->push_back(text_->size()) : (void)0;
+    }
+
+protected:
+    std::vector<size_t>* offsets_;
+    const bool locking_;
+    std::mutex mux_;
+};
+
+cmd_output_t* cmd_output_t::create_output_buffer(std::string& text, std::vector<size_t>* offsets, bool locking)
+{
+    return new cmd_output_buffer_t(text, offsets, locking);
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- cmd_tokens_t
+
+void cmd_tokens_t::push(const char* str, size_t size)
+{
+    const char EXP_DELIM = '$';
+    /* flush when input is empty */
+    if (size == 0) {
+        if (!stage_pair_.first.empty()) {
+            flags.flags_.insert(stage_pair_.first);
+            stage_pair_.first = std::string_view();
+        }
+        return;
+    }
+    /* process identifier substitution */
+    if (str[0] == EXP_DELIM) {
+        const std::string_view name(str + 1, size - 1);
+        const uint64_t* found = nullptr;
+        for (const cmd_idents_t* idents : { binds_, (const cmd_idents_t*)idents_ }) {
+            if (!idents) {
+                continue;
+            }
+            auto itt = idents->find(name);
+            if (itt != idents->end()) {
+                found = &itt->second;
+                break;
+            }
+        }
+        if (found) {
+            const uint64_t val = *found;
+            // todo: convert to hex string
+            std::array<char, 24> temp;
+            const int len = snprintf(temp.data(), temp.size(), "%llu", (unsigned long long)val);
+            // tokenize() reserved space for this so the views are stable
+            assert(line_.size() + len + 1 <= line_.capacity());
+            str = line_.data() + line_.size();
+            size = size_t(len);
+            line_.append(temp.data(), size);
+            line_.push_back('\0');
+        }
+    }
+    const cmd_token_t input(str, size);
+    /* add to raw token set */
     tokens.raw_.push_back(input);
     /* if we have a flag or switch */
-    if (input.find("-") == 0) {
+    if (str[0] == '-') {
         if (!stage_pair_.first.empty()) {
             flags.flags_.insert(stage_pair_.first);
         }
-        stage_pair_.first = input;
+        stage_pair_.first = input.get();
     } else {
         if (!stage_pair_.first.empty()) {
             pairs.pairs_[stage_pair_.first] = input;
-            stage_pair_.first.clear();
+            stage_pair_.first = std::string_view();
         } else {
             tokens.tokens_.push_back(input);
         }
     }
 }
 
-size_t cmd_tokens_t::tokenize(const char* in)
+size_t cmd_tokens_t::tokenize(std::string_view in, const char* const* args, size_t num_args)
 {
     const std::array<char, 3> whitespace = { ' ', '\r', '\t' };
-    assert(in);
-    const char* src = in;
-    const char* start = src;
+    const char EXP_DELIM = '$';
+    // worst case length of a substituted identifier value
+    const size_t SUBST_SIZE = 21;
+    assert(args || !num_args);
+    // take one copy of the input line and arguments that all tokens will
+    // view, with room for any identifier substitutions so that it will never
+    // reallocate
+    size_t size = in.size();
+    size_t num_subst = std::count(in.begin(), in.end(), EXP_DELIM);
+    for (size_t i = 0; i < num_args; ++i) {
+        const size_t len = strlen(args[i]);
+        num_subst += std::count(args[i], args[i] + len, EXP_DELIM);
+        size += len + 1;
+    }
+    line_.clear();
+    line_.reserve(size + 1 + ((idents_ || binds_) ? num_subst * SUBST_SIZE : 0));
+    line_.append(in);
+    for (size_t i = 0; i < num_args; ++i) {
+        line_.push_back(' ');
+        line_.append(args[i]);
+    }
+    line_.push_back('\0');
+    char* src = &line_[0];
+    char* start = src;
     // step over the string
     while (*src) {
         // find for next white space
         if (in_array(*src, whitespace)) {
-            // extract this token
-            push(std::string(start, src));
+            char* end = src;
             // skip trailing white space
             for (; in_array(*src, whitespace); ++src) {
                 ;
             }
+            // terminate and extract this token
+            *end = '\0';
+            push(start, end - start);
             start = src;
         } else {
             ++src;
@@ -454,10 +4659,10 @@ size_t cmd_tokens_t::tokenize(const char* in)
     // skip any trailing tokens
     if (src != start) {
         // extract this token
-        push(std::string(start, src));
+        push(start, src - start);
     }
     // flush tokens
-    push(std::string{});
+    push(src, 0);
     // return number of tokens
     return tokens.size();
 }
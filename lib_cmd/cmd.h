@@ -5,580 +5,2545 @@
 /// @end
 
 #pragma once
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-/// @brief cmd_list_t, list of cmd_t instances.
+/// @brief have the compiler check printf style format strings and arguments.
 ///
-typedef std::vector<std::unique_ptr<struct cmd_t>> cmd_list_t;
-
-/// @brief cmd_idents_t, identfier list used for cmd_tokens_t substitutions.
+/// the indices count from 1 and include the implicit this of methods.
+#if defined(__GNUC__) || defined(__clang__)
+#define CMD_PRINTF(fmt_ix, args_ix) __attribute__((format(printf, fmt_ix, args_ix)))
+#else
+#define CMD_PRINTF(fmt_ix, args_ix)
+#endif
+
+/// @brief cmd_trie_t, compact radix trie mapping names to list indices.
 ///
-typedef std::map<std::string, uint64_t> cmd_idents_t;
-
-/// @brief cmd_baton_t, baton used for passing user data to cm_t instances.
+/// edges are labeled with strings so that a chain of single children is
+/// stored as one node.  each node counts the values in its subtree so that a
+/// unique prefix match is found in time proportional to the prefix length.
 ///
-typedef void* cmd_baton_t;
+struct cmd_trie_t {
+
+    /// @brief result of a prefix search.
+    struct match_t {
+        /// @brief node the prefix ended at.
+        uint32_t node_;
+        /// @brief true if the prefix was an exact key.
+        bool exact_;
+        /// @brief number of matching values.
+        uint32_t count_;
+        /// @brief lowest matching value.
+        uint32_t first_;
+    };
 
-/// @brief cmd_util_t, utility functions for the command parser.
-///
-struct cmd_util_t {
+    /// @brief constructor.
+    cmd_trie_t();
 
-    /// @brief convert string to 64 bit integer.
-    ///
-    /// @param in input string to parse as integer
-    /// @param out output integer to receive contersion
-    /// @param neg output boolean to be set if integer should be negated
+    /// @brief insert a new key value pair.
     ///
-    /// @return true if the conversion was successfull
-    static bool strtoll(const char* in, uint64_t& out, bool& neg);
+    /// @param key key to insert, duplicate keys are allowed.
+    /// @param value value to associate with key.
+    void insert(std::string_view key, uint32_t value);
 
-    /// @brief levenshtein string distance function.
+    /// @brief search for all keys matching a prefix.
     ///
-    /// @param s1 input string a
-    /// @param s2 input string b
+    /// if prefix is itself a key then only the values for that key match.
     ///
-    /// @return edit distance between strings s1 and s2
-    static uint32_t levenshtein(const char* a, const char* b);
+    /// @param prefix key prefix to search for.
+    /// @param out match result.
+    /// @return true if any keys matched.
+    bool find(std::string_view prefix, match_t& out) const;
 
-    /// @brief partial substring match.
+    /// @brief collect all matching values in ascending order.
     ///
-    /// @return number of characters between str and sub that match or -1 if different
-    static int32_t str_match(const char* str, const char* sub);
-};
+    /// @param match result returned from find().
+    /// @param out vector to append the matching values to.
+    void collect(const match_t& match, std::vector<uint32_t>& out) const;
 
-/// @brief cmd_output_t, command output interface base class.
-///
-/// this class brokers all output text writing from cmd_t classes during command execution.
-/// using a specific class we can ensure consisten output and eliminate output race conditions.
-/// a versatile iterface also makes it easy to output text in a range of formats.
-/// cmd_output_t is also a factory for derived classes with specialisations.
-///
-struct cmd_output_t {
+protected:
+    struct node_t {
+        /// @brief edge label from the parent node.
+        std::string label_;
+        /// @brief child nodes sorted by the first character of their label.
+        std::vector<uint32_t> child_;
+        /// @brief values of the keys that end at this node.
+        std::vector<uint32_t> value_;
+        /// @brief number of values in this subtree.
+        uint32_t count_;
+        /// @brief lowest value in this subtree.
+        uint32_t first_;
+    };
 
-    /// @brief Create a cmd_output_t instance that will write directly to a file descriptor.
+    /// @brief find the child of a node with a label starting with ch.
     ///
-    /// @param fd, the file descriptior that all output will be written to.
-    /// @return cmd_output_t instance.
-    static cmd_output_t* create_output_stdio(FILE* fd);
+    /// @return the child slot in node.child_ if found, otherwise the slot
+    ///         the child should be inserted at.
+    size_t child_find(const node_t& node, char ch, bool& found) const;
 
-    /// @bried Create a dummy cmd_output_t instance that has no side effects.
-    ///
-    /// @return cmd_output_t instance.
-    static cmd_output_t* create_output_dummy();
+    /// @brief append all values of a subtree.
+    void collect(uint32_t node, std::vector<uint32_t>& out) const;
 
-    /// @brief indent_t, indent control helper class.
-    ///
-    struct indent_t {
+    /// @brief all trie nodes, the root is node 0.
+    std::vector<node_t> node_;
+};
 
-        indent_t(uint32_t* ptr, uint32_t indent)
-            : ptr_(ptr)
-            , restore_(*ptr)
-        {
-            assert(ptr);
-            *ptr += indent;
-        }
+/// @brief cmd_static_index_t, compile time name index for a cmd_list_t.
+///
+/// entries are sorted by the hash of their name so that a name can be
+/// resolved with a binary search and a single string compare.  instances are
+/// produced at compile time by cmd_static_table_t.
+///
+struct cmd_static_index_t {
+
+    struct entry_t {
+        /// @brief hash of the command name.
+        uint64_t hash_;
+        /// @brief command name.
+        const char* name_;
+        /// @brief index of the command in the registered type list.
+        uint32_t index_;
+    };
 
-        ~indent_t()
-        {
-            assert(ptr_);
-            *ptr_ = restore_;
+    /// @brief FNV-1a string hash usable at compile time.
+    ///
+    /// @param str string to hash.
+    /// @return 64 bit hash value.
+    static constexpr uint64_t hash(std::string_view str)
+    {
+        uint64_t out = 0xcbf29ce484222325ull;
+        for (const char ch : str) {
+            out = (out ^ uint8_t(ch)) * 0x100000001b3ull;
         }
+        return out;
+    }
 
-        void add(uint32_t num)
-        {
-            assert(ptr_);
-            *ptr_ += num;
-        }
+    /// @brief sorted entry table.
+    const entry_t* entry_;
+    /// @brief number of entries in the table.
+    size_t size_;
+};
 
-    protected:
-        uint32_t* ptr_;
-        uint32_t restore_;
-    };
+/// @brief cmd_static_table_t, dispatch table built at compile time.
+///
+/// each type_t must provide its command name as a 'static constexpr const
+/// char* NAME' member.
+///
+template <typename... types_t>
+struct cmd_static_table_t {
 
-    /// @brief guard_t, output mutex helper class.
-    ///
-    struct guard_t {
-        cmd_output_t& out_;
+    typedef cmd_static_index_t::entry_t entry_t;
 
-        guard_t() = delete;
+    static constexpr size_t SIZE = sizeof...(types_t);
 
-        guard_t(cmd_output_t& out)
-            : out_(out)
-        {
-            out.lock();
+    static constexpr std::array<entry_t, SIZE> build()
+    {
+        std::array<entry_t, SIZE> out{};
+        const char* names[] = { types_t::NAME... };
+        for (size_t i = 0; i < SIZE; ++i) {
+            out[i] = entry_t{ cmd_static_index_t::hash(names[i]), names[i], uint32_t(i) };
         }
-
-        ~guard_t()
-        {
-            out_.unlock();
+        // insertion sort by hash
+        for (size_t i = 1; i < SIZE; ++i) {
+            for (size_t j = i; j > 0 && out[j].hash_ < out[j - 1].hash_; --j) {
+                const entry_t temp = out[j];
+                out[j] = out[j - 1];
+                out[j - 1] = temp;
+            }
         }
-    };
+        return out;
+    }
 
-    /// @brief obtain scope guard for the output mutex.
-    ///
-    /// @return scope guard object for the output mutex.
-    guard_t guard()
+    /// @brief the sorted dispatch table.
+    static constexpr std::array<entry_t, SIZE> table_ = build();
+
+    /// @brief return a type erased index for the dispatch table.
+    static cmd_static_index_t index()
     {
-        return guard_t(*this);
+        return cmd_static_index_t{ table_.data(), SIZE };
     }
+};
+
+/// @brief cmd_list_t, list of cmd_t instances.
+///
+/// commands are kept in the order they were added alongside a cmd_trie_t of
+/// their names which is used to resolve commands by name or unique prefix.
+/// a list may also hold one contiguous run of statically registered commands
+/// whose exact names are resolved through a cmd_static_index_t first.
+///
+struct cmd_list_t {
 
     /// @brief constructor.
-    cmd_output_t()
-        : indent_(2)
+    cmd_list_t()
+        : static_{ nullptr, 0 }
+        , static_base_(0)
     {
     }
 
-    /// @brief virtual destructor.
-    virtual ~cmd_output_t() {}
-
-    /// @brief aquire the output mutex.
-    virtual void lock() = 0;
-
-    /// @brief release the output mutex.
-    virtual void unlock() = 0;
+    typedef std::vector<std::unique_ptr<struct cmd_t>> vector_t;
+    typedef vector_t::iterator iterator;
+    typedef vector_t::const_iterator const_iterator;
+    typedef vector_t::reverse_iterator reverse_iterator;
+    typedef vector_t::const_reverse_iterator const_reverse_iterator;
 
-    /// @brief push a new indentation level.
+    /// @brief append a command to the list.
     ///
-    /// @return indent helper class.
-    indent_t indent(uint32_t next = 2)
-    {
-        return indent_t(&indent_, next);
-    }
+    /// @param cmd the command to take ownership of.
+    void push_back(std::unique_ptr<cmd_t>&& cmd);
 
-    /// @brief print a format string into this output stream.
-    ///
-    /// print to output string without appending a new line.
+    /// @brief copy the commands and their indices into a tree snapshot.
     ///
-    /// @param INDENT follow indentation marker from output string.
-    /// @param fmt format string.
-    /// @param variable length argument list.
-    template <bool INDENT = true>
-    void print(const char* fmt, ...)
-    {
-        va_list args;
-        va_start(args, fmt);
-        print(INDENT, fmt, args);
-        va_end(args);
-    }
+    /// @param out snapshot to receive the root list.
+    void snapshot(struct cmd_tree_t& out) const;
 
-    /// @brief print a format string into this output stream.
+    /// @brief find the commands that best match a name or prefix.
     ///
-    /// print to output string and append a new line.
+    /// an exact name match is preferred, otherwise all of the commands that
+    /// sub is a prefix of are returned in the order they were added.
     ///
-    /// @param INDENT follow indentation marker from output string.
-    /// @param fmt format string.
-    /// @param variable length argument list.
-    template <bool INDENT = true>
-    void println(const char* fmt, ...)
-    {
-        va_list args;
-        va_start(args, fmt);
-        println(INDENT, fmt, args);
-        va_end(args);
-    }
-
-    virtual void print(bool indent, const char* fmt, va_list& args) = 0;
-    virtual void println(bool indent, const char* fmt, va_list& args) = 0;
-
-    /// @brief Append an end of line character.
-    virtual void eol() = 0;
-
-protected:
-    /// @brief Current indentation level.
-    uint32_t indent_;
-};
-
-/// @brief cmd_locale_t, command locale text definitions.
-///
-struct cmd_locale_t {
+    /// @param sub name or prefix to match.
+    /// @param out vector to append the matching commands to.
+    /// @return true if any commands matched.
+    bool find(std::string_view sub, std::vector<cmd_t*>& out) const;
 
-    static void possible_completions(cmd_output_t& out)
-    {
-        out.println("possible completions:");
-    }
+    /// @brief find a command with an exact name.
+    ///
+    /// @param name command name to find.
+    /// @return the first command added with this name, otherwise nullptr.
+    cmd_t* find_exact(std::string_view name) const;
 
-    static void invalid_command(cmd_output_t& out)
-    {
-        out.println("invalid command");
-    }
+    /// @brief attach a static index to the list.
+    ///
+    /// @param index compile time index of a run of commands.
+    /// @param base position in the list of the first command in the run.
+    void set_static(const cmd_static_index_t& index, size_t base);
 
-    static void no_subcommand(cmd_output_t& out, const char* cmd)
-    {
-        out.println("no subcommand '%s'", cmd);
-    }
+    /// @brief find a command by exact name in the static index only.
+    ///
+    /// @param name command name to find.
+    /// @return the statically registered command, otherwise nullptr.
+    cmd_t* find_static(std::string_view name) const;
 
-    static void did_you_meen(cmd_output_t& out)
+    size_t size() const
     {
-        out.println("did you meen:");
+        return list_.size();
     }
 
-    static void not_val_or_ident(cmd_output_t& out)
+    bool empty() const
     {
-        out.println("return type not value or identifier");
+        return list_.empty();
     }
 
-    static void unknown_ident(cmd_output_t& out, const char* ident)
+    iterator begin()
     {
-        out.println("unknown identifier '%s'", ident);
+        return list_.begin();
     }
 
-    static void malformed_exp(cmd_output_t& out)
+    iterator end()
     {
-        out.println("malformed expression");
+        return list_.end();
     }
 
-    static void error(cmd_output_t& out, const char* err)
+    const_iterator begin() const
     {
-        out.println("error: %s", err);
+        return list_.begin();
     }
 
-    static void usage(cmd_output_t& out, const char* path, const char* args, const char* desc)
+    const_iterator end() const
     {
-        out.println("usage: %s %s", path, args ? args : "");
-        if (desc) {
-            out.println("desc:  %s", desc);
-        }
+        return list_.end();
     }
 
-    static void subcommands(cmd_output_t& out)
+    reverse_iterator rbegin()
     {
-        out.println("subcomands:");
+        return list_.rbegin();
     }
 
-    static void unable_to_find_cmd(cmd_output_t& out, const char* cmd)
+    reverse_iterator rend()
     {
-        out.println("unable to find command '%s'", cmd);
+        return list_.rend();
     }
 
-    static void num_aliases(cmd_output_t& out, uint64_t num)
+    const std::unique_ptr<cmd_t>& operator[](size_t index) const
     {
-        num ? out.println("%d aliases:", (uint32_t)num) : out.println("no alises");
+        return list_[index];
     }
 
-    static void command_failed(cmd_output_t& out, const char* cmd)
-    {
-        out.println("  command failed: '%s'", cmd);
-    }
+protected:
+    /// @brief commands in the order they were added.
+    vector_t list_;
+    /// @brief name index into list_.
+    cmd_trie_t trie_;
+    /// @brief compile time index for statically registered commands.
+    cmd_static_index_t static_;
+    /// @brief position of the first statically registered command.
+    size_t static_base_;
 };
 
-/// @brief cmd_token_t, command arguement token.
+/// @brief cmd_idents_t, identfier list used for cmd_tokens_t substitutions.
 ///
-/// User input is processed, it is parsed to form a list of tokens.  These
-/// tokens are encapsulated as a cmd_token_t.  A list of tokens is defined as
-/// the cmd_tokens_t type.  The cmd_token_t type makes it easier to convert
-/// string tokens between multiple data types.
+/// the comparator is transparent so that lookups can be made directly from
+/// token views without building a temporary std::string.
 ///
-struct cmd_token_t {
+typedef std::map<std::string, uint64_t, std::less<>> cmd_idents_t;
 
-    /// @brief constructor.
-    cmd_token_t() = default;
+/// @brief cmd_baton_t, baton used for passing user data to cm_t instances.
+///
+typedef void* cmd_baton_t;
 
-    /// @brief cmd_token_t constructor.
+/// @brief cmd_util_t, utility functions for the command parser.
+///
+struct cmd_util_t {
+
+    /// @brief convert string to 64 bit integer.
     ///
-    /// @param string token.
-    cmd_token_t(const std::string& string)
-        : token_(string)
-    {
-    }
+    /// @param in input string to parse as integer
+    /// @param out output integer to receive contersion
+    /// @param neg output boolean to be set if integer should be negated
+    ///
+    /// @return true if the conversion was successfull
+    static bool strtoll(const char* in, uint64_t& out, bool& neg);
 
-    /// @brief return token as a string.
+    /// @brief levenshtein string distance function.
     ///
-    /// @return underlying token string.
-    const std::string& get() const
-    {
-        return token_;
-    }
+    /// @param s1 input string a
+    /// @param s2 input string b
+    ///
+    /// @return edit distance between strings s1 and s2
+    static uint32_t levenshtein(const char* a, const char* b);
 
-    /// @brief get token as an integer.
+    /// @brief bounded levenshtein string distance function.
     ///
-    /// @param output integer to store the conversion.
-    /// @return true if the token represents an integer.
-    template <typename type_t>
-    bool get(type_t& out) const
-    {
-        bool neg = false;
-        uint64_t value = 0;
-        if (!cmd_util_t::strtoll(token_.c_str(), value, neg)) {
-            return false;
-        }
-        out = static_cast<type_t>(neg ? 0 - value : value);
-        return true;
-    }
+    /// uses a bit parallel kernel and stops as soon as the distance is known
+    /// to be at least max.
+    ///
+    /// @param a input string a
+    /// @param b input string b
+    /// @param max distance bound
+    ///
+    /// @return edit distance between a and b, or max if it is not less than max
+    static uint32_t levenshtein(const char* a, const char* b, uint32_t max);
 
-    /// @brief test for token equality.
+    /// @brief bounded levenshtein distance from one query to many strings.
     ///
-    /// @param rhs token to check equality with.
-    /// @return true if tokens are equal.
-    bool operator==(const cmd_token_t& rhs) const
-    {
-        return token_ == rhs.get();
-    }
+    /// the query is preprocessed once and candidates are scored in SIMD lanes
+    /// where they are available.
+    ///
+    /// @param query input string to compare against all candidates
+    /// @param names array of candidate strings
+    /// @param count number of candidate strings
+    /// @param max distance bound
+    /// @param out array receiving count bounded distances
+    static void levenshtein(const char* query,
+        const char* const* names,
+        size_t count,
+        uint32_t max,
+        uint32_t* out);
 
-    /// @brief test for token equality.
+    /// @brief partial substring match.
     ///
-    /// @param rhs token to check equality with.
-    /// @return true if token is equal to rhs.
-    template <typename type_t>
-    bool operator==(const type_t& rhs) const
-    {
-        return token_ == rhs;
-    }
-
-    /// @brief std::string cast operator.
-    ///
-    /// @return token as string.
-    operator std::string() const
-    {
-        return token_;
-    }
-
-    /// @brief c string cast operator.
-    ///
-    /// @return c string representataion of token.
-    const char* c_str() const
-    {
-        return token_.c_str();
-    }
-
-protected:
-    std::string token_;
+    /// @return number of characters between str and sub that match or -1 if different
+    static int32_t str_match(const char* str, const char* sub);
 };
 
-/// @brief cmd_tokens_t, command arguments token list.
+/// @brief cmd_format_t, compile time checked format strings.
 ///
-struct cmd_tokens_t {
+/// format strings made with CMD_FMT() are checked against the types of their
+/// arguments and split into literal text and placeholders at compile time, so
+/// printing only copies text and converts the arguments.  a placeholder is
+/// "{[-][0][width][.precision][x]}", "{{" and "}}" print a brace.  '-' aligns
+/// left, '0' pads numbers with zeros, precision is the number of fraction
+/// digits of a floating point value and 'x' prints an integer in hex.
+///
+/// out.println(CMD_FMT("{8} - {}"), name, path);
+///
+struct cmd_format_t {
+
+    enum kind_t : uint8_t {
+        e_none,
+        e_int,
+        e_uint,
+        e_double,
+        e_string,
+        e_bool,
+        e_char,
+    };
 
-    struct {
-        /// @brief check if a flag was passed to the token list.
-        ///
-        /// @return true if 'name' flag was passed as an argument.
-        bool get(const std::string& name) const
+    /// @brief literal text or one placeholder of a format string.
+    struct spec_t {
+        // literal text when arg_ is NO_ARG
+        static constexpr uint16_t NO_ARG = 0xffff;
+
+        uint16_t offset_ = 0;
+        uint16_t size_ = 0;
+        uint16_t arg_ = NO_ARG;
+        uint8_t width_ = 0;
+        int8_t precision_ = -1;
+        bool left_ = false;
+        bool zero_ = false;
+        bool hex_ = false;
+    };
+
+    /// @brief type erased argument.
+    struct arg_t {
+        arg_t()
+            : kind_(e_none)
+            , size_(0)
         {
-            return !(flags_.find(name) == flags_.end());
+            uint_ = 0;
         }
 
-        /// @brief check if the flag set is empty.
-        ///
-        /// @return true if the flags set is empty, otherwise false.
-        bool empty() const
+        arg_t(bool value)
+            : kind_(e_bool)
+            , size_(0)
         {
-            return flags_.empty();
+            bool_ = value;
         }
 
-        /// @brief command token flags.
-        std::set<std::string> flags_;
-    } flags;
-
-    struct {
-        /// @brief retreive the argument to a passed token pair.
-        ///
-        /// @return true if the pair was in the token list.
-        bool get(const std::string& name, cmd_token_t& out) const
+        arg_t(char value)
+            : kind_(e_char)
+            , size_(0)
         {
-            auto itt = pairs_.find(name);
-            if (itt == pairs_.end()) {
-                return false;
-            } else {
-                return (out = itt->second), true;
-            }
+            char_ = value;
         }
 
-        /// @brief check if the pairs map is empty.
-        ///
-        /// @return true if the pairs set is empty, otherwise false.
-        bool empty() const
+        arg_t(double value)
+            : kind_(e_double)
+            , size_(0)
         {
-            return pairs_.empty();
+            double_ = value;
         }
 
-        /// @brief key value pair arguments.
-        std::map<std::string, cmd_token_t> pairs_;
-    } pairs;
+        arg_t(const char* value)
+            : kind_(e_string)
+            , size_(value ? strlen(value) : 0)
+        {
+            string_ = value ? value : "";
+        }
 
-    struct {
-        /// @brief return number of tokens in the token list.
-        ///
-        /// @return number of tokens in the token list.
-        size_t size() const
+        arg_t(std::string_view value)
+            : kind_(e_string)
+            , size_(value.size())
         {
-            return tokens_.size();
+            string_ = value.data();
         }
 
-        /// @brief get the front most token from the token list.
-        ///
-        /// @return true if the front most token could be retrived.
-        bool get(std::string& out)
+        arg_t(const std::string& value)
+            : arg_t(std::string_view(value))
         {
-            if (tokens_.empty()) {
-                return false;
-            }
-            out = tokens_.front().get();
-            tokens_.pop_front();
-            return true;
         }
 
-        /// @brief get the front most token from the token list.
-        ///
-        /// @param output to receive front most token.
-        /// @return true if the front most token could be retrived.
-        bool get(cmd_token_t& out)
+        template <typename type_t, typename = typename std::enable_if<std::is_integral<type_t>::value>::type>
+        arg_t(type_t value)
+            : kind_(std::is_signed<type_t>::value ? e_int : e_uint)
+            , size_(0)
         {
-            if (tokens_.empty()) {
-                return false;
+            if (std::is_signed<type_t>::value) {
+                int_ = int64_t(value);
+            } else {
+                uint_ = uint64_t(value);
             }
-            out = tokens_.front();
-            tokens_.pop_front();
-            return true;
         }
 
-        /// @brief get the front most token from the token list as an integer.
-        ///
-        /// @param output to receive the front most token.
-        /// @return true if the front most token could be interpreted as integer.
-        bool get(uint64_t& out)
+        kind_t kind_;
+        // length of a string
+        size_t size_;
+        union {
+            uint64_t uint_;
+            int64_t int_;
+            double double_;
+            const char* string_;
+            bool bool_;
+            char char_;
+        };
+    };
+
+    /// @brief line rendered on the stack, moving to the heap only when long.
+    struct buffer_t {
+        buffer_t()
+            : size_(0)
         {
-            if (!tokens_.empty()) {
-                if (front().get(out)) {
-                    tokens_.pop_front();
-                    return true;
-                }
-            }
-            return false;
+            // set once inline_ is constructed, it is left uninitialized
+            data_ = inline_.data();
+            capacity_ = inline_.size();
         }
 
-        /// @brief check if the token list is empty.
-        ///
-        /// @return true if the token list is empty.
-        bool empty() const
+        buffer_t(const buffer_t&) = delete;
+
+        const char* data() const
         {
-            return tokens_.empty();
+            return data_;
         }
 
-        /// @brief return a reference to the first token in the queue.
-        ///
-        /// @return reference to first token.
-        const cmd_token_t& front() const
+        size_t size() const
         {
-            return tokens_.front();
+            return size_;
         }
 
-        /// @brief return a reference to the last token in the queue.
-        ///
-        /// @return reference to last token.
-        const cmd_token_t& back() const
+        /// @brief return room for num more characters, committed by advance().
+        char* reserve(size_t num);
+
+        void advance(size_t num)
         {
-            return tokens_.back();
+            size_ += num;
         }
 
-        /// @brief pop front most argument from token list.
-        ///
-        /// @return true if front argument was popped.
-        bool pop()
+        void append(const char* src, size_t num)
         {
-            if (!tokens_.empty()) {
-                assert(!raw_.empty());
-                if (raw_.front() == tokens_.front()) {
-                    // pop prefixed tokens
-                    raw_.pop_front();
-                    tokens_.pop_front();
-                    return true;
-                }
+            memcpy(reserve(num), src, num);
+            size_ += num;
+        }
+
+    protected:
+        char* data_;
+        size_t size_;
+        size_t capacity_;
+        std::string heap_;
+        std::array<char, 256> inline_;
+    };
+
+    /// @brief base of the string types made by CMD_FMT().
+    struct string_t {
+    };
+
+    /// @brief return the kind of argument a type is printed as, e_none if it can not be.
+    template <typename type_t>
+    static constexpr kind_t kind_of()
+    {
+        typedef typename std::decay<type_t>::type decayed_t;
+        return std::is_same<decayed_t, bool>::value ? e_bool
+            : std::is_same<decayed_t, char>::value ? e_char
+            : std::is_integral<decayed_t>::value ? (std::is_signed<decayed_t>::value ? e_int : e_uint)
+            : std::is_floating_point<decayed_t>::value ? e_double
+            : (std::is_same<decayed_t, const char*>::value || std::is_same<decayed_t, char*>::value
+                  || std::is_same<decayed_t, std::string>::value || std::is_same<decayed_t, std::string_view>::value)
+            ? e_string
+            : e_none;
+    }
+
+    /// @brief parse one placeholder starting after its '{'.
+    ///
+    /// @return index of its closing '}', 0 if malformed.
+    static constexpr size_t parse_spec(const char* fmt, size_t ix, spec_t& spec)
+    {
+        if (fmt[ix] == '-') {
+            spec.left_ = true;
+            ++ix;
+        }
+        if (fmt[ix] == '0') {
+            spec.zero_ = true;
+            ++ix;
+        }
+        uint32_t width = 0;
+        for (; fmt[ix] >= '0' && fmt[ix] <= '9'; ++ix) {
+            width = width * 10 + uint32_t(fmt[ix] - '0');
+        }
+        if (width > 0xff) {
+            return 0;
+        }
+        spec.width_ = uint8_t(width);
+        if (fmt[ix] == '.') {
+            uint32_t precision = 0;
+            const size_t start = ++ix;
+            for (; fmt[ix] >= '0' && fmt[ix] <= '9'; ++ix) {
+                precision = precision * 10 + uint32_t(fmt[ix] - '0');
             }
-            assert(!"FIXME: failed to pop");
-            return false;
+            if (ix == start || precision > 0x7f) {
+                return 0;
+            }
+            spec.precision_ = int8_t(precision);
+        }
+        if (fmt[ix] == 'x') {
+            spec.hex_ = true;
+            ++ix;
         }
+        return fmt[ix] == '}' ? ix : 0;
+    }
 
-        /// @brief Find a matching token in the token list.
-        ///
-        /// @param in input string to try and locate in the token list.
-        const bool find(const std::string& in) const
-        {
-            for (const cmd_token_t& tok : tokens_) {
-                if (tok == in) {
-                    return true;
+    /// @brief split a format string into specs.
+    ///
+    /// @param fmt the format string.
+    /// @param out where specs are written, or nullptr to only count them.
+    /// @return number of specs, or -1 if the format string is malformed.
+    static constexpr int32_t split(const char* fmt, spec_t* out)
+    {
+        int32_t num = 0;
+        uint16_t args = 0;
+        size_t start = 0;
+        size_t ix = 0;
+        for (;; ++ix) {
+            const char ch = fmt[ix];
+            if (ch != '\0' && ch != '{' && ch != '}') {
+                continue;
+            }
+            // a doubled brace keeps the first one as literal text
+            const bool escape = ch != '\0' && fmt[ix + 1] == ch;
+            const size_t end = escape ? ix + 1 : ix;
+            if (end > start) {
+                if (end - start > 0xffff) {
+                    return -1;
                 }
+                if (out) {
+                    out[num].offset_ = uint16_t(start);
+                    out[num].size_ = uint16_t(end - start);
+                }
+                ++num;
             }
-            return false;
+            if (ch == '\0') {
+                return num;
+            }
+            if (escape) {
+                start = ++ix + 1;
+                continue;
+            }
+            if (ch == '}') {
+                return -1;
+            }
+            spec_t spec;
+            const size_t close = parse_spec(fmt, ix + 1, spec);
+            if (!close) {
+                return -1;
+            }
+            spec.arg_ = args++;
+            if (out) {
+                out[num] = spec;
+            }
+            ++num;
+            ix = close;
+            start = close + 1;
         }
+    }
 
-        /// @brief Accessor for the tokens deque.
-        std::deque<cmd_token_t>& operator()()
-        {
-            return tokens_;
+    /// @brief return the number of placeholders of a well formed format string.
+    static constexpr size_t num_args(const char* fmt)
+    {
+        size_t num = 0;
+        for (size_t ix = 0; fmt[ix]; ++ix) {
+            if ((fmt[ix] == '{' || fmt[ix] == '}') && fmt[ix + 1] == fmt[ix]) {
+                ++ix;
+            } else if (fmt[ix] == '{') {
+                ++num;
+            }
         }
+        return num;
+    }
 
-        /// @brief basic token arguments.
-        std::deque<cmd_token_t> tokens_;
-        /// @brief raw tokens.
-        std::deque<cmd_token_t> raw_;
-    } tokens;
-
-    /// @brief constructor.
-    ///
-    /// @param idents list of identifiers to substitute tokens with.
-    cmd_tokens_t(cmd_idents_t* idents)
-        : idents_(idents)
+    /// @brief check the placeholders of a well formed format string suit their arguments.
+    static constexpr bool suits(const char* fmt, const kind_t* kinds)
     {
+        size_t arg = 0;
+        for (size_t ix = 0; fmt[ix]; ++ix) {
+            if ((fmt[ix] == '{' || fmt[ix] == '}') && fmt[ix + 1] == fmt[ix]) {
+                ++ix;
+                continue;
+            }
+            if (fmt[ix] != '{') {
+                continue;
+            }
+            spec_t spec;
+            ix = parse_spec(fmt, ix + 1, spec);
+            const kind_t kind = kinds[arg++];
+            if (kind == e_none) {
+                return false;
+            }
+            if (spec.hex_ && kind != e_int && kind != e_uint) {
+                return false;
+            }
+            if (spec.precision_ >= 0 && kind != e_double) {
+                return false;
+            }
+            if (spec.zero_ && kind != e_int && kind != e_uint && kind != e_double) {
+                return false;
+            }
+        }
+        return true;
     }
 
-    /// @brief tokenize and input stream into a cmd_tokens_t instance.
-    ///
-    /// @param in input stream to tokenize.
-    /// @param out output cmd_tokens_t instance to populate.
-    /// @return number of tokens parsed.
-    size_t tokenize(const char* in);
+    /// @brief the checked and split form of a CMD_FMT() string.
+    template <typename fmt_t, typename... args_t>
+    struct compiled_t {
+        // trailing entry so that no arguments is not an empty array
+        static constexpr kind_t kinds[] = { kind_of<args_t>()..., e_none };
+        static constexpr int32_t count = split(fmt_t::get(), nullptr);
 
-protected:
-    /// @brief push a new token into this token list.
-    ///
-    /// @param string token to push onto list.
-    void push(std::string input);
+        static_assert(count >= 0, "malformed format string");
+        static_assert(count < 0 || num_args(fmt_t::get()) == sizeof...(args_t),
+            "format string placeholders do not match the number of arguments");
+        static_assert(count < 0 || num_args(fmt_t::get()) != sizeof...(args_t) || suits(fmt_t::get(), kinds),
+            "format string placeholder does not suit its argument type");
 
-    /// @brief list of identifiers that can be substituted for tokens.
-    cmd_idents_t* idents_;
+        static constexpr std::array<spec_t, size_t(count < 0 ? 0 : count)> make()
+        {
+            std::array<spec_t, size_t(count < 0 ? 0 : count)> specs {};
+            split(fmt_t::get(), specs.data());
+            return specs;
+        }
 
-    /// @brief staging area for pairs.
-    std::pair<std::string, cmd_token_t> stage_pair_;
+        static constexpr std::array<spec_t, size_t(count < 0 ? 0 : count)> specs = make();
+    };
+
+    /// @brief render a split format string and its arguments.
+    static void render(buffer_t& out, const char* fmt, const spec_t* specs, size_t num, const arg_t* args);
 };
 
-/// @brief cmd_t, the command base class.
+/// @brief make a compile time checked format string for cmd_output_t::print(),
+/// println(), value(), row(), list_begin() and error().
+#define CMD_FMT(str)                                   \
+    [] {                                               \
+        struct str_t : public cmd_format_t::string_t { \
+            static constexpr const char* get()         \
+            {                                          \
+                return str;                            \
+            }                                          \
+        };                                             \
+        return str_t();                                \
+    }()
+
+/// @brief cmd_field_t, typed value of structured output.
 ///
-/// this is the base command class that should be extended to handle custom commands.
-/// a cmd_t can be a child of another command or inserted into a cmd_parser_t as a root command.
-/// two key methods can be overriden, on_execute and on_usage which the cmd_parser_t will invoke based on user input.
+/// fields are built by cmd_output_t::value() and cmd_output_t::row() from
+/// the same arguments that render their text.  string fields only view their
+/// text and are valid for the duration of the call.
 ///
-struct cmd_t {
+struct cmd_field_t {
+
+    enum type_t {
+        e_uint,
+        e_int,
+        e_double,
+        e_string,
+        e_bool,
+    };
 
-    /// @brief command name.
-    const char* const name_;
+    cmd_field_t(const char* key, bool value)
+        : key_(key)
+        , type_(e_bool)
+    {
+        bool_ = value;
+    }
 
-    /// @brief owning command parser.
-    struct cmd_parser_t& parser_;
+    cmd_field_t(const char* key, const char* value)
+        : key_(key)
+        , type_(e_string)
+    {
+        string_ = value ? value : "";
+    }
 
-    /// @brief opaque user data for this command.
-    cmd_baton_t user_;
+    cmd_field_t(const char* key, const std::string& value)
+        : cmd_field_t(key, value.c_str())
+    {
+    }
 
-    /// @brief the parent if this is a child command.
-    cmd_t* parent_;
+    cmd_field_t(const char* key, double value)
+        : key_(key)
+        , type_(e_double)
+    {
+        double_ = value;
+    }
 
-    /// @brief list of child commands.
-    cmd_list_t sub_;
+    template <typename type_t, typename = typename std::enable_if<std::is_integral<type_t>::value>::type>
+    cmd_field_t(const char* key, type_t value)
+        : key_(key)
+        , type_(std::is_signed<type_t>::value ? e_int : e_uint)
+    {
+        if (std::is_signed<type_t>::value) {
+            int_ = int64_t(value);
+        } else {
+            uint_ = uint64_t(value);
+        }
+    }
 
-    /// @brief command argument string.
-    const char* usage_;
+    const char* key_;
+    type_t type_;
+    union {
+        uint64_t uint_;
+        int64_t int_;
+        double double_;
+        const char* string_;
+        bool bool_;
+    };
+};
 
-    /// @brief command description string.
-    const char* desc_;
+/// @brief cmd_output_t, command output interface base class.
+///
+/// this class brokers all output text writing from cmd_t classes during command execution.
+/// using a specific class we can ensure consisten output and eliminate output race conditions.
+/// a versatile iterface also makes it easy to output text in a range of formats.
+/// cmd_output_t is also a factory for derived classes with specialisations.
+///
+struct cmd_output_t {
 
-    /// @brief cmd_t constructor.
+    /// @brief what an asynchronous output does while its queue is full.
+    enum backpressure_t {
+        // wait for the writer to make room
+        e_block,
+        // discard the output, the writer reports how many lines were lost
+        e_drop,
+        // queue the output without a limit
+        e_grow,
+    };
+
+    /// @brief error codes reported through error().
+    enum error_t {
+        e_invalid_command,
+        e_no_subcommand,
+        e_unable_to_find_cmd,
+        e_command_failed,
+        e_command_cancelled,
+        e_command_overrun,
+        e_not_val_or_ident,
+        e_unknown_ident,
+        e_malformed_exp,
+        e_bad_expression,
+        e_unable_to_open,
+        e_script_error,
+        e_no_job,
+        e_command_timeout,
+        e_not_concurrent,
+        e_error,
+    };
+
+    /// @brief return the name of an error code, as written by structured outputs.
+    static const char* error_name(error_t code);
+
+    /// @brief Create a cmd_output_t instance that will write directly to a file descriptor.
+    ///
+    /// @param fd, the file descriptior that all output will be written to.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_stdio(FILE* fd);
+
+    /// @brief Create a cmd_output_t instance that buffers output for a file descriptor.
+    ///
+    /// output is formatted into reusable chunks and written with a single
+    /// writev() when the output guard is released, which is once per command
+    /// or batch, or when flush() is called.  output written without holding
+    /// the guard, such as a prompt, must be followed by flush().
+    ///
+    /// @param fd, the file that all output will be written to.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_buffered(FILE* fd);
+
+    /// @brief Create a cmd_output_t instance that writes to a file from its own thread.
+    ///
+    /// each thread formats into its own chunk, which is queued on a lock free
+    /// ring when the output guard is released, after each call made without
+    /// the guard, or on flush().  a writer thread drains the ring to the file
+    /// so commands do not wait on I/O, unless the ring is full under e_block.
+    /// flush() hands output to the writer without waiting for it to be
+    /// written.  destroying the output writes out everything queued, and
+    /// must not race with other threads writing to it.
+    ///
+    /// @param fd, the file that all output will be written to.
+    /// @param policy, what to do when the ring is full.
+    /// @param capacity, number of chunks the ring holds.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_async(FILE* fd, backpressure_t policy = e_block, size_t capacity = 256);
+
+    /// @brief Create a cmd_output_t instance that writes structured output as JSON.
+    ///
+    /// each top level value(), row(), list or error() is written as one JSON
+    /// object per line.  text written with print() and println() is written as
+    /// {"text":"..."} lines.
+    ///
+    /// @param fd, the file that all output will be written to.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_json(FILE* fd);
+
+    /// @brief Create a cmd_output_t instance that writes structured output as binary records.
+    ///
+    /// each record is a one byte kind and a little endian uint32 payload size
+    /// followed by the payload, see cmd_output_binary_t in cmd.cpp for the
+    /// layout of each kind.
+    ///
+    /// @param fd, the file that all output will be written to.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_binary(FILE* fd);
+
+    /// @brief Create a cmd_output_t instance that appends to a caller owned string.
+    ///
+    /// the string is only appended to, so clearing it between uses keeps its
+    /// capacity.  when offsets are given the parser appends the size of the
+    /// string at the start of each command it executes, for a batch one entry
+    /// per line including blank lines, so output i of n is the range
+    /// [offsets[i], offsets[i + 1]) with the size of the string ending the last.
+    /// cmd_executor_t::execute() marks per line as cmd_parser_t does.  output
+    /// delivered later gets an entry of its own when it is written: that of
+    /// a cmd_async_t task, and that of a background job delivering itself.
+    /// job output delivered by 'wait' belongs to the wait command.  without
+    /// locking the guard does nothing, and the output must only be used from
+    /// one thread at a time.
+    ///
+    /// @param text the string that all output is appended to.
+    /// @param offsets optional command output offsets, also appended to.
+    /// @param locking false to turn the output mutex off.
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_buffer(std::string& text, std::vector<size_t>* offsets = nullptr, bool locking = true);
+
+    /// @bried Create a dummy cmd_output_t instance that has no side effects.
+    ///
+    /// @return cmd_output_t instance.
+    static cmd_output_t* create_output_dummy();
+
+    /// @brief indent_t, indent control helper class.
+    ///
+    struct indent_t {
+
+        indent_t(uint32_t* ptr, uint32_t indent)
+            : ptr_(ptr)
+            , restore_(*ptr)
+        {
+            assert(ptr);
+            *ptr += indent;
+        }
+
+        ~indent_t()
+        {
+            assert(ptr_);
+            *ptr_ = restore_;
+        }
+
+        void add(uint32_t num)
+        {
+            assert(ptr_);
+            *ptr_ += num;
+        }
+
+    protected:
+        uint32_t* ptr_;
+        uint32_t restore_;
+    };
+
+    /// @brief guard_t, output mutex helper class.
+    ///
+    struct guard_t {
+        cmd_output_t& out_;
+
+        guard_t() = delete;
+
+        guard_t(cmd_output_t& out)
+            : out_(out)
+        {
+            out.lock();
+        }
+
+        ~guard_t()
+        {
+            out_.unlock();
+        }
+    };
+
+    /// @brief obtain scope guard for the output mutex.
+    ///
+    /// @return scope guard object for the output mutex.
+    guard_t guard()
+    {
+        return guard_t(*this);
+    }
+
+    /// @brief constructor.
+    cmd_output_t()
+        : indent_(2)
+    {
+    }
+
+    /// @brief virtual destructor.
+    virtual ~cmd_output_t() {}
+
+    /// @brief aquire the output mutex.
+    virtual void lock() = 0;
+
+    /// @brief aquire the output mutex if it is free.
+    ///
+    /// the default waits for it, outputs with a mutex should override this.
+    ///
+    /// @return true if the mutex was aquired.
+    virtual bool try_lock()
+    {
+        lock();
+        return true;
+    }
+
+    /// @brief release the output mutex.
+    virtual void unlock() = 0;
+
+    /// @brief push a new indentation level.
+    ///
+    /// @return indent helper class.
+    indent_t indent(uint32_t next = 2)
+    {
+        return indent_t(&indent_, next);
+    }
+
+    /// @brief print a format string into this output stream.
+    ///
+    /// print to output string without appending a new line.
+    ///
+    /// @param INDENT follow indentation marker from output string.
+    /// @param fmt format string.
+    /// @param variable length argument list.
+    template <bool INDENT = true>
+    CMD_PRINTF(2, 3) void print(const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        print(INDENT, fmt, args);
+        va_end(args);
+    }
+
+    /// @brief print a format string into this output stream.
+    ///
+    /// print to output string and append a new line.
+    ///
+    /// @param INDENT follow indentation marker from output string.
+    /// @param fmt format string.
+    /// @param variable length argument list.
+    template <bool INDENT = true>
+    CMD_PRINTF(2, 3) void println(const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        println(INDENT, fmt, args);
+        va_end(args);
+    }
+
+    /// @brief print a compile time checked format string into this output stream.
+    ///
+    /// the line is rendered before the output is called once to write it.
+    ///
+    /// @param INDENT follow indentation marker from output string.
+    /// @param fmt format string made with CMD_FMT(), see cmd_format_t.
+    /// @param args arguments of the format string.
+    template <bool INDENT = true, typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    print(fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        print_format<fmt_t>(INDENT, false, args...);
+    }
+
+    /// @brief print a compile time checked format string and append a new line.
+    ///
+    /// @param INDENT follow indentation marker from output string.
+    /// @param fmt format string made with CMD_FMT(), see cmd_format_t.
+    /// @param args arguments of the format string.
+    template <bool INDENT = true, typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    println(fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        print_format<fmt_t>(INDENT, true, args...);
+    }
+
+    virtual void print(bool indent, const char* fmt, va_list& args) = 0;
+    virtual void println(bool indent, const char* fmt, va_list& args) = 0;
+
+    /// @brief write text that needs no formatting.
+    ///
+    /// outputs override this to copy the text, by default it is printed
+    /// through print() or println().
+    ///
+    /// @param indent follow indentation marker from output string.
+    /// @param text the text, which need not be null terminated.
+    /// @param size length of the text.
+    /// @param eol append a new line.
+    virtual void emit_text(bool indent, const char* text, size_t size, bool eol)
+    {
+        print_v(indent, eol, "%.*s", int(size), text);
+    }
+
+    /// @brief Append an end of line character.
+    virtual void eol() = 0;
+
+    /// @brief Write out any buffered output.
+    virtual void flush() {}
+
+    /// @brief Mark the start of the output of a command.
+    ///
+    /// called by the parser under the output guard before each command or
+    /// batch line it executes, and before output delivered after its command
+    /// returned, see create_output_buffer().
+    virtual void mark() {}
+
+    /// @brief emit a named value.
+    ///
+    /// text outputs print the line fmt and args describe, structured outputs
+    /// write the typed value instead.
+    ///
+    /// @param key name of the value.
+    /// @param val the value.
+    /// @param fmt format string of the text line made with CMD_FMT().
+    /// @param args arguments of the text line.
+    template <typename type_t, typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    value(const char* key, const type_t& val, fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        const cmd_field_t field(key, val);
+        cmd_format_t::buffer_t line;
+        render<fmt_t>(line, args...);
+        emit_value_v(field, "%.*s", int(line.size()), line.data());
+    }
+
+    /// @brief emit a named value with a printf style text line.
+    ///
+    /// the arguments are not checked against fmt, prefer a CMD_FMT() string.
+    template <typename type_t, typename... args_t>
+    void value(const char* key, type_t val, const char* fmt, args_t... args)
+    {
+        static_assert(all_scalar<args_t...>(), "printf arguments must be scalars, use a CMD_FMT() string");
+        const cmd_field_t field(key, val);
+        emit_value_v(field, fmt, args...);
+    }
+
+    /// @brief emit a table row whose fields are also the arguments of its text.
+    ///
+    /// @param name name of the kind of row.
+    /// @param keys names of each field.
+    /// @param fmt format string of the text line made with CMD_FMT().
+    /// @param args the field values, also the arguments of the text line.
+    template <typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    row(const char* name, const char* const (&keys)[sizeof...(args_t)], fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        const auto fields = make_fields(keys, std::index_sequence_for<args_t...>(), args...);
+        cmd_format_t::buffer_t line;
+        render<fmt_t>(line, args...);
+        emit_row_v(name, fields.data(), fields.size(), "%.*s", int(line.size()), line.data());
+    }
+
+    /// @brief emit a table row with a printf style text line.
+    ///
+    /// the arguments are not checked against fmt, prefer a CMD_FMT() string.
+    template <typename... args_t>
+    void row(const char* name, const char* const (&keys)[sizeof...(args_t)], const char* fmt, args_t... args)
+    {
+        static_assert(all_scalar<args_t...>(), "printf arguments must be scalars, use a CMD_FMT() string");
+        const auto fields = make_fields(keys, std::index_sequence_for<args_t...>(), args...);
+        emit_row_v(name, fields.data(), fields.size(), fmt, args...);
+    }
+
+    /// @brief begin a list of values or rows, ended by list_end().
+    ///
+    /// @param name name of the list.
+    /// @param fmt format string of the text heading made with CMD_FMT().
+    /// @param args arguments of the text heading.
+    template <typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    list_begin(const char* name, fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        cmd_format_t::buffer_t line;
+        render<fmt_t>(line, args...);
+        list_begin(name, "%.*s", int(line.size()), line.data());
+    }
+
+    /// @brief begin a list with a printf style text heading.
+    CMD_PRINTF(3, 4) void list_begin(const char* name, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        emit_list_begin(name, fmt, args);
+        va_end(args);
+    }
+
+    /// @brief end the list begun last.
+    void list_end()
+    {
+        emit_list_end();
+    }
+
+    /// @brief emit an error.
+    ///
+    /// @param code the kind of error.
+    /// @param fmt format string of the error message made with CMD_FMT().
+    /// @param args arguments of the error message.
+    template <typename fmt_t, typename... args_t>
+    typename std::enable_if<std::is_base_of<cmd_format_t::string_t, fmt_t>::value>::type
+    error(error_t code, fmt_t fmt, const args_t&... args)
+    {
+        (void)fmt;
+        cmd_format_t::buffer_t line;
+        render<fmt_t>(line, args...);
+        error(code, "%.*s", int(line.size()), line.data());
+    }
+
+    /// @brief emit an error with a printf style message.
+    CMD_PRINTF(3, 4) void error(error_t code, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        emit_error(code, fmt, args);
+        va_end(args);
+    }
+
+    /// @brief structured output hooks, by default printing their text.
+    virtual void emit_value(const cmd_field_t& field, const char* fmt, va_list& args)
+    {
+        (void)field;
+        println(true, fmt, args);
+    }
+
+    virtual void emit_row(const char* name, const cmd_field_t* fields, size_t num, const char* fmt, va_list& args)
+    {
+        (void)name, (void)fields, (void)num;
+        println(true, fmt, args);
+    }
+
+    virtual void emit_list_begin(const char* name, const char* fmt, va_list& args)
+    {
+        (void)name;
+        println(true, fmt, args);
+    }
+
+    virtual void emit_list_end() {}
+
+    virtual void emit_error(error_t code, const char* fmt, va_list& args)
+    {
+        (void)code;
+        println(true, fmt, args);
+    }
+
+protected:
+    template <typename fmt_t, typename... args_t>
+    static void render(cmd_format_t::buffer_t& line, const args_t&... args)
+    {
+        typedef cmd_format_t::compiled_t<fmt_t, args_t...> compiled_t;
+        const cmd_format_t::arg_t argv[] = { cmd_format_t::arg_t(args)..., cmd_format_t::arg_t() };
+        cmd_format_t::render(line, fmt_t::get(), compiled_t::specs.data(), compiled_t::specs.size(), argv);
+    }
+
+    template <typename fmt_t, typename... args_t>
+    void print_format(bool indent, bool eol, const args_t&... args)
+    {
+        cmd_format_t::buffer_t line;
+        render<fmt_t>(line, args...);
+        emit_text(indent, line.data(), line.size(), eol);
+    }
+
+    // true if every type can be passed through '...' as a printf argument
+    template <typename... args_t>
+    static constexpr bool all_scalar()
+    {
+        return (std::is_scalar<args_t>::value && ...);
+    }
+
+    CMD_PRINTF(4, 5) void print_v(bool indent, bool eol, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        eol ? println(indent, fmt, args) : print(indent, fmt, args);
+        va_end(args);
+    }
+
+    template <size_t... ix, typename... args_t>
+    static std::array<cmd_field_t, sizeof...(args_t)> make_fields(
+        const char* const* keys, std::index_sequence<ix...>, const args_t&... args)
+    {
+        return { { cmd_field_t(keys[ix], args)... } };
+    }
+
+    void emit_value_v(const cmd_field_t& field, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        emit_value(field, fmt, args);
+        va_end(args);
+    }
+
+    void emit_row_v(const char* name, const cmd_field_t* fields, size_t num, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        emit_row(name, fields, num, fmt, args);
+        va_end(args);
+    }
+
+    /// @brief Current indentation level.
+    uint32_t indent_;
+};
+
+/// @brief cmd_locale_t, command locale text definitions.
+///
+struct cmd_locale_t {
+
+    static void possible_completions(cmd_output_t& out)
+    {
+        out.println("possible completions:");
+    }
+
+    static void invalid_command(cmd_output_t& out)
+    {
+        out.error(cmd_output_t::e_invalid_command, CMD_FMT("invalid command"));
+    }
+
+    static void no_subcommand(cmd_output_t& out, const char* cmd)
+    {
+        out.error(cmd_output_t::e_no_subcommand, CMD_FMT("no subcommand '{}'"), cmd);
+    }
+
+    static void did_you_meen(cmd_output_t& out)
+    {
+        out.println("did you meen:");
+    }
+
+    static void not_val_or_ident(cmd_output_t& out)
+    {
+        out.error(cmd_output_t::e_not_val_or_ident, CMD_FMT("return type not value or identifier"));
+    }
+
+    static void unknown_ident(cmd_output_t& out, const char* ident)
+    {
+        out.error(cmd_output_t::e_unknown_ident, CMD_FMT("unknown identifier '{}'"), ident);
+    }
+
+    static void malformed_exp(cmd_output_t& out)
+    {
+        out.error(cmd_output_t::e_malformed_exp, CMD_FMT("malformed expression"));
+    }
+
+    static void error(cmd_output_t& out, const char* err)
+    {
+        out.error(cmd_output_t::e_error, CMD_FMT("error: {}"), err);
+    }
+
+    static void usage(cmd_output_t& out, const char* path, const char* args, const char* desc)
+    {
+        out.println(CMD_FMT("usage: {} {}"), path, args);
+        if (desc) {
+            out.println(CMD_FMT("desc:  {}"), desc);
+        }
+    }
+
+    static void subcommands(cmd_output_t& out)
+    {
+        out.println("subcomands:");
+    }
+
+    static void unable_to_find_cmd(cmd_output_t& out, const char* cmd)
+    {
+        out.error(cmd_output_t::e_unable_to_find_cmd, CMD_FMT("unable to find command '{}'"), cmd);
+    }
+
+    static void num_aliases(cmd_output_t& out, uint64_t num)
+    {
+        num ? out.println(CMD_FMT("{} aliases:"), num) : out.println("no alises");
+    }
+
+    static void command_failed(cmd_output_t& out, const char* cmd)
+    {
+        out.error(cmd_output_t::e_command_failed, CMD_FMT("  command failed: '{}'"), cmd);
+    }
+
+    static void unable_to_open(cmd_output_t& out, const char* path)
+    {
+        out.error(cmd_output_t::e_unable_to_open, CMD_FMT("unable to open '{}'"), path);
+    }
+
+    static void script_error(cmd_output_t& out, const char* path, uint64_t line)
+    {
+        out.error(cmd_output_t::e_script_error, CMD_FMT("{}:{}: error"), path, line);
+    }
+
+    static void script_summary(cmd_output_t& out, uint64_t lines, double secs)
+    {
+        const double rate = secs > 0.0 ? double(lines) / secs : 0.0;
+        out.row("script", { "lines", "ms", "rate" }, CMD_FMT("{} lines in {.3} ms ({.0} lines/s)"),
+            lines, secs * 1e3, rate);
+    }
+
+    static void task_done(cmd_output_t& out, uint64_t id, const char* cmd, bool ok)
+    {
+        out.row("task", { "id", "status", "line" }, CMD_FMT("[{}] {}: {}"),
+            id, ok ? "done" : "failed", cmd);
+    }
+
+    static void command_cancelled(cmd_output_t& out, const char* cmd)
+    {
+        out.error(cmd_output_t::e_command_cancelled, CMD_FMT("  command cancelled: '{}'"), cmd);
+    }
+
+    static void command_timeout(cmd_output_t& out, const char* cmd)
+    {
+        out.error(cmd_output_t::e_command_timeout, CMD_FMT("  command timed out: '{}'"), cmd);
+    }
+
+    static void job_status(cmd_output_t& out, uint64_t id, const char* status, const char* line)
+    {
+        out.row("job", { "id", "status", "line" }, CMD_FMT("[{}] {}: {}"), id, status, line);
+    }
+
+    static void no_job(cmd_output_t& out, uint64_t id)
+    {
+        out.error(cmd_output_t::e_no_job, CMD_FMT("no job {}"), id);
+    }
+
+    static void invalid_job(cmd_output_t& out, const char* id)
+    {
+        out.error(cmd_output_t::e_no_job, CMD_FMT("invalid job id '{}'"), id);
+    }
+
+    static void not_concurrent(cmd_output_t& out)
+    {
+        out.error(cmd_output_t::e_not_concurrent, CMD_FMT("background jobs need a concurrent parser"));
+    }
+
+    static void command_stats(cmd_output_t& out, const char* cmd, uint64_t calls, uint64_t failed,
+        double total_ms, double p50_us, double p99_us, double max_us)
+    {
+        out.row("stats", { "cmd", "calls", "failed", "total_ms", "p50_us", "p99_us", "max_us" },
+            CMD_FMT("{}: {} calls, {} failed, {.3} ms total, p50 {.1} us, p99 {.1} us, max {.1} us"),
+            cmd, calls, failed, total_ms, p50_us, p99_us, max_us);
+    }
+
+    static void command_overrun(cmd_output_t& out, const char* cmd, uint64_t ms)
+    {
+        out.error(cmd_output_t::e_command_overrun, CMD_FMT("command overran its deadline: '{}' running for {} ms"),
+            cmd, ms);
+    }
+};
+
+/// @brief cmd_file_map_t, read only view of an entire file.
+///
+/// the file is memory mapped where the platform supports it so that large
+/// scripts can be processed without copying them onto the heap.
+///
+struct cmd_file_map_t {
+
+    /// @brief constructor.
+    cmd_file_map_t()
+        : data_(nullptr)
+        , size_(0)
+        , mapped_(false)
+    {
+    }
+
+    ~cmd_file_map_t()
+    {
+        close();
+    }
+
+    cmd_file_map_t(const cmd_file_map_t&) = delete;
+    cmd_file_map_t& operator=(const cmd_file_map_t&) = delete;
+
+    /// @brief map a file, closing any previously mapped file.
+    ///
+    /// @param path path of the file to map.
+    /// @return true if the file was mapped.
+    bool open(const char* path);
+
+    /// @brief release the mapped file.
+    void close();
+
+    /// @brief return a view of the mapped file contents.
+    std::string_view view() const
+    {
+        return std::string_view(data_, size_);
+    }
+
+protected:
+    const char* data_;
+    size_t size_;
+    /// @brief true if data_ is a mapping rather than a heap copy.
+    bool mapped_;
+};
+
+/// @brief cmd_arena_t, bump allocator for short lived command state.
+///
+/// memory is handed out linearly from a list of blocks and is never freed
+/// individually.  instead the arena is rewound to a previous mark, which makes
+/// the memory available again without returning the blocks to the heap.  once
+/// the blocks have grown to fit the working set no further heap allocations
+/// are made.
+///
+struct cmd_arena_t {
+
+    /// @brief position in the arena that can be rewound to.
+    struct mark_t {
+        size_t block_;
+        size_t used_;
+    };
+
+    /// @brief constructor.
+    ///
+    /// @param block_size size of the first block to be allocated.
+    cmd_arena_t(size_t block_size = 4096)
+        : block_(0)
+        , used_(0)
+        , block_size_(block_size)
+        , allocs_(0)
+    {
+    }
+
+    cmd_arena_t(const cmd_arena_t&) = delete;
+    cmd_arena_t& operator=(const cmd_arena_t&) = delete;
+
+    /// @brief allocate memory from the arena.
+    ///
+    /// @param size number of bytes to allocate.
+    /// @param align required alignment, must be a power of two.
+    /// @return pointer to the allocated memory.
+    void* alloc(size_t size, size_t align);
+
+    /// @brief return the current arena position.
+    mark_t mark() const
+    {
+        return mark_t{ block_, used_ };
+    }
+
+    /// @brief release all memory allocated since a mark was taken.
+    ///
+    /// @param mark previous position returned from mark().
+    void rewind(const mark_t& mark)
+    {
+        assert(mark.block_ < block_ || (mark.block_ == block_ && mark.used_ <= used_));
+        block_ = mark.block_;
+        used_ = mark.used_;
+    }
+
+    /// @brief release all memory allocated from the arena.
+    void reset()
+    {
+        rewind(mark_t{ 0, 0 });
+    }
+
+    /// @brief return the number of blocks allocated from the heap.
+    uint64_t num_allocs() const
+    {
+        return allocs_;
+    }
+
+protected:
+    struct block_t {
+        std::unique_ptr<uint8_t[]> data_;
+        size_t size_;
+    };
+
+    /// @brief memory blocks, retained when the arena is rewound.
+    std::vector<block_t> blocks_;
+    /// @brief index of the current block.
+    size_t block_;
+    /// @brief bytes used in the current block.
+    size_t used_;
+    /// @brief size of the first block.
+    size_t block_size_;
+    /// @brief number of heap allocations made.
+    uint64_t allocs_;
+};
+
+/// @brief cmd_arena_alloc_t, standard allocator adapter for cmd_arena_t.
+///
+/// deallocation is a no-op as memory is reclaimed by rewinding the arena.  an
+/// allocator without an arena falls back to the global heap.
+///
+template <typename type_t>
+struct cmd_arena_alloc_t {
+    typedef type_t value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    cmd_arena_alloc_t(cmd_arena_t* arena = nullptr) noexcept
+        : arena_(arena)
+    {
+    }
+
+    template <typename other_t>
+    cmd_arena_alloc_t(const cmd_arena_alloc_t<other_t>& other) noexcept
+        : arena_(other.arena_)
+    {
+    }
+
+    type_t* allocate(size_t num)
+    {
+        if (arena_) {
+            return static_cast<type_t*>(arena_->alloc(num * sizeof(type_t), alignof(type_t)));
+        }
+        return std::allocator<type_t>().allocate(num);
+    }
+
+    void deallocate(type_t* ptr, size_t num) noexcept
+    {
+        if (!arena_) {
+            std::allocator<type_t>().deallocate(ptr, num);
+        }
+    }
+
+    template <typename other_t>
+    bool operator==(const cmd_arena_alloc_t<other_t>& rhs) const
+    {
+        return arena_ == rhs.arena_;
+    }
+
+    template <typename other_t>
+    bool operator!=(const cmd_arena_alloc_t<other_t>& rhs) const
+    {
+        return arena_ != rhs.arena_;
+    }
+
+    /// @brief arena to allocate from or nullptr for the heap.
+    cmd_arena_t* arena_;
+};
+
+/// @brief cmd_token_t, command arguement token.
+///
+/// User input is processed, it is parsed to form a list of tokens.  These
+/// tokens are encapsulated as a cmd_token_t.  A list of tokens is defined as
+/// the cmd_tokens_t type.  The cmd_token_t type makes it easier to convert
+/// string tokens between multiple data types.
+///
+struct cmd_token_t {
+
+    /// @brief constructor.
+    cmd_token_t()
+        : own_()
+        , view_(own_)
+    {
+    }
+
+    /// @brief cmd_token_t constructor.
+    ///
+    /// the token will hold its own copy of string.
+    ///
+    /// @param string token.
+    cmd_token_t(const std::string& string)
+        : own_(string)
+        , view_(own_)
+    {
+    }
+
+    /// @brief copy constructor.
+    cmd_token_t(const cmd_token_t& rhs)
+    {
+        *this = rhs;
+    }
+
+    /// @brief copy assignment.
+    ///
+    /// tokens that view a cmd_tokens_t line will still view the same line.
+    cmd_token_t& operator=(const cmd_token_t& rhs)
+    {
+        if (rhs.owned()) {
+            own_ = rhs.own_;
+            view_ = own_;
+        } else {
+            own_.clear();
+            view_ = rhs.view_;
+        }
+        return *this;
+    }
+
+    /// @brief return token as a string.
+    ///
+    /// @return view of the underlying token string.
+    std::string_view get() const
+    {
+        return view_;
+    }
+
+    /// @brief get token as an integer.
+    ///
+    /// @param output integer to store the conversion.
+    /// @return true if the token represents an integer.
+    template <typename type_t>
+    bool get(type_t& out) const
+    {
+        bool neg = false;
+        uint64_t value = 0;
+        if (!cmd_util_t::strtoll(c_str(), value, neg)) {
+            return false;
+        }
+        out = static_cast<type_t>(neg ? 0 - value : value);
+        return true;
+    }
+
+    /// @brief test for token equality.
+    ///
+    /// @param rhs token to check equality with.
+    /// @return true if tokens are equal.
+    bool operator==(const cmd_token_t& rhs) const
+    {
+        return view_ == rhs.get();
+    }
+
+    /// @brief test for token equality.
+    ///
+    /// @param rhs token to check equality with.
+    /// @return true if token is equal to rhs.
+    template <typename type_t>
+    bool operator==(const type_t& rhs) const
+    {
+        return view_ == rhs;
+    }
+
+    /// @brief std::string cast operator.
+    ///
+    /// @return token as string.
+    operator std::string() const
+    {
+        return std::string(view_);
+    }
+
+    /// @brief c string cast operator.
+    ///
+    /// @return c string representataion of token.
+    const char* c_str() const
+    {
+        return view_.data();
+    }
+
+protected:
+    friend struct cmd_tokens_t;
+
+    /// @brief construct a token viewing part of a tokenized line.
+    ///
+    /// @param str nul terminated token string owned by a cmd_tokens_t.
+    /// @param size length of the token string.
+    cmd_token_t(const char* str, size_t size)
+        : own_()
+        , view_(str, size)
+    {
+        assert(str[size] == '\0');
+    }
+
+    /// @brief return true if this token holds its own string.
+    bool owned() const
+    {
+        return view_.data() == own_.data();
+    }
+
+    /// @brief token storage when not viewing a tokenized line.
+    std::string own_;
+    /// @brief nul terminated view of the token string.
+    std::string_view view_;
+};
+
+/// @brief cmd_cancel_t, cancellation token with an optional deadline.
+///
+/// passed to cmd_parser_t::execute() and visible to a running command through
+/// cmd_tokens_t::cancelled().  long running commands should poll it and
+/// return early once it is set.  polling is an atomic load, plus a clock read
+/// when a deadline is set.  a token may be cancelled from any thread.
+///
+struct cmd_cancel_t {
+    typedef std::chrono::steady_clock clock_t;
+
+    /// @brief constructor, the token has no deadline.
+    cmd_cancel_t()
+        : cancelled_(false)
+        , deadline_(NO_DEADLINE)
+    {
+    }
+
+    /// @brief constructor, the token expires after a timeout.
+    ///
+    /// @param timeout time from now until the token is cancelled.
+    explicit cmd_cancel_t(std::chrono::milliseconds timeout)
+        : cancelled_(false)
+        , deadline_(NO_DEADLINE)
+    {
+        set_deadline(clock_t::now() + timeout);
+    }
+
+    /// @brief cancel the operations observing this token.
+    void cancel()
+    {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    /// @brief set the time at which the token is cancelled.
+    void set_deadline(clock_t::time_point deadline)
+    {
+        deadline_.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /// @brief return true if the token has a deadline.
+    bool has_deadline() const
+    {
+        return deadline_.load(std::memory_order_relaxed) != NO_DEADLINE;
+    }
+
+    /// @brief return the deadline, clock_t::time_point::max() if none.
+    clock_t::time_point deadline() const
+    {
+        const clock_t::rep rep = deadline_.load(std::memory_order_relaxed);
+        return clock_t::time_point(clock_t::duration(rep));
+    }
+
+    /// @brief check if the token was cancelled or its deadline has passed.
+    ///
+    /// @return true if the operation should stop.
+    bool cancelled() const
+    {
+        if (cancelled_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        const clock_t::rep deadline = deadline_.load(std::memory_order_relaxed);
+        return deadline != NO_DEADLINE && clock_t::now().time_since_epoch().count() >= deadline;
+    }
+
+protected:
+    static constexpr clock_t::rep NO_DEADLINE = clock_t::duration::max().count();
+
+    std::atomic<bool> cancelled_;
+    std::atomic<clock_t::rep> deadline_;
+};
+
+/// @brief cmd_tokens_t, command arguments token list.
+///
+/// cmd_tokens_t keeps a single copy of the tokenized input line and all of its
+/// tokens, flags and pairs are views into that copy.  as such a cmd_tokens_t
+/// can not be copied and any cmd_token_t taken from it must not outlive it.
+/// when given a cmd_arena_t all of its containers are allocated from it.
+///
+struct cmd_tokens_t {
+
+    typedef std::deque<cmd_token_t, cmd_arena_alloc_t<cmd_token_t>> token_list_t;
+    typedef std::set<std::string_view, std::less<>, cmd_arena_alloc_t<std::string_view>> flag_set_t;
+    typedef std::map<std::string_view, cmd_token_t, std::less<>,
+        cmd_arena_alloc_t<std::pair<const std::string_view, cmd_token_t>>>
+        pair_map_t;
+    typedef std::basic_string<char, std::char_traits<char>, cmd_arena_alloc_t<char>> line_t;
+
+    struct flags_t {
+        flags_t(cmd_arena_t* arena)
+            : flags_(cmd_arena_alloc_t<std::string_view>(arena))
+        {
+        }
+
+        /// @brief check if a flag was passed to the token list.
+        ///
+        /// @return true if 'name' flag was passed as an argument.
+        bool get(std::string_view name) const
+        {
+            return !(flags_.find(name) == flags_.end());
+        }
+
+        /// @brief check if the flag set is empty.
+        ///
+        /// @return true if the flags set is empty, otherwise false.
+        bool empty() const
+        {
+            return flags_.empty();
+        }
+
+        /// @brief command token flags.
+        flag_set_t flags_;
+    } flags;
+
+    struct pairs_t {
+        pairs_t(cmd_arena_t* arena)
+            : pairs_(pair_map_t::allocator_type(arena))
+        {
+        }
+
+        /// @brief retreive the argument to a passed token pair.
+        ///
+        /// @return true if the pair was in the token list.
+        bool get(std::string_view name, cmd_token_t& out) const
+        {
+            auto itt = pairs_.find(name);
+            if (itt == pairs_.end()) {
+                return false;
+            } else {
+                return (out = itt->second), true;
+            }
+        }
+
+        /// @brief check if the pairs map is empty.
+        ///
+        /// @return true if the pairs set is empty, otherwise false.
+        bool empty() const
+        {
+            return pairs_.empty();
+        }
+
+        /// @brief key value pair arguments.
+        pair_map_t pairs_;
+    } pairs;
+
+    struct tokens_t {
+        tokens_t(cmd_arena_t* arena)
+            : tokens_(token_list_t::allocator_type(arena))
+            , raw_(token_list_t::allocator_type(arena))
+        {
+        }
+
+        /// @brief return number of tokens in the token list.
+        ///
+        /// @return number of tokens in the token list.
+        size_t size() const
+        {
+            return tokens_.size();
+        }
+
+        /// @brief get the front most token from the token list.
+        ///
+        /// @return true if the front most token could be retrived.
+        bool get(std::string& out)
+        {
+            if (tokens_.empty()) {
+                return false;
+            }
+            out = tokens_.front().get();
+            tokens_.pop_front();
+            return true;
+        }
+
+        /// @brief get the front most token from the token list.
+        ///
+        /// @param output to receive front most token.
+        /// @return true if the front most token could be retrived.
+        bool get(cmd_token_t& out)
+        {
+            if (tokens_.empty()) {
+                return false;
+            }
+            out = tokens_.front();
+            tokens_.pop_front();
+            return true;
+        }
+
+        /// @brief get the front most token from the token list as an integer.
+        ///
+        /// @param output to receive the front most token.
+        /// @return true if the front most token could be interpreted as integer.
+        bool get(uint64_t& out)
+        {
+            if (!tokens_.empty()) {
+                if (front().get(out)) {
+                    tokens_.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// @brief check if the token list is empty.
+        ///
+        /// @return true if the token list is empty.
+        bool empty() const
+        {
+            return tokens_.empty();
+        }
+
+        /// @brief return a reference to the first token in the queue.
+        ///
+        /// @return reference to first token.
+        const cmd_token_t& front() const
+        {
+            return tokens_.front();
+        }
+
+        /// @brief return a reference to the last token in the queue.
+        ///
+        /// @return reference to last token.
+        const cmd_token_t& back() const
+        {
+            return tokens_.back();
+        }
+
+        /// @brief pop front most argument from token list.
+        ///
+        /// @return true if front argument was popped.
+        bool pop()
+        {
+            if (!tokens_.empty()) {
+                assert(!raw_.empty());
+                if (raw_.front() == tokens_.front()) {
+                    // pop prefixed tokens
+                    raw_.pop_front();
+                    tokens_.pop_front();
+                    return true;
+                }
+            }
+            assert(!"FIXME: failed to pop");
+            return false;
+        }
+
+        /// @brief Find a matching token in the token list.
+        ///
+        /// @param in input string to try and locate in the token list.
+        const bool find(const std::string& in) const
+        {
+            for (const cmd_token_t& tok : tokens_) {
+                if (tok == in) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// @brief Accessor for the tokens deque.
+        token_list_t& operator()()
+        {
+            return tokens_;
+        }
+
+        /// @brief basic token arguments.
+        token_list_t tokens_;
+        /// @brief raw tokens.
+        token_list_t raw_;
+    } tokens;
+
+    /// @brief constructor.
+    ///
+    /// @param idents list of identifiers to substitute tokens with.
+    /// @param arena optional arena to allocate all token storage from.
+    cmd_tokens_t(cmd_idents_t* idents, cmd_arena_t* arena = nullptr)
+        : flags(arena)
+        , pairs(arena)
+        , tokens(arena)
+        , state_(nullptr)
+        , cancel_(nullptr)
+        , idents_(idents)
+        , binds_(nullptr)
+        , line_(line_t::allocator_type(arena))
+    {
+    }
+
+    cmd_tokens_t(const cmd_tokens_t&) = delete;
+    cmd_tokens_t& operator=(const cmd_tokens_t&) = delete;
+
+    /// @brief tokenize and input stream into a cmd_tokens_t instance.
+    ///
+    /// @param in input stream to tokenize.
+    /// @param out output cmd_tokens_t instance to populate.
+    /// @return number of tokens parsed.
+    size_t tokenize(const char* in)
+    {
+        assert(in);
+        return tokenize(std::string_view(in), nullptr, 0);
+    }
+
+    /// @brief tokenize an input stream followed by extra arguments.
+    ///
+    /// each extra argument is tokenized as if it followed the input stream
+    /// separated by a space.
+    ///
+    /// @param in input stream to tokenize.
+    /// @param args array of extra argument strings.
+    /// @param num_args number of extra argument strings.
+    /// @return number of tokens parsed.
+    size_t tokenize(std::string_view in, const char* const* args, size_t num_args);
+
+    /// @brief state the command executes in, set before on_execute().
+    struct cmd_state_t* state_;
+
+    /// @brief cancellation token of the execution, set before on_execute().
+    ///
+    /// nullptr when the execution can not be cancelled.  only valid until
+    /// on_execute() returns.
+    cmd_cancel_t* cancel_;
+
+    /// @brief check if the running command has been asked to stop.
+    ///
+    /// @return true if the execution was cancelled or is past its deadline.
+    bool cancelled() const
+    {
+        return cancel_ && cancel_->cancelled();
+    }
+
+    /// @brief set identifiers that take precedence over idents_.
+    ///
+    /// @param binds identifier bindings or nullptr, must be set before
+    ///        calling tokenize.
+    void bind(const cmd_idents_t* binds)
+    {
+        binds_ = binds;
+    }
+
+protected:
+    /// @brief push a new token into this token list.
+    ///
+    /// an empty token will flush any staged flag.
+    ///
+    /// @param str nul terminated token inside line_ to push onto list.
+    /// @param size length of the token.
+    void push(const char* str, size_t size);
+
+    /// @brief list of identifiers that can be substituted for tokens.
+    cmd_idents_t* idents_;
+
+    /// @brief identifier bindings searched before idents_.
+    const cmd_idents_t* binds_;
+
+    /// @brief owned copy of the input line that all tokens view.
+    line_t line_;
+
+    /// @brief staging area for pairs.
+    std::pair<std::string_view, cmd_token_t> stage_pair_;
+};
+
+/// @brief cmd_tokens_pool_t, arena backed cmd_tokens_t storage.
+///
+/// a cmd_parser_t uses this pool so that executing a command does not need to
+/// allocate new token storage each time.  cmd_tokens_t instances and all of
+/// their containers are placed in the pools arena, which is rewound (not
+/// freed) when the instance is released.  leases may be nested but must be
+/// released in reverse order.
+///
+struct cmd_tokens_pool_t {
+
+    /// @brief lease_t, scoped ownership of a pooled cmd_tokens_t.
+    struct lease_t {
+
+        lease_t(cmd_tokens_pool_t& pool, cmd_idents_t* idents)
+            : pool_(pool)
+            , mark_(pool.arena_.mark())
+            , tokens_(new (pool.arena_.alloc(sizeof(cmd_tokens_t), alignof(cmd_tokens_t)))
+                      cmd_tokens_t(idents, &pool.arena_))
+        {
+        }
+
+        lease_t(const lease_t&) = delete;
+        lease_t& operator=(const lease_t&) = delete;
+
+        ~lease_t()
+        {
+            tokens_->~cmd_tokens_t();
+            pool_.arena_.rewind(mark_);
+        }
+
+        cmd_tokens_t& operator*() const
+        {
+            return *tokens_;
+        }
+
+        cmd_tokens_t* operator->() const
+        {
+            return tokens_;
+        }
+
+    protected:
+        cmd_tokens_pool_t& pool_;
+        cmd_arena_t::mark_t mark_;
+        cmd_tokens_t* tokens_;
+    };
+
+    /// @brief obtain a cleared cmd_tokens_t from the pool.
+    ///
+    /// @param idents list of identifiers to substitute tokens with.
+    /// @return lease that returns the tokens to the pool when destroyed.
+    lease_t acquire(cmd_idents_t* idents)
+    {
+        return lease_t(*this, idents);
+    }
+
+    /// @brief return the number of heap allocations made by this pool.
+    ///
+    /// this should stop increasing once the pool has warmed up.
+    uint64_t num_allocs() const
+    {
+        return arena_.num_allocs();
+    }
+
+protected:
+    cmd_arena_t arena_;
+};
+
+/// @brief cmd_path_cache_t, bounded LRU cache of resolved command paths.
+///
+/// maps a sequence of leading tokens, such as "expr eval", to the command
+/// they resolved to, including any alias lookup or prefix abbreviation on
+/// the way.  the cache must be cleared whenever the command tree or aliases
+/// change.
+///
+struct cmd_path_cache_t {
+
+    typedef cmd_tokens_t::token_list_t token_list_t;
+
+    /// @brief constructor.
+    ///
+    /// @param capacity maximum number of paths to remember.
+    cmd_path_cache_t(size_t capacity = 256)
+        : capacity_(capacity)
+        , hits_(0)
+        , misses_(0)
+    {
+    }
+
+    /// @brief find the longest cached path that prefixes a token list.
+    ///
+    /// @param tokens token list to match against.
+    /// @param depth receives the number of tokens the path spans.
+    /// @return the resolved command, otherwise nullptr.
+    struct cmd_t* find(const token_list_t& tokens, size_t& depth);
+
+    /// @brief remember the command that a run of leading tokens resolved to.
+    ///
+    /// @param tokens token list the path was resolved from.
+    /// @param depth number of leading tokens that form the path.
+    /// @param cmd the command the path resolved to.
+    void insert(const token_list_t& tokens, size_t depth, cmd_t* cmd);
+
+    /// @brief forget all cached paths.
+    void clear()
+    {
+        lru_.clear();
+        map_.clear();
+    }
+
+    /// @brief return the number of cached paths.
+    size_t size() const
+    {
+        return lru_.size();
+    }
+
+    /// @brief maximum number of cached paths.
+    size_t capacity_;
+    /// @brief number of path lookups that hit the cache.
+    uint64_t hits_;
+    /// @brief number of path lookups that missed the cache.
+    uint64_t misses_;
+
+protected:
+    struct entry_t {
+        /// @brief hash of the path.
+        uint64_t hash_;
+        /// @brief space separated path tokens.
+        std::string key_;
+        /// @brief the resolved command.
+        cmd_t* cmd_;
+    };
+
+    typedef std::list<entry_t> lru_t;
+
+    /// @brief entries ordered from most to least recently used.
+    lru_t lru_;
+    /// @brief hash index into lru_.
+    std::unordered_map<uint64_t, lru_t::iterator> map_;
+};
+
+/// @brief cmd_fuzzy_index_t, BK-tree of all command and alias names.
+///
+/// used to make "did you mean" suggestions from anywhere in the command tree.
+/// names are indexed as they are registered and the tree lets a search with a
+/// small edit distance skip most of the names.
+///
+struct cmd_fuzzy_index_t {
+
+    /// @brief names must be closer than this to be suggested.
+    static const uint32_t FUZZYNESS = 3;
+
+    /// @brief a name found by a search.
+    struct match_t {
+        /// @brief edit distance from the query.
+        uint32_t distance_;
+        /// @brief the command that was matched.
+        struct cmd_t* cmd_;
+        /// @brief alias name if an alias was matched, otherwise nullptr.
+        const char* alias_;
+        /// @brief registration order used to break ties.
+        uint32_t order_;
+    };
+
+    /// @brief constructor.
+    cmd_fuzzy_index_t()
+        : order_(0)
+    {
+    }
+
+    /// @brief add a name to the index.
+    ///
+    /// @param name command or alias name.
+    /// @param cmd the command this name refers to.
+    /// @param alias true if name is an alias for cmd.
+    void insert(const char* name, cmd_t* cmd, bool alias);
+
+    /// @brief remove an alias by name.
+    void remove_alias(const char* name);
+
+    /// @brief remove all aliases for a command.
+    void remove_alias(const cmd_t* cmd);
+
+    /// @brief find the names closest to a query.
+    ///
+    /// @param query name to search for.
+    /// @param max_distance only names closer than this will match.
+    /// @param max_results maximum number of matches to return.
+    /// @param out receives the matches sorted by distance.
+    /// @return number of matches found.
+    size_t find(const char* query,
+        uint32_t max_distance,
+        size_t max_results,
+        std::vector<match_t>& out) const;
+
+protected:
+    struct entry_t {
+        cmd_t* cmd_;
+        bool alias_;
+        uint32_t order_;
+    };
+
+    struct node_t {
+        /// @brief name held by this node.
+        std::string key_;
+        /// @brief commands and aliases with this name.
+        std::vector<entry_t> entry_;
+        /// @brief children keyed by their distance from key_.
+        std::vector<std::pair<uint32_t, uint32_t>> child_;
+        /// @brief largest child distance, bounding the search distance.
+        uint32_t reach_;
+    };
+
+    /// @brief find the node for an exact name.
+    node_t* find_node(const char* name);
+
+    /// @brief all tree nodes, the root is node 0.
+    std::vector<node_t> node_;
+    /// @brief next registration order.
+    uint32_t order_;
+};
+
+/// @brief cmd_access_t, identifiers a command will read and write.
+///
+/// filled in by cmd_t::on_access() so that cmd_executor_t can order lines
+/// that touch the same identifiers while running the rest in parallel.
+///
+struct cmd_access_t {
+
+    /// @brief constructor.
+    cmd_access_t()
+        : all_(false)
+    {
+    }
+
+    /// @brief reset to an empty access set.
+    void clear()
+    {
+        reads_.clear();
+        writes_.clear();
+        all_ = false;
+    }
+
+    /// @brief identifiers that will be read.
+    std::vector<std::string> reads_;
+    /// @brief identifiers that may be assigned.
+    std::vector<std::string> writes_;
+    /// @brief true if every identifier may be read.
+    bool all_;
+};
+
+/// @brief cmd_prepared_t, a command path resolved ahead of execution.
+///
+/// returned by cmd_parser_t::prepare() and executed any number of times with
+/// cmd_parser_t::execute().  the command is bound when it is prepared, so
+/// later changes to the command tree or aliases do not affect it.
+///
+struct cmd_prepared_t {
+
+    /// @brief constructor.
+    cmd_prepared_t()
+        : cmd_(nullptr)
+    {
+    }
+
+    /// @brief return true if this holds a successfully prepared command.
+    bool valid() const
+    {
+        return cmd_ != nullptr;
+    }
+
+    /// @brief the resolved command.
+    struct cmd_t* cmd_;
+    /// @brief argument template following the command path.
+    std::string args_;
+    /// @brief the expression that was prepared.
+    std::string expr_;
+};
+
+/// @brief cmd_histogram_t, lock free log linear latency histogram.
+///
+/// values are bucketed by their power of two with SUB_BUCKETS linear
+/// divisions in each, so a recorded value is known to within 1/SUB_BUCKETS
+/// of itself, in the manner of an HDR histogram.  values past the largest
+/// bucket are clamped into it.  recording is a relaxed atomic increment and
+/// may race with reading, which then sees a slightly stale distribution.
+///
+struct cmd_histogram_t {
+    static constexpr uint32_t SUB_BITS = 3;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BITS;
+    // 2^40 ns is around 18 minutes
+    static constexpr uint32_t MAX_BITS = 40;
+    static constexpr uint32_t NUM_BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    cmd_histogram_t()
+    {
+        reset();
+    }
+
+    /// @brief record a value.
+    void record(uint64_t value)
+    {
+        buckets_[index(value)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /// @brief return the number of values recorded.
+    uint64_t count() const;
+
+    /// @brief return the largest value recorded.
+    uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief return the value at or below which a fraction of values fall.
+    ///
+    /// @param fraction fraction of recorded values in the range [0, 1].
+    /// @return the highest value equivalent to the bucket, 0 if empty.
+    uint64_t percentile(double fraction) const;
+
+    /// @brief forget all recorded values.
+    void reset();
+
+    /// @brief return the bucket a value is recorded in.
+    static uint32_t index(uint64_t value)
+    {
+        if (value < SUB_BUCKETS) {
+            return uint32_t(value);
+        }
+        // position of the most significant bit
+        uint32_t msb = 0;
+        for (uint32_t shift = 32; shift; shift >>= 1) {
+            if (value >> (msb + shift)) {
+                msb += shift;
+            }
+        }
+        if (msb >= MAX_BITS) {
+            return NUM_BUCKETS - 1;
+        }
+        const uint32_t sub = uint32_t(value >> (msb - SUB_BITS)) - SUB_BUCKETS;
+        return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    /// @brief return the highest value recorded in a bucket.
+    static uint64_t highest(uint32_t index)
+    {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        const uint32_t shift = index / SUB_BUCKETS - 1;
+        const uint64_t sub = index % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+protected:
+    std::array<std::atomic<uint32_t>, NUM_BUCKETS> buckets_;
+    std::atomic<uint64_t> max_;
+};
+
+/// @brief cmd_counters_t, execution statistics of a single command.
+///
+/// updated by cmd_parser_t around each call to cmd_t::on_execute() without
+/// taking any locks, see cmd_parser_t::set_stats().
+///
+struct cmd_counters_t {
+    cmd_counters_t()
+        : calls_(0)
+        , failures_(0)
+        , total_ns_(0)
+    {
+    }
+
+    /// @brief record a completed execution.
+    ///
+    /// @param ns time the execution took in nanoseconds.
+    /// @param ok true if the execution succeeded.
+    void record(uint64_t ns, bool ok)
+    {
+        calls_.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) {
+            failures_.fetch_add(1, std::memory_order_relaxed);
+        }
+        total_ns_.fetch_add(ns, std::memory_order_relaxed);
+        latency_ns_.record(ns);
+    }
+
+    /// @brief forget all recorded executions.
+    void reset()
+    {
+        calls_.store(0, std::memory_order_relaxed);
+        failures_.store(0, std::memory_order_relaxed);
+        total_ns_.store(0, std::memory_order_relaxed);
+        latency_ns_.reset();
+    }
+
+    /// @brief number of executions.
+    std::atomic<uint64_t> calls_;
+    /// @brief number of executions that returned false.
+    std::atomic<uint64_t> failures_;
+    /// @brief total execution time in nanoseconds.
+    std::atomic<uint64_t> total_ns_;
+    /// @brief distribution of execution times in nanoseconds.
+    cmd_histogram_t latency_ns_;
+};
+
+/// @brief cmd_t, the command base class.
+///
+/// this is the base command class that should be extended to handle custom commands.
+/// a cmd_t can be a child of another command or inserted into a cmd_parser_t as a root command.
+/// two key methods can be overriden, on_execute and on_usage which the cmd_parser_t will invoke based on user input.
+///
+struct cmd_t {
+
+    /// @brief command name.
+    const char* const name_;
+
+    /// @brief owning command parser.
+    struct cmd_parser_t& parser_;
+
+    /// @brief opaque user data for this command.
+    cmd_baton_t user_;
+
+    /// @brief the parent if this is a child command.
+    cmd_t* parent_;
+
+    /// @brief list of child commands.
+    cmd_list_t sub_;
+
+    /// @brief command argument string.
+    const char* usage_;
+
+    /// @brief command description string.
+    const char* desc_;
+
+    /// @brief true if on_execute() may run on several threads at once.
+    ///
+    /// such a command must only read shared parser state and write to the
+    /// output stream it is given.  cmd_executor_t runs these in parallel.
+    /// see also on_access().
+    bool concurrent_;
+
+    /// @brief execution statistics, see cmd_parser_t::set_stats().
+    cmd_counters_t stats_;
+
+    /// @brief cmd_t constructor.
     ///
     /// @param const char* name, the name of this command.
     /// @param cmd_t* parent, the parent cmd_t instance.
@@ -594,264 +2559,1501 @@ struct cmd_t {
         , sub_()
         , usage_(nullptr)
         , desc_(nullptr)
+        , concurrent_(false)
+    {
+    }
+
+    virtual ~cmd_t() {}
+
+    /// @brief Add child command to this command.
+    ///
+    /// instanciate and attach a new child command to this parent command
+    /// supplying this commands user_ data during its construction.
+    ///
+    /// @return the new cmd_t instance.
+    template <typename type_t>
+    type_t* add_sub_command()
+    {
+        return add_sub_command<type_t>(user_);
+    }
+
+    /// @brief Add child command to this command.
+    ///
+    /// instanciate and attach a new child command to this parent command.
+    ///
+    /// @param user opaque user data to pass to the new child cmd_t.
+    /// @return the new cmd_t instance.
+    template <typename type_t>
+    type_t* add_sub_command(cmd_baton_t user)
+    {
+        auto temp = std::unique_ptr<type_t>(new type_t(parser_, this, user));
+        sub_.push_back(std::move(temp));
+        sub_command_added(sub_.rbegin()->get());
+        return (type_t*)sub_.rbegin()->get();
+    }
+
+    /// @brief Add a fixed set of child commands to this command.
+    ///
+    /// the children are instanciated as with add_sub_command() and their
+    /// names are also indexed by a dispatch table built at compile time.
+    /// this can only be done once per command.
+    ///
+    /// @param types_t classes derived from cmd_t with a constexpr NAME.
+    template <typename... types_t>
+    void add_sub_commands()
+    {
+        const size_t base = sub_.size();
+        (add_sub_command<types_t>(), ...);
+        sub_.set_static(cmd_static_table_t<types_t...>::index(), base);
+    }
+
+    /// @brief Command execution handler.
+    ///
+    /// Virtual function that will be called when the user specifies is full path or an alias to this command.
+    /// If this command is ternimal then any following input tokens will be passed to this handler.
+    /// The caller provided output stream is also passed to the called command execution handler.
+    ///
+    /// @param tok token list of arguments supplied by the user.
+    /// @param out text output stream for writing results to.
+    /// @param user user data passed to the command from cmd_parser_t::execute().
+    /// @return true if the command executed successfully.
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user);
+
+    /// @brief Asynchronous command execution handler, see cmd_async_t.
+    ///
+    /// a command that waits on I/O can return a future that completes later
+    /// rather than blocking the caller.  the tokens are only valid until
+    /// this returns so any arguments must be copied, while the output
+    /// stream remains valid until the future completes.  by default this
+    /// calls on_execute() and returns a completed future.
+    ///
+    /// @param tok token list of arguments supplied by the user.
+    /// @param out text output stream for writing results to.
+    /// @param user user data passed to the command.
+    /// @return future holding true if the command executed successfully.
+    virtual std::future<bool> on_execute_async(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user)
+    {
+        std::promise<bool> done;
+        done.set_value(on_execute(tok, out, user));
+        return done.get_future();
+    }
+
+    /// @brief Describe the identifiers an execution will access.
+    ///
+    /// returning true declares that on_execute() may run concurrently with
+    /// any command it does not conflict with, given that it touches no
+    /// identifiers other than those listed (and any $ident arguments).
+    /// written identifiers must only be assigned if execution succeeds.
+    ///
+    /// @param tok token list of arguments that will be executed.
+    /// @param access receives the accessed identifiers.
+    /// @return true if the command can be scheduled concurrently.
+    virtual bool on_access(const cmd_tokens_t& tok, cmd_access_t& access) const
+    {
+        (void)tok;
+        (void)access;
+        return concurrent_;
+    }
+
+    /// @brief Return string with hierarchy of parent commands.
+    ///
+    /// @param out the string to store output hierarchy.
+    void get_command_path(std::string& out) const
+    {
+        if (parent_) {
+            parent_->get_command_path(out);
+            out.append(" ");
+        }
+        out.append(name_);
+    }
+
+    /// @brief Print command usage information to output stream.
+    ///
+    /// @param out output stream to print to
+    /// @return true if usage was written successfully
+    virtual bool on_usage(cmd_output_t& out, cmd_baton_t user) const
+    {
+        (void)user;
+        cmd_output_t::indent_t indent = out.indent(2);
+        std::string path;
+        get_command_path(path);
+        cmd_locale_t::usage(out, path.c_str(), usage_, desc_);
+        if (!sub_.empty()) {
+            cmd_locale_t::subcommands(out);
+            print_sub_commands(out);
+        }
+        return true;
+    }
+
+    /// @brief Get the state this command is executing in.
+    ///
+    /// this is the executing cmd_session_t, otherwise the parser.
+    ///
+    /// @param tok the tokens passed to on_execute().
+    /// @return the state for history, aliases and identifiers.
+    struct cmd_state_t& state(const cmd_tokens_t& tok) const;
+
+protected:
+    /// @brief Notify the parser that a child command has been added.
+    ///
+    /// @param cmd the new child command.
+    void sub_command_added(cmd_t* cmd);
+
+    /// @brief Add an alias for this command.
+    ///
+    /// bind a cmt_t instance to a single string token known as an alias.
+    /// during command interpretation if the first token matches any alises then the associated cmd_t instance will be executed.
+    ///
+    /// @param name the string name of the alias to add.
+    /// @return true if the alias was associated successfully.
+    bool alias_add(const std::string& name);
+
+    /// @brief Report an error condition to the output stream.
+    ///
+    /// @param out output stream.
+    /// @param fmt input format string.
+    /// @param ... variable args.
+    /// @return false so it can be propagated via return statements easily.
+    CMD_PRINTF(3, 4) bool error(cmd_output_t& out, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        out.println(true, fmt, args);
+        va_end(args);
+        return false;
+    }
+
+    /// @brief Print a list of command names to an output stream.
+    ///
+    /// @param list input command list.
+    /// @param out output stream to write command names to.
+    void print_cmd_list(const cmd_list_t& list, cmd_output_t& out) const
+    {
+        cmd_output_t::indent_t indent = out.indent(2);
+        for (const auto& cmd : list) {
+            out.println(CMD_FMT("{}"), cmd->name_);
+        }
+    }
+
+    /// @brief Print a list of child commands to the output stream.
+    ///
+    /// @param out output stream to write command names to.
+    void print_sub_commands(cmd_output_t& out) const
+    {
+        print_cmd_list(sub_, out);
+    }
+};
+
+/// @brief cmd_epoch_t, epoch based reclamation of shared objects.
+///
+/// readers enter a read section before loading a shared pointer and exit it
+/// once they are done with the object.  writers publish a replacement and
+/// retire the old object, which is only freed once every read section that
+/// could have loaded it has exited.  readers never block or write to memory
+/// shared with other readers beyond their own slot.
+///
+struct cmd_epoch_t {
+
+    /// @brief maximum number of concurrent read sections.
+    ///
+    /// read sections entered while every slot is taken share one overflow
+    /// section, which holds back reclaim() until the last of them exits.
+    static const size_t MAX_READERS = 64;
+
+    /// @brief slot returned by enter() when every slot is taken.
+    static const size_t OVERFLOW_SLOT = MAX_READERS;
+
+    cmd_epoch_t();
+
+    /// @brief frees all retired objects.
+    ///
+    /// no read sections may be active.
+    ~cmd_epoch_t();
+
+    /// @brief enter a read section.
+    ///
+    /// never waits, a thread may hold several read sections at once.
+    ///
+    /// @return the slot that must be passed to exit(), OVERFLOW_SLOT if
+    /// every slot was taken.
+    size_t enter();
+
+    /// @brief exit a read section.
+    ///
+    /// @param slot slot returned from enter().
+    void exit(size_t slot)
+    {
+        if (slot == OVERFLOW_SLOT) {
+            overflow_.fetch_sub(1, std::memory_order_release);
+        } else {
+            slots_[slot].store(0, std::memory_order_release);
+        }
+    }
+
+    /// @brief retire an object that has been unpublished.
+    ///
+    /// @param ptr object to free once no reader can reference it.
+    template <typename type_t>
+    void retire(const type_t* ptr)
+    {
+        retire(const_cast<type_t*>(ptr),
+            [](void* obj) { delete static_cast<type_t*>(obj); });
+    }
+
+    /// @brief retire an object that has been unpublished.
+    ///
+    /// @param ptr object to free once no reader can reference it.
+    /// @param free function used to free the object.
+    void retire(void* ptr, void (*free)(void*));
+
+    /// @brief free any retired objects no longer visible to readers.
+    ///
+    /// @return the number of objects freed.
+    size_t reclaim();
+
+    /// @brief number of objects waiting to be freed.
+    size_t num_retired() const;
+
+protected:
+    struct retired_t {
+        uint64_t epoch_;
+        void* ptr_;
+        void (*free_)(void*);
+    };
+
+    /// @brief global epoch, advanced each time an object is retired.
+    std::atomic<uint64_t> epoch_;
+
+    /// @brief epoch each read section was entered at, 0 if the slot is free.
+    std::array<std::atomic<uint64_t>, MAX_READERS> slots_;
+
+    /// @brief number of read sections entered without a slot of their own.
+    std::atomic<uint64_t> overflow_;
+
+    /// @brief guards retired_.
+    mutable std::mutex mux_;
+
+    std::vector<retired_t> retired_;
+};
+
+/// @brief cmd_state_t, execution state belonging to one user.
+///
+/// holds the history, aliases and identifiers that commands read and write.
+/// a cmd_parser_t is the default state, while each cmd_session_t carries its
+/// own and shares the parsers command tree.  commands reach the state they
+/// are executing in through cmd_t::state().
+///
+struct cmd_state_t {
+
+    /// @brief optional limits on the memory held by a state, 0 for none.
+    struct quota_t {
+        /// @brief bytes of history kept, the oldest entries are dropped.
+        size_t history_;
+        /// @brief maximum number of identifiers.
+        size_t idents_;
+        /// @brief maximum number of aliases.
+        size_t aliases_;
+    };
+
+    /// @brief user input history.
+    std::vector<std::string> history_;
+
+    /// @brief map of alias names to command instances.
+    std::map<std::string, cmd_t*, std::less<>> alias_;
+
+    /// @brief expression identifier list.
+    cmd_idents_t idents_;
+
+    /// @brief guards history_ when locked_.
+    std::mutex history_mux_;
+
+    /// @brief guards idents_.
+    ///
+    /// commands assigning identifiers hold it exclusively.  arguments are
+    /// substituted under a shared lock when locked_.
+    std::shared_mutex idents_mux_;
+
+    /// @brief memory limits.
+    quota_t quota_;
+
+    /// @brief constructor.
+    ///
+    /// @param quota memory limits of this state.
+    cmd_state_t(const quota_t& quota = quota_t{ 0, 0, 0 })
+        : quota_(quota)
+        , locked_(false)
+        , history_bytes_(0)
+    {
+    }
+
+    virtual ~cmd_state_t() {}
+
+    /// @brief Add an alias for a cmd_t instance.
+    ///
+    /// @param cmd command instance for which to make an alias.
+    /// @param alias name for the alias.
+    /// @return true if that alias was added, false if over the quota.
+    virtual bool alias_add(cmd_t* cmd, const std::string& alias);
+
+    /// @brief Remove a previously registered alias by name.
+    ///
+    /// @param alias the string command alias to remove.
+    /// @return true if the alias was removed.
+    virtual bool alias_remove(const std::string& alias);
+
+    /// @brief Find a cmd_t instance given its alias name.
+    ///
+    /// @param alias the string alias to search for an associated cmd_t instance.
+    /// @return cmd_t instance linked to this alias otherwise nullptr.
+    cmd_t* alias_find(std::string_view alias) const
+    {
+        auto itt = alias_.find(alias);
+        return itt == alias_.end() ? nullptr : itt->second;
+    }
+
+    /// @brief Get a string with the last user input to be executed.
+    ///
+    /// @return reference to the last
+    const std::string& last_cmd()
+    {
+        if (history_.empty()) {
+            history_.push_back("hello");
+        }
+        return history_.back();
+    }
+
+    /// @brief Append an expression to the history.
+    ///
+    /// beyond the history quota the oldest entries are dropped.
+    ///
+    /// @param expr the expression to record.
+    void history_push(std::string_view expr);
+
+    /// @brief Check the identifier quota before adding an identifier.
+    ///
+    /// idents_mux_ must be held.
+    ///
+    /// @param name identifier that would be assigned.
+    /// @return true if the identifier exists or there is room for it.
+    bool ident_room(std::string_view name) const
+    {
+        return quota_.idents_ == 0 || idents_.size() < quota_.idents_ ||
+            idents_.find(name) != idents_.end();
+    }
+
+    /// @brief Approximate number of bytes held by this state.
+    size_t memory_usage() const;
+
+protected:
+    friend struct cmd_parser_t;
+
+    /// @brief true if the state is used by several threads at once.
+    bool locked_;
+
+    /// @brief bytes of history counted towards the quota.
+    size_t history_bytes_;
+};
+
+/// @brief cmd_tree_t, immutable snapshot of the root commands and aliases.
+///
+/// when a parser executes concurrently, readers resolve commands against
+/// the current snapshot while writers build and publish a new one.  the
+/// commands themselves are owned by the parser and are not copied.
+///
+struct cmd_tree_t {
+
+    cmd_tree_t()
+        : static_{ nullptr, 0 }
+        , static_base_(0)
+        , version_(0)
     {
     }
 
-    /// @brief Add child command to this command.
+    /// @brief find the root commands that best match a name or prefix.
     ///
-    /// instanciate and attach a new child command to this parent command
-    /// supplying this commands user_ data during its construction.
+    /// @param sub name or prefix to match.
+    /// @param out vector to append the matching commands to.
+    /// @return true if any commands matched.
+    bool find(std::string_view sub, std::vector<cmd_t*>& out) const;
+
+    /// @brief find a root command with an exact name.
     ///
-    /// @return the new cmd_t instance.
-    template <typename type_t>
-    type_t* add_sub_command()
+    /// @param name command name to find.
+    /// @return the first command added with this name, otherwise nullptr.
+    cmd_t* find_exact(std::string_view name) const;
+
+    /// @brief find a cmd_t instance given its alias name.
+    ///
+    /// @param alias the string alias to search for.
+    /// @return cmd_t instance linked to this alias otherwise nullptr.
+    cmd_t* alias_find(std::string_view alias) const
     {
-        return add_sub_command<type_t>(user_);
+        auto itt = alias_.find(alias);
+        return itt == alias_.end() ? nullptr : itt->second;
     }
 
-    /// @brief Add child command to this command.
+    /// @brief root commands in the order they were added.
+    std::vector<cmd_t*> roots_;
+
+    /// @brief index of root command names into roots_.
+    cmd_trie_t trie_;
+
+    /// @brief static index of a run of roots_.
+    cmd_static_index_t static_;
+
+    /// @brief position of the first static command in roots_.
+    size_t static_base_;
+
+    /// @brief map of alias names to command instances.
+    std::map<std::string, cmd_t*, std::less<>> alias_;
+
+    /// @brief index of all command and alias names for suggestions.
+    cmd_fuzzy_index_t fuzzy_index_;
+
+    /// @brief incremented for each published snapshot.
+    uint64_t version_;
+};
+
+/// @brief cmd_parser_t, the command parser.
+///
+/// this type is the main workhorse of the command library.  it forms the root of the command hieararchy
+/// it stores some state that can be accessed via all commands (alias_, idents_)
+/// cmd_parser_t is responsible for parsing and dispatching user input to the appropriate command
+///
+struct cmd_parser_t : public cmd_state_t {
+
+    /// @brief global user data passed to new subcommands unless overridden.
+    void* user_;
+
+    /// @brief the parent cmd_parser_t to fall back to for unknown commands.
     ///
-    /// instanciate and attach a new child command to this parent command.
+    /// a hierarchy of commands can make it easier to have context sensitive
+    /// commands in a application.
+    cmd_parser_t * parent_;
+
+    /// @brief root subcommand list.
+    cmd_list_t sub_;
+
+    /// @brief reusable storage for tokenized commands.
+    cmd_tokens_pool_t tokens_pool_;
+
+    /// @brief cache of resolved command paths.
+    cmd_path_cache_t path_cache_;
+
+    /// @brief index of all command and alias names for suggestions.
+    cmd_fuzzy_index_t fuzzy_index_;
+
+    /// @brief cmd_parser_t constructor.
     ///
-    /// @param user opaque user data to pass to the new child cmd_t.
-    /// @return the new cmd_t instance.
+    /// @param user opaque user data pointer passed from parent to child.
+    /// @return user a global custom data pointer to be passed to any sub commands.
+    cmd_parser_t(cmd_baton_t user = nullptr);
+
+    ~cmd_parser_t();
+
+    /// @brief Allow commands to be executed from several threads at once.
+    ///
+    /// from then on each execution resolves commands against an immutable
+    /// snapshot of the root commands and aliases, using its own token pool
+    /// and path cache, without taking any locks.  adding commands or
+    /// aliases publishes a new snapshot, and old snapshots are freed once
+    /// no execution can still be using them.
+    ///
+    /// sub commands must be added before their parent is added to the
+    /// parser, and the parser must outlive any executing threads.  this
+    /// cannot be undone.
+    ///
+    /// up to cmd_epoch_t::MAX_READERS executions, nested ones included,
+    /// get a token pool and path cache that outlive them.  executions
+    /// beyond that still run but use a private pool and cache, and delay
+    /// freeing old snapshots until they complete.
+    void set_concurrent();
+
+    /// @brief true if set_concurrent() has been called.
+    bool concurrent() const
+    {
+        return shared_ != nullptr;
+    }
+
+    /// @brief background jobs started by lines ending in '&'.
+    struct cmd_job_table_t& jobs()
+    {
+        return *jobs_;
+    }
+
+    /// @brief Lock out changes to the command tree and aliases.
+    ///
+    /// commands inspecting sub_ or alias_ directly should hold this lock.
+    /// it is only taken once the parser is concurrent.
+    ///
+    /// @return the lock, which may be recursively reaquired.
+    std::unique_lock<std::recursive_mutex> write_lock()
+    {
+        return shared_ ? std::unique_lock<std::recursive_mutex>(write_mux_)
+                       : std::unique_lock<std::recursive_mutex>();
+    }
+
+    /// @brief Add a new root command to the command parser.
+    ///
+    /// add a new root command to the command interpreter.
+    /// the new subcommand instance will be passed the global cmd_parser_t user_ data
+    ///
+    /// @param type_t class derived from cmd_t base.
+    /// @return instance of the newly created command.
     template <typename type_t>
-    type_t* add_sub_command(cmd_baton_t user)
+    type_t* add_command()
     {
-        auto temp = std::unique_ptr<type_t>(new type_t(parser_, this, user));
+        return add_command<type_t>(user_);
+    }
+
+    /// @brief Add a new root command to the command parser.
+    ///
+    /// @param user the user data type to pass to the sub command.
+    /// @return instance of the newly created command.
+    template <typename type_t>
+    type_t* add_command(cmd_baton_t user)
+    {
+        const auto lock = write_lock();
+        cmd_t* parent = nullptr;
+        // publish once the command is fully constructed
+        ++publish_defer_;
+        std::unique_ptr<type_t> temp(new type_t(*this, parent, user));
+        --publish_defer_;
         sub_.push_back(std::move(temp));
+        command_added(sub_.rbegin()->get());
         return (type_t*)sub_.rbegin()->get();
     }
 
-    /// @brief Command execution handler.
+    /// @brief Add a fixed set of root commands to the command parser.
+    ///
+    /// the commands are instanciated as with add_command() and their names
+    /// are also indexed by a dispatch table built at compile time, so that
+    /// resolving them by name needs no allocation or trie walk.  commands
+    /// can still be added dynamically afterwards.  this can only be done
+    /// once per parser.
+    ///
+    /// @param types_t classes derived from cmd_t with a constexpr NAME.
+    template <typename... types_t>
+    void add_commands()
+    {
+        const auto lock = write_lock();
+        const size_t base = sub_.size();
+        (add_command<types_t>(), ...);
+        sub_.set_static(cmd_static_table_t<types_t...>::index(), base);
+        publish();
+    }
+
+    /// @brief Add a new root command to the command parser.
+    ///
+    /// Note: the command parameter will be moved so that ownership is
+    /// transfered to the command parser.  command should not be accessed
+    /// after calling this function and instead, the return instance should
+    /// be used in its place.
+    ///
+    /// @param command a command instance to add to the parser
+    /// @return the new command instance after moving the parameter
+    cmd_t* add_command(cmd_t*& command)
+    {
+        const auto lock = write_lock();
+        std::unique_ptr<cmd_t> temp(std::move(command));
+        sub_.push_back(std::move(temp));
+        command = nullptr;
+        command_added(sub_.rbegin()->get());
+        return sub_.rbegin()->get();
+    }
+
+    /// @brief Execute expressions, calling the relevant cmd_t instances with arguments.
+    ///
+    /// a line ending in '&' is started as a background job, see jobs(),
+    /// which fails unless set_concurrent() has been called.
+    ///
+    /// @param a list of ';' delimited expression strings to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if the command executed successfully.
+    bool execute(
+        const std::string& expr,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Execute a line of ';' delimited expressions.
+    ///
+    /// unlike execute() the output guard is not taken, it must already be
+    /// held by the caller.  this lets a running command execute further
+    /// lines, e.g. when sourcing a script.
+    ///
+    /// @param line expressions to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param state optional state to execute in, the parser by default.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if all of the commands executed successfully.
+    bool execute_line(
+        std::string_view line,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        cmd_state_t* state = nullptr,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Execute a batch of lines under a single output guard.
+    ///
+    /// each line may hold ';' delimited expressions as with execute().
+    /// blank lines are skipped and always succeed.  execution continues
+    /// past failing lines and the output is flushed once at the end.  once
+    /// cancelled the remaining lines are not executed and fail.
+    ///
+    /// @param lines array of lines to execute.
+    /// @param num_lines number of lines in the array.
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param status optional per line status, true if the line succeeded.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if every line executed successfully.
+    bool execute_batch(
+        const std::string_view* lines,
+        size_t num_lines,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        std::vector<bool>* status = nullptr,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Execute a batch of new line delimited lines.
+    ///
+    /// @param buffer buffer of '\n' delimited lines to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param status optional per line status, true if the line succeeded.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if every line executed successfully.
+    bool execute_batch(
+        std::string_view buffer,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        std::vector<bool>* status = nullptr,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Prepare a single command expression for repeated execution.
+    ///
+    /// tokenizes the expression, resolves any alias and walks the command
+    /// tree once.  identifiers in the arguments are not substituted until
+    /// the prepared command is executed.
+    ///
+    /// @param expr command expression to prepare.
+    /// @param prepared receives the prepared command.
+    /// @param output output stream for reporting resolution errors.
+    /// @return true if the command was resolved.
+    bool prepare(
+        std::string_view expr,
+        cmd_prepared_t& prepared,
+        cmd_output_t* output);
+
+    /// @brief Execute a prepared command.
+    ///
+    /// the arguments are the prepared argument template followed by any
+    /// extra arguments.  the command is not added to the history.
+    ///
+    /// @param prepared command returned from prepare().
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param binds optional identifiers that take precedence over idents_.
+    /// @param args optional array of extra positional arguments.
+    /// @param num_args number of extra positional arguments.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if the command executed successfully.
+    bool execute(
+        const cmd_prepared_t& prepared,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        const cmd_idents_t* binds = nullptr,
+        const char* const* args = nullptr,
+        size_t num_args = 0,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Add a new parser alias for a cmd_t instance.
+    ///
+    /// @param cmd command instance for which to make an alias.
+    /// @param alias name for the alias.
+    /// @return true if that alias was added.
+    bool alias_add(cmd_t* cmd, const std::string& alias) override;
+
+    /// @brief Remove a previously registered command alias byt name.
+    ///
+    /// @param alias the string command alias to remove.
+    /// @return true if the alias was removed.
+    bool alias_remove(const std::string& alias) override;
+
+    /// @brief Remove any previously registered command alises by target cmd_t.
+    ///
+    /// @param cmd the cmd_t instance to remove any alises to.
+    /// @return true if the alias was removed.
+    bool alias_remove(const cmd_t* cmd);
+
+    /// @brief Notify the parser that a command has been added to the tree.
+    ///
+    /// @param cmd the newly added command.
+    void command_added(cmd_t* cmd);
+
+    /// @brief Print "did you mean" suggestions for an unknown name.
+    ///
+    /// searches all command and alias names in the tree.
+    ///
+    /// @param name the unknown name entered by the user.
+    /// @param out output stream to print the suggestions to.
+    /// @return true if any suggestions were printed.
+    bool suggest(const char* name, cmd_output_t& out) const;
+
+    /// @brief Record execution statistics of every command, see cmd_t::stats_.
+    ///
+    /// enabled by default.  each execution then reads the clock twice.
+    /// commands that complete later through cmd_async_t are not recorded.
+    /// may be called while other threads are executing commands.
+    ///
+    /// @param enable true to record statistics.
+    void set_stats(bool enable)
+    {
+        record_stats_.store(enable, std::memory_order_relaxed);
+    }
+
+    /// @brief Record spans of every execution, see cmd_tracer_t.
+    ///
+    /// may be changed while executing, executions in flight finish their
+    /// spans with the tracer they started with.
+    ///
+    /// @param tracer tracer to record with, or nullptr.
+    void set_tracer(struct cmd_tracer_t* tracer)
+    {
+        tracer_.store(tracer, std::memory_order_release);
+    }
+
+    /// @brief return the current tracer, if any.
+    struct cmd_tracer_t* tracer() const
+    {
+        return tracer_.load(std::memory_order_acquire);
+    }
+
+    /// @brief Report executions that overrun through a watchdog.
+    ///
+    /// every command executed while set is watched for the duration of
+    /// on_execute(), or until the result of on_execute_async() is ready when
+    /// run through cmd_async_t.  must be set before executing from several
+    /// threads.
+    ///
+    /// @param watchdog watchdog to register executions with, or nullptr.
+    void set_watchdog(struct cmd_watchdog_t* watchdog)
+    {
+        watchdog_ = watchdog;
+    }
+
+protected:
+    friend struct cmd_executor_t;
+    friend struct cmd_session_t;
+    friend struct cmd_async_t;
+
+    /// @brief per execution view of the parser, see set_concurrent().
+    struct reader_t;
+
+    /// @brief state shared by concurrent executions.
+    struct shared_t;
+
+    std::unique_ptr<shared_t> shared_;
+
+    /// @brief watchdog executions are registered with, see set_watchdog().
+    struct cmd_watchdog_t* watchdog_;
+
+    /// @brief true if execution statistics are recorded, see set_stats().
+    std::atomic<bool> record_stats_;
+
+    /// @brief tracer executions record spans with, see set_tracer().
+    std::atomic<struct cmd_tracer_t*> tracer_;
+
+    /// @brief background jobs, destroyed before the rest of the parser.
+    std::unique_ptr<struct cmd_job_table_t> jobs_;
+
+    /// @brief serializes changes to sub_ and alias_ once concurrent.
+    std::recursive_mutex write_mux_;
+
+    /// @brief nonzero while publishing is deferred, guarded by write_mux_.
+    uint32_t publish_defer_;
+
+    /// @brief Publish a new snapshot of the command tree if concurrent.
+    ///
+    /// write_mux_ must be held.
+    void publish();
+
+    /// @brief Prepare a command expression using a readers view.
+    bool prepare_imp(
+        reader_t& reader,
+        std::string_view expr,
+        cmd_prepared_t& prepared,
+        cmd_output_t* output);
+
+    /// @brief Execute a batch of lines, the output guard must be held.
+    bool execute_lines(
+        reader_t& reader,
+        const std::string_view* lines,
+        size_t num_lines,
+        cmd_output_t& output,
+        cmd_baton_t user,
+        std::vector<bool>* status);
+
+    /// @brief Execute a line of ';' delimited expressions.
+    bool execute_line(
+        reader_t& reader,
+        std::string_view line,
+        cmd_output_t* output,
+        cmd_baton_t user);
+
+    /// @brief Execute a prepared command using a given token pool.
+    ///
+    /// the output guard must already be held by the caller.
+    ///
+    /// @return true if the command executed successfully.
+    bool execute_prepared(
+        const cmd_prepared_t& prepared,
+        cmd_tokens_pool_t& pool,
+        cmd_state_t& state,
+        cmd_output_t& output,
+        cmd_baton_t user,
+        const cmd_idents_t* binds,
+        const char* const* args,
+        size_t num_args,
+        cmd_cancel_t* cancel);
+
+    /// @brief Resolve the command path at the front of a token list.
+    ///
+    /// the path tokens are removed from the token list leaving only the
+    /// arguments.  resolution errors are reported to the output stream.
+    ///
+    /// @param reader the executions view of the command tree.
+    /// @param tokens token list to resolve.
+    /// @param out output stream for error messages.
+    /// @return the resolved command, otherwise nullptr.
+    cmd_t* resolve(reader_t& reader, cmd_tokens_t& tokens, cmd_output_t& out);
+
+    /// @brief Execute a command expression, calling the relevant cmd_t instance with arguments.
+    ///
+    /// @param reader the executions view of the command tree.
+    /// @param expression string to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param async if set, receives the result of on_execute_async().  when
+    ///        the command is still running on return, the watch is handed
+    ///        to the caller through reader_t::watch_ to unwatch once the
+    ///        result is ready, which needs the reader to have a token.
+    /// @return true if the command executed successfully, or was started.
+    bool execute_imp(
+        reader_t& reader,
+        std::string_view expr,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        std::future<bool>* async = nullptr);
+};
+
+/// @brief cmd_session_t, a users execution context on a shared parser.
+///
+/// a session keeps its own history, aliases and identifiers, optionally
+/// within a quota, and executes against the command tree of a parser
+/// without copying it.  session aliases take precedence over parser
+/// aliases.  a session must only be used by one thread at a time, but
+/// sessions of a concurrent parser may execute on different threads.
+///
+struct cmd_session_t : public cmd_state_t {
+
+    /// @brief the parser owning the command tree.
+    cmd_parser_t& parser_;
+
+    /// @brief constructor.
+    ///
+    /// @param parser parser whose commands the session executes.
+    /// @param quota memory limits of this session.
+    cmd_session_t(cmd_parser_t& parser, const quota_t& quota = quota_t{ 0, 0, 0 })
+        : cmd_state_t(quota)
+        , parser_(parser)
+    {
+    }
+
+    /// @brief Execute ';' delimited expressions in this session.
+    ///
+    /// @param expr expressions to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if the command executed successfully.
+    bool execute(
+        const std::string& expr,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Execute a batch of new line delimited lines in this session.
+    ///
+    /// see cmd_parser_t::execute_batch().
+    ///
+    /// @param buffer buffer of '\n' delimited lines to execute.
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param status optional per line status, true if the line succeeded.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if every line executed successfully.
+    bool execute_batch(
+        std::string_view buffer,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        std::vector<bool>* status = nullptr,
+        cmd_cancel_t* cancel = nullptr);
+
+    /// @brief Prepare a command expression, see cmd_parser_t::prepare().
+    ///
+    /// @param expr command expression to prepare.
+    /// @param prepared receives the prepared command.
+    /// @param output output stream for reporting resolution errors.
+    /// @return true if the command was resolved.
+    bool prepare(
+        std::string_view expr,
+        cmd_prepared_t& prepared,
+        cmd_output_t* output);
+
+    /// @brief Execute a prepared command in this session.
+    ///
+    /// @param prepared command returned from prepare().
+    /// @param output output stream that can be written to during execution.
+    /// @param additional user data to pass to command.
+    /// @param binds optional identifiers that take precedence over idents_.
+    /// @param args optional array of extra positional arguments.
+    /// @param num_args number of extra positional arguments.
+    /// @param cancel optional token to stop the execution with.
+    /// @return true if the command executed successfully.
+    bool execute(
+        const cmd_prepared_t& prepared,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        const cmd_idents_t* binds = nullptr,
+        const char* const* args = nullptr,
+        size_t num_args = 0,
+        cmd_cancel_t* cancel = nullptr);
+};
+
+/// @brief cmd_async_t, keeps several commands in flight at once.
+///
+/// each expression is started with cmd_t::on_execute_async() and renders
+/// into its own buffer, so commands completing in any order never
+/// interleave their output.  the buffer of a command is written to the
+/// output stream in one piece once it completes.  commands that did not
+/// complete immediately are followed by a line naming the task, and are
+/// delivered from the thread completing them to the output stream of the
+/// line that started them, which must outlive the task.
+///
+/// all of the methods must be called from one thread.
+///
+struct cmd_async_t {
+
+    /// @brief constructor.
+    ///
+    /// @param parser parser to resolve and execute commands with.
+    cmd_async_t(cmd_parser_t& parser);
+
+    /// @brief cancels and waits for any commands still in flight.
+    ~cmd_async_t();
+
+    /// @brief Start a line of ';' delimited expressions.
     ///
-    /// Virtual function that will be called when the user specifies is full path or an alias to this command.
-    /// If this command is ternimal then any following input tokens will be passed to this handler.
-    /// The caller provided output stream is also passed to the called command execution handler.
+    /// each expression is a separate task and they are all started in
+    /// order without waiting for earlier ones to complete.  the output of
+    /// any completed tasks is written before returning, and that of tasks
+    /// still running as soon as they complete.  a line ending in
+    /// '&' is instead started as a background job of the parser, which
+    /// must be concurrent.
     ///
-    /// @param tok token list of arguments supplied by the user.
-    /// @param out text output stream for writing results to.
-    /// @param user user data passed to the command from cmd_parser_t::execute().
-    /// @return true if the command executed successfully.
-    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user);
+    /// @param line expressions to execute.
+    /// @param output output stream to deliver completed output to.
+    /// @param user user data to pass to the commands.
+    /// @return id of the last task started, 0 if none were.
+    uint64_t execute(
+        std::string_view line,
+        cmd_output_t* output,
+        cmd_baton_t user);
 
-    /// @brief Return string with hierarchy of parent commands.
+    /// @brief Deliver the output of tasks that have completed.
     ///
-    /// @param out the string to store output hierarchy.
-    void get_command_path(std::string& out) const
-    {
-        if (parent_) {
-            parent_->get_command_path(out);
-            out.append(" ");
-        }
-        out.append(name_);
-    }
+    /// tasks that were still running when started have already delivered
+    /// their output and are only released.
+    ///
+    /// @param output output stream to deliver completed output to.
+    /// @return the number of tasks delivered.
+    size_t poll(cmd_output_t* output);
 
-    /// @brief Print command usage information to output stream.
+    /// @brief Wait for every task, delivering output as each completes.
     ///
-    /// @param out output stream to print to
-    /// @return true if usage was written successfully
-    virtual bool on_usage(cmd_output_t& out, cmd_baton_t user) const
+    /// @param output output stream to deliver completed output to.
+    /// @return true if all of the delivered tasks succeeded.
+    bool wait(cmd_output_t* output);
+
+    /// @brief number of tasks that have not been delivered.
+    size_t num_pending() const
     {
-        (void)user;
-        cmd_output_t::indent_t indent = out.indent(2);
-        std::string path;
-        get_command_path(path);
-        cmd_locale_t::usage(out, path.c_str(), usage_, desc_);
-        if (!sub_.empty()) {
-            cmd_locale_t::subcommands(out);
-            print_sub_commands(out);
-        }
-        return true;
+        return tasks_.size();
     }
 
 protected:
-    /// @brief Add an alias for this command.
+    struct task_t;
+
+    /// @brief deliver a completed task, from any thread.
+    bool deliver(task_t& task, bool ok, cmd_output_t& out);
+
+    cmd_parser_t& parser_;
+    uint64_t next_id_;
+    std::vector<std::unique_ptr<task_t>> tasks_;
+};
+
+/// @brief cmd_job_table_t, lines running in the background.
+///
+/// each job executes a whole line on its own thread, into its own buffer,
+/// with its own cancellation token.  the buffer is written to the output
+/// stream that started the job once it completes, or to the stream of
+/// whoever waits for it first.  jobs run alongside the thread that started
+/// them, so the parser must already be concurrent, see
+/// cmd_parser_t::set_concurrent().  the output stream of a job must outlive it, see wait_all().
+///
+struct cmd_job_table_t {
+
+    /// @brief status of a job, see list().
+    struct status_t {
+        uint64_t id_;
+        std::string line_;
+        bool done_;
+        bool killed_;
+    };
+
+    /// @brief constructor.
     ///
-    /// bind a cmt_t instance to a single string token known as an alias.
-    /// during command interpretation if the first token matches any alises then the associated cmd_t instance will be executed.
+    /// @param parser parser jobs execute with.
+    cmd_job_table_t(cmd_parser_t& parser);
+
+    /// @brief destructor, waits for every job to finish.
+    ~cmd_job_table_t();
+
+    /// @brief Start a line of ';' delimited expressions in the background.
     ///
-    /// @param name the string name of the alias to add.
-    /// @return true if the alias was associated successfully.
-    bool alias_add(const std::string& name);
+    /// the parser must be concurrent.
+    ///
+    /// @param line expressions to execute.
+    /// @param output output stream to deliver the jobs output to.
+    /// @param user user data to pass to the commands.
+    /// @return id of the new job.
+    uint64_t start(
+        std::string_view line,
+        cmd_output_t* output,
+        cmd_baton_t user);
 
-    /// @brief Report an error condition to the output stream.
+    /// @brief Wait for a job and deliver its output.
     ///
-    /// @param out output stream.
-    /// @param fmt input format string.
-    /// @param ... variable args.
-    /// @return false so it can be propagated via return statements easily.
-    bool error(cmd_output_t& out, const char* fmt, ...)
-    {
-        va_list args;
-        va_start(args, fmt);
-        out.println(fmt, args);
-        va_end(args);
-        return false;
-    }
+    /// the output guard of 'out' must be held by the caller.
+    ///
+    /// @param id id of the job to wait for.
+    /// @param out output stream to deliver the jobs output to.
+    /// @return true if the job succeeded, false if it failed or is unknown.
+    bool wait(uint64_t id, cmd_output_t& out);
 
-    /// @brief Print a list of command names to an output stream.
+    /// @brief Wait for every job started so far, see wait().
     ///
-    /// @param list input command list.
-    /// @param out output stream to write command names to.
-    void print_cmd_list(const cmd_list_t& list, cmd_output_t& out) const
-    {
-        cmd_output_t::indent_t indent = out.indent(2);
-        for (const auto& cmd : list) {
-            out.println("%s", cmd->name_);
-        }
-    }
+    /// @param out output stream to deliver the jobs output to.
+    /// @return true if all of the jobs succeeded.
+    bool wait_all(cmd_output_t& out);
 
-    /// @brief Print a list of child commands to the output stream.
+    /// @brief Cancel a running job.
     ///
-    /// @param out output stream to write command names to.
-    void print_sub_commands(cmd_output_t& out) const
-    {
-        print_cmd_list(sub_, out);
-    }
+    /// @param id id of the job to cancel.
+    /// @return true if the job was running.
+    bool kill(uint64_t id);
+
+    /// @brief List the jobs whose output has not been delivered.
+    ///
+    /// @param out receives the status of each job in start order.
+    void list(std::vector<status_t>& out);
+
+protected:
+    struct job_t;
+
+    /// @brief job thread body.
+    void run(job_t& job);
+
+    /// @brief join and free jobs whose thread has finished.
+    void reap();
+
+    cmd_parser_t& parser_;
+    std::mutex mux_;
+    std::condition_variable cv_;
+    uint64_t next_id_;
+    std::list<std::unique_ptr<job_t>> jobs_;
 };
 
-/// @brief cmd_parser_t, the command parser.
+/// @brief cmd_watchdog_t, reports commands running past their deadline.
 ///
-/// this type is the main workhorse of the command library.  it forms the root of the command hieararchy
-/// it stores some state that can be accessed via all commands (alias_, idents_)
-/// cmd_parser_t is responsible for parsing and dispatching user input to the appropriate command
+/// a background thread tracks the executions registered with watch().  an
+/// execution overruns when its tokens deadline, or the default limit since
+/// it started, has passed.  each overrun is reported once to the report
+/// stream and its token is cancelled, so a command polling
+/// cmd_tokens_t::cancelled() stops and releases the output guard.  commands
+/// that never poll can only be reported.  the watchdog never waits for the
+/// guard of the report stream, while a command holds it the reports are
+/// queued and written once it is free.  reports still queued when the
+/// watchdog is destroyed are dropped.
 ///
-struct cmd_parser_t {
+struct cmd_watchdog_t {
+    typedef cmd_cancel_t::clock_t clock_t;
 
-    /// @brief global user data passed to new subcommands unless overridden.
-    void* user_;
-
-    /// @brief the parent cmd_parser_t to fall back to for unknown commands.
+    /// @brief constructor, starts the watchdog thread.
     ///
-    /// a hierarchy of commands can make it easier to have context sensitive
-    /// commands in a application.
-    cmd_parser_t * parent_;
+    /// @param report stream overruns are reported to, may be nullptr.
+    /// @param limit default time an execution may take, zero for none.
+    cmd_watchdog_t(cmd_output_t* report, std::chrono::milliseconds limit = std::chrono::milliseconds(0));
 
-    /// @brief root subcommand list.
-    cmd_list_t sub_;
+    /// @brief destructor, stops the watchdog thread.
+    ~cmd_watchdog_t();
 
-    /// @brief user input history.
-    std::vector<std::string> history_;
+    /// @brief Start watching an execution.
+    ///
+    /// @param expr expression being executed, used when reporting.
+    /// @param cancel token to cancel on overrun, must outlive unwatch().
+    /// @return identifier to pass to unwatch().
+    uint64_t watch(std::string_view expr, cmd_cancel_t& cancel);
 
-    /// @brief map of alias names to command instances.
-    std::map<std::string, cmd_t*> alias_;
+    /// @brief Stop watching an execution.
+    ///
+    /// @param id identifier returned by watch().
+    /// @return true if the execution overran and its token was cancelled.
+    bool unwatch(uint64_t id);
 
-    /// @brief expression identifier list.
-    cmd_idents_t idents_;
+    /// @brief return the number of executions being watched.
+    size_t num_watched() const;
 
-    /// @brief cmd_parser_t constructor.
-    ///
-    /// @param user opaque user data pointer passed from parent to child.
-    /// @return user a global custom data pointer to be passed to any sub commands.
-    cmd_parser_t(cmd_baton_t user = nullptr)
-        : user_(user)
-        , parent_(nullptr)
+    /// @brief return the number of overruns reported.
+    uint64_t num_overruns() const
     {
+        return overruns_.load();
     }
 
-    /// @brief Get a string with the last user input to be executed.
+protected:
+    struct entry_t {
+        std::string expr_;
+        clock_t::time_point start_;
+        clock_t::time_point deadline_;
+        cmd_cancel_t* cancel_;
+        bool reported_;
+    };
+
+    /// @brief watchdog thread body.
+    void run();
+
+    /// @brief write queued reports if the report stream is free.
     ///
-    /// @return reference to the last
-    const std::string& last_cmd()
-    {
-        if (history_.empty()) {
-            history_.push_back("hello");
+    /// @return false if reports are left queued.
+    bool report();
+
+    cmd_output_t* report_;
+    const std::chrono::milliseconds limit_;
+    mutable std::mutex mux_;
+    std::condition_variable cv_;
+    std::map<uint64_t, entry_t> watched_;
+    /// @brief overruns not yet written to the report stream.
+    std::vector<std::pair<std::string, uint64_t>> pending_;
+    uint64_t next_id_;
+    bool stop_;
+    std::atomic<uint64_t> overruns_;
+    std::thread thread_;
+};
+
+/// @brief cmd_tracer_t, records execution spans for Chrome trace export.
+///
+/// each thread records begin and end events into its own ring buffer with
+/// relaxed atomic stores and no locks, overwriting its oldest events when
+/// full.  a thread takes a lock once to register its ring, and hands it
+/// back when it exits for the next new thread to reuse, so memory grows
+/// with the number of threads alive at once.  a reused ring keeps its
+/// thread id and the events of its previous owner until overwritten.  the
+/// event names are not copied and must outlive the tracer, command names do.
+/// dump() may run while other threads are recording.
+///
+struct cmd_tracer_t {
+    typedef std::chrono::steady_clock clock_t;
+
+    /// @brief span_t, records a span for the lifetime of the object.
+    struct span_t {
+        span_t(cmd_tracer_t* tracer, const char* name)
+            : tracer_(tracer)
+            , name_(name)
+        {
+            if (tracer_) {
+                tracer_->begin(name_);
+            }
         }
-        return history_.back();
-    }
 
-    /// @brief Add a new root command to the command parser.
-    ///
-    /// add a new root command to the command interpreter.
-    /// the new subcommand instance will be passed the global cmd_parser_t user_ data
+        ~span_t()
+        {
+            if (tracer_) {
+                tracer_->end(name_);
+            }
+        }
+
+        span_t(const span_t&) = delete;
+        span_t& operator=(const span_t&) = delete;
+
+        cmd_tracer_t* const tracer_;
+        const char* const name_;
+    };
+
+    /// @brief constructor.
     ///
-    /// @param type_t class derived from cmd_t base.
-    /// @return instance of the newly created command.
-    template <typename type_t>
-    type_t* add_command()
+    /// @param capacity number of events kept per thread, rounded up to a
+    ///        power of two.
+    cmd_tracer_t(size_t capacity = 1 << 16);
+
+    ~cmd_tracer_t();
+
+    /// @brief record the start of a span on the calling thread.
+    void begin(const char* name)
     {
-        return add_command<type_t>(user_);
+        record(name, false);
     }
 
-    /// @brief Add a new root command to the command parser.
-    ///
-    /// @param user the user data type to pass to the sub command.
-    /// @return instance of the newly created command.
-    template <typename type_t>
-    type_t* add_command(cmd_baton_t user)
+    /// @brief record the end of a span on the calling thread.
+    void end(const char* name)
     {
-        cmd_t* parent = nullptr;
-        std::unique_ptr<type_t> temp(new type_t(*this, parent, user));
-        sub_.push_back(std::move(temp));
-        return (type_t*)sub_.rbegin()->get();
+        record(name, true);
     }
 
-    /// @brief Add a new root command to the command parser.
+    /// @brief render the recorded events as Chrome trace JSON.
     ///
-    /// Note: the command parameter will be moved so that ownership is
-    /// transfered to the command parser.  command should not be accessed
-    /// after calling this function and instead, the return instance should
-    /// be used in its place.
+    /// @param out string the JSON is appended to.
+    /// @return number of events rendered.
+    size_t dump(std::string& out) const;
+
+    /// @brief write the recorded events to a Chrome trace JSON file.
     ///
-    /// @param command a command instance to add to the parser
-    /// @return the new command instance after moving the parameter
-    cmd_t* add_command(cmd_t*& command)
-    {
-        std::unique_ptr<cmd_t> temp(std::move(command));
-        sub_.push_back(std::move(temp));
-        command = nullptr;
-        return sub_.rbegin()->get();
-    }
+    /// the file can be loaded by chrome://tracing or Perfetto.
+    ///
+    /// @param path path of the file to write.
+    /// @return true if the file was written.
+    bool dump(const char* path) const;
 
-    /// @brief Execute expressions, calling the relevant cmd_t instances with arguments.
+protected:
+    struct ring_t;
+
+    /// @brief record an event in the calling threads ring.
+    void record(const char* name, bool end);
+
+    /// @brief find, reuse or create the ring of the calling thread.
+    ring_t* ring();
+
+    /// @brief return a ring to its tracer when the thread holding it exits.
+    static void release(void* rings, void* ring);
+
+    struct rings_t;
+
+    /// @brief unique id so thread local ring lookups can not go stale.
+    const uint64_t id_;
+    const size_t capacity_;
+    const clock_t::time_point epoch_;
+    /// @brief every ring created, shared with the threads holding them.
+    const std::shared_ptr<rings_t> rings_;
+};
+
+/// @brief cmd_executor_t, runs scripts across a pool of worker threads.
+///
+/// lines of a script whose commands are all marked concurrent_ are executed
+/// in parallel, each rendering into its own buffer.  the buffers are then
+/// written to the output stream in the original line order.  any other line
+/// acts as a barrier and runs on the calling thread once all of the lines
+/// before it have completed, so the script observes program order.
+///
+/// command paths are resolved on the calling thread, so aliases and the
+/// path cache behave as they would with cmd_parser_t::execute().
+///
+/// lines declaring their identifier accesses with cmd_t::on_access() form a
+/// dependency graph: a line runs once every earlier line that writes what
+/// it reads, or reads or writes what it writes, has completed.  identifiers
+/// first defined in a window are inserted before it runs so that workers
+/// never change the structure of the identifier map.
+///
+struct cmd_executor_t {
+
+    /// @brief constructor.
     ///
-    /// @param a list of ';' delimited expression strings to execute.
+    /// @param parser parser to execute commands with.
+    /// @param num_threads total threads including the caller, 0 to use the
+    ///        hardware concurrency.
+    cmd_executor_t(cmd_parser_t& parser, uint32_t num_threads = 0);
+
+    ~cmd_executor_t();
+
+    cmd_executor_t(const cmd_executor_t&) = delete;
+    cmd_executor_t& operator=(const cmd_executor_t&) = delete;
+
+    /// @brief Execute lines of ';' delimited expressions.
+    ///
+    /// semantics match cmd_parser_t::execute_batch(), including a mark()
+    /// per line as its output is emitted.
+    ///
+    /// @param lines array of lines to execute.
+    /// @param num_lines number of lines in the array.
     /// @param output output stream that can be written to during execution.
     /// @param additional user data to pass to command.
-    /// @return true if the command executed successfully.
+    /// @param status optional per line status, true if the line succeeded.
+    /// @return true if every line executed successfully.
     bool execute(
-        const std::string& expr,
+        const std::string_view* lines,
+        size_t num_lines,
         cmd_output_t* output,
-        cmd_baton_t user);
-
-    /// @brief Add a new parser alias for a cmd_t instance.
-    ///
-    /// @param cmd command instance for which to make an alias.
-    /// @param alias name for the alias.
-    /// @return true if that alias was added.
-    bool alias_add(cmd_t* cmd, const std::string& alias);
-
-    /// @brief Remove a previously registered command alias byt name.
-    ///
-    /// @param alias the string command alias to remove.
-    /// @return true if the alias was removed.
-    bool alias_remove(const std::string& alias);
+        cmd_baton_t user,
+        std::vector<bool>* status = nullptr);
 
-    /// @brief Remove any previously registered command alises by target cmd_t.
-    ///
-    /// @param cmd the cmd_t instance to remove any alises to.
-    /// @return true if the alias was removed.
-    bool alias_remove(const cmd_t* cmd);
+    /// @brief Execute a buffer of new line delimited lines.
+    bool execute(
+        std::string_view buffer,
+        cmd_output_t* output,
+        cmd_baton_t user,
+        std::vector<bool>* status = nullptr);
 
-    /// @brief Find a cmd_t instance given its alias name.
+    /// @brief Execute lines with the output guard already held.
     ///
-    /// @param alias the string alias to search for an associated cmd_t instance.
-    /// @return cmd_t instance linked to this alias otherwise nullptr.
-    cmd_t* alias_find(const std::string& alias) const
+    /// as execute(), for use by a running command.  when script is given a
+    /// failing line reports a script error directly after its own output.
+    /// lines are not marked, their output belongs to the running command.
+    bool execute_lines(
+        const std::string_view* lines,
+        size_t num_lines,
+        cmd_output_t& output,
+        cmd_baton_t user,
+        std::vector<bool>* status,
+        const char* script = nullptr);
+
+    /// @brief return the number of threads including the caller.
+    size_t num_threads() const
     {
-        auto itt = alias_.find(alias);
-        return itt == alias_.end() ? nullptr : itt->second;
+        return threads_.size() + 1;
     }
 
+    /// @brief number of lines buffered before they are run and emitted.
+    static const size_t WINDOW = 1024;
+
 protected:
-    /// @brief Execute a command expression, calling the relevant cmd_t instance with arguments.
-    ///
-    /// @param expression string to execute.
-    /// @param output output stream that can be written to during execution.
-    /// @return true if the command executed successfully.
-    bool execute_imp(
-        const std::string& expr,
-        cmd_output_t* output,
-        cmd_baton_t user);
+    /// @brief per thread state.
+    struct worker_t;
+
+    /// @brief a line scheduled to run on the pool.
+    struct unit_t {
+        /// @brief the resolved expressions of the line.
+        std::vector<cmd_prepared_t> exprs_;
+        /// @brief number of valid exprs_.
+        size_t num_exprs_;
+        /// @brief rendered output of the line.
+        std::string text_;
+        /// @brief index of the line in the script.
+        size_t line_;
+        /// @brief true if the line succeeded.
+        bool ok_;
+        /// @brief number of units that must complete before this one.
+        uint32_t pending_;
+        /// @brief units waiting on this one.
+        std::vector<size_t> dependents_;
+    };
+
+    /// @brief per identifier dependency state within a window.
+    struct ident_t {
+        ident_t()
+            : writer_(SIZE_MAX)
+            , fresh_(false)
+        {
+        }
+
+        /// @brief last unit to write the identifier, or SIZE_MAX.
+        size_t writer_;
+        /// @brief units that read it since the last write.
+        std::vector<size_t> readers_;
+        /// @brief true if inserted ahead of its first assignment.
+        bool fresh_;
+        /// @brief units that may define a fresh identifier.
+        std::vector<size_t> defs_;
+    };
+
+    /// @brief result of scheduling a line.
+    enum schedule_t {
+        e_scheduled,
+        e_barrier,
+        // the window must run before the line can be scheduled
+        e_flush,
+    };
+
+    /// @brief resolve a line into a unit.
+    schedule_t schedule(std::string_view line, unit_t& unit);
+
+    /// @brief add dependency edges for the access set of a unit.
+    schedule_t add_access(size_t index, const cmd_access_t& access);
+
+    /// @brief add an edge so that a unit waits on another.
+    void add_edge(size_t from, size_t to);
+
+    /// @brief remove identifiers defined by a window that never assigned them.
+    void clean_idents();
+
+    /// @brief run all scheduled units and emit their output in order.
+    bool run_units(cmd_output_t& output, std::vector<bool>* status, const char* script);
+
+    /// @brief mark every line up to and including line when marking.
+    void mark_lines(cmd_output_t& output, size_t line);
+
+    /// @brief claim and run units until none remain.
+    void work(worker_t& worker);
+
+    /// @brief run a single unit.
+    void run_unit(worker_t& worker, unit_t& unit);
+
+    /// @brief worker thread entry point.
+    void thread_main(worker_t& worker);
+
+    cmd_parser_t& parser_;
+    /// @brief per thread state, [0] belongs to the calling thread.
+    std::vector<std::unique_ptr<worker_t>> workers_;
+    std::vector<std::thread> threads_;
+
+    /// @brief scheduled units, reused between windows.
+    std::vector<unit_t> units_;
+    size_t num_units_;
+    /// @brief next unit to claim.
+    std::atomic<size_t> next_;
+    /// @brief user data for the running units.
+    cmd_baton_t user_;
+    /// @brief true if lines are marked, only when called through execute().
+    bool marking_;
+    /// @brief number of lines marked so far.
+    size_t marked_;
+
+    /// @brief identifiers accessed by the current window.
+    std::map<std::string, ident_t, std::less<>> idents_;
+    /// @brief units reading every identifier since the last write.
+    std::vector<size_t> all_readers_;
+    /// @brief units writing any identifier.
+    std::vector<size_t> writers_;
+    /// @brief scratch access set.
+    cmd_access_t access_;
+    /// @brief number of dependency edges in the current window.
+    size_t num_edges_;
+
+    /// @brief units ready to run when the window has dependencies.
+    std::deque<size_t> ready_;
+    /// @brief number of completed units when the window has dependencies.
+    size_t finished_;
+    std::mutex ready_mux_;
+    std::condition_variable ready_cv_;
+
+    std::mutex mux_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    /// @brief incremented each time units are published.
+    uint64_t generation_;
+    /// @brief true while the published units may be claimed.
+    bool open_;
+    /// @brief number of workers inside work().
+    uint32_t active_;
+    bool quit_;
 };
@@ -2,10 +2,13 @@
 #include "cmd.h"
 
 struct cmd_alias_t : public cmd_t {
+    static constexpr const char* NAME = "alias";
 
     struct cmd_alias_add_t : public cmd_t {
+        static constexpr const char* NAME = "add";
+
         cmd_alias_add_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("add", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             usage_ = "name cmd [cmd ...]";
             desc_ = "alias a command with a single name";
@@ -15,16 +18,10 @@ struct cmd_alias_t : public cmd_t {
         {
             cmd_t* cmd = nullptr;
             for (const cmd_token_t& token : tok.tokens.raw_) {
-                cmd = nullptr;
                 if (list == nullptr) {
                     return nullptr;
                 }
-                for (const auto& list_cmd : *list) {
-                    if (token.get() == list_cmd->name_) {
-                        cmd = list_cmd.get();
-                        break;
-                    }
-                }
+                cmd = list->find_exact(token.get());
                 if (cmd == nullptr) {
                     break;
                 }
@@ -44,12 +41,15 @@ struct cmd_alias_t : public cmd_t {
                 cmd_token_t name = tok.tokens.front();
                 tok.tokens.pop();
                 // lookup a command for the remaining tokens
+                const auto lock = parser_.write_lock();
                 cmd_t* cmd = cmd_find(tok, &(parser_.sub_));
                 if (cmd == nullptr) {
                     auto ident = out.indent(2);
                     return cmd_locale_t::unable_to_find_cmd(out, name.c_str()), false;
                 }
-                parser_.alias_add(cmd, name);
+                if (!state(tok).alias_add(cmd, name)) {
+                    return out.println("alias quota exceeded"), false;
+                }
                 return true;
             }
             return on_usage(out, user), false;
@@ -57,8 +57,10 @@ struct cmd_alias_t : public cmd_t {
     };
 
     struct cmd_alias_remove_t : public cmd_t {
+        static constexpr const char* NAME = "remove";
+
         cmd_alias_remove_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("remove", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             usage_ = "name";
             desc_ = "remove a previously registered alias";
@@ -67,16 +69,19 @@ struct cmd_alias_t : public cmd_t {
         virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
         {
             (void)user, (void)out;
+            cmd_state_t& context = state(tok);
             for (const cmd_token_t& token : tok.tokens()) {
-                parser_.alias_remove(token);
+                context.alias_remove(token);
             }
             return true;
         }
     };
 
     struct cmd_alias_list_t : public cmd_t {
+        static constexpr const char* NAME = "list";
+
         cmd_alias_list_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("list", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             desc_ = "list all registered aliases";
         }
@@ -84,25 +89,25 @@ struct cmd_alias_t : public cmd_t {
         virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
         {
             auto indent = out.indent(2);
-            cmd_locale_t::num_aliases(out, parser_.alias_.size());
+            const auto lock = parser_.write_lock();
+            const auto& aliases = state(tok).alias_;
+            cmd_locale_t::num_aliases(out, aliases.size());
             indent.add(2);
             std::string path;
-            for (auto itt : parser_.alias_) {
+            for (auto itt : aliases) {
                 const cmd_t* cmd = itt.second;
                 path.clear();
                 cmd->get_command_path(path);
-                out.println("%8s - %s", itt.first.c_str(), path.c_str());
+                out.println(CMD_FMT("{8} - {}"), itt.first, path);
             }
             return true;
         }
     };
 
     cmd_alias_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-        : cmd_t("alias", cli, parent, user)
+        : cmd_t(NAME, cli, parent, user)
     {
-        add_sub_command<cmd_alias_add_t>(user);
-        add_sub_command<cmd_alias_remove_t>(user);
-        add_sub_command<cmd_alias_list_t>(user);
+        add_sub_commands<cmd_alias_add_t, cmd_alias_remove_t, cmd_alias_list_t>();
         desc_ = "manage command aliases";
     }
 };
@@ -2,12 +2,14 @@
 #include "cmd.h"
 
 struct cmd_echo_t : public cmd_t {
+    static constexpr const char* NAME = "echo";
 
     cmd_echo_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-        : cmd_t("echo", cli, parent, user)
+        : cmd_t(NAME, cli, parent, user)
     {
         usage_ = "arg [arg] [...]";
         desc_ = "echo cmd_t args for debugging";
+        concurrent_ = true;
     }
 
     virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
@@ -19,28 +21,28 @@ struct cmd_echo_t : public cmd_t {
                 tokens.append(token);
                 tokens.append(1, ' ');
             }
-            out.println("tokens: %s", tokens.c_str());
+            out.println(CMD_FMT("tokens: {}"), tokens);
         }
         if (!tok.flags.empty()) {
             std::string flags;
-            for (const cmd_token_t& flag : tok.flags.flags_) {
+            for (const std::string_view& flag : tok.flags.flags_) {
                 flags.append(flag);
                 flags.append(1, ' ');
             }
-            out.println(" flags: %s", flags.c_str());
+            out.println(CMD_FMT(" flags: {}"), flags);
         }
         if (!tok.pairs.empty()) {
             out.print(" pairs: ");
             std::string pair;
             for (const auto& pair : tok.pairs.pairs_) {
-                out.print<false>("%s:%s ", pair.first.c_str(), pair.second.c_str());
+                out.print<false>(CMD_FMT("{}:{} "), pair.first, pair.second.c_str());
             }
             out.eol();
         }
         if (!tok.tokens.raw_.empty()) {
             out.print("   raw: ");
             for (const cmd_token_t& token : tok.tokens.raw_) {
-                out.print<false>("%s ", token.c_str());
+                out.print<false>(CMD_FMT("{} "), token.c_str());
             }
             out.eol();
         }
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <array>
@@ -26,7 +27,7 @@ struct cmd_exp_error_t {
     bool print(cmd_output_t& out)
     {
         for (const std::string& err : error_) {
-            out.println("  %s", err.c_str());
+            out.error(cmd_output_t::e_bad_expression, CMD_FMT("  {}"), err);
         }
         return true;
     }
@@ -61,6 +62,11 @@ struct cmd_exp_error_t {
         return error("cant assign to a literal");
     }
 
+    bool error_ident_quota()
+    {
+        return error("identifier quota exceeded");
+    }
+
     bool error_malformed_expr()
     {
         return error("malformed expression");
@@ -287,11 +293,15 @@ struct cmd_exp_lexer_t {
 struct cmd_expr_imp_t {
     std::vector<exp_token_t> stack_;
     std::deque<exp_token_t> input_;
-    std::map<std::string, uint64_t>& idents_;
+    // read only while evaluating, assignments are collected in writes_
+    const cmd_idents_t& idents_;
+    cmd_idents_t writes_;
+    size_t max_idents_;
     cmd_exp_error_t error_;
 
-    cmd_expr_imp_t(std::map<std::string, uint64_t>& i)
+    cmd_expr_imp_t(const cmd_idents_t& i, size_t max_idents = SIZE_MAX)
         : idents_(i)
+        , max_idents_(max_idents)
     {
     }
 
@@ -311,7 +321,31 @@ struct cmd_expr_imp_t {
         return true;
     }
 
+    /* find the value of an identifier, as assigned by this expression */
+    bool lookup(const std::string& name, uint64_t& value) const
+    {
+        auto itt = writes_.find(name);
+        if (itt == writes_.end()) {
+            itt = idents_.find(name);
+            if (itt == idents_.end()) {
+                return false;
+            }
+        }
+        value = itt->second;
+        return true;
+    }
+
 protected:
+    /* return true if another identifier can be assigned within the quota */
+    bool ident_room() const
+    {
+        size_t size = idents_.size() + 1;
+        for (const auto& itt : writes_) {
+            size += idents_.find(itt.first) == idents_.end() ? 1 : 0;
+        }
+        return size <= max_idents_;
+    }
+
     bool input_found_op(const char op)
     {
         assert(!input_.empty());
@@ -430,12 +464,12 @@ protected:
             return true;
         }
         if (in.type_ == in.e_identifier) {
-            auto itt = idents_.find(in.ident_);
-            if (itt == idents_.end()) {
+            uint64_t value;
+            if (!lookup(in.ident_, value)) {
                 return false;
             }
             out.type_ = out.e_value;
-            out.value_ = itt->second;
+            out.value_ = value;
             return true;
         }
         return false;
@@ -447,7 +481,10 @@ protected:
             return error_.error_cant_assign_literal();
         }
         assert(rhs.type_ == exp_token_t::e_value);
-        idents_[lhs.ident_] = rhs.value_;
+        if (idents_.find(lhs.ident_) == idents_.end() && writes_.find(lhs.ident_) == writes_.end() && !ident_room()) {
+            return error_.error_ident_quota();
+        }
+        writes_[lhs.ident_] = rhs.value_;
         stack_.push_back(lhs);
         return true;
     }
@@ -573,34 +610,96 @@ bool cmd_expr_t::cmd_expr_eval_t::on_execute(cmd_tokens_t& tok, cmd_output_t& ou
     if (!join_expr(tok, expr)) {
         return cmd_locale_t::malformed_exp(out), false;
     }
-    // execute the expression
-    cmd_expr_imp_t state(parser_.idents_);
-    if (!state.evaluate(expr)) {
-        return state.error_.print(out), false;
+    cmd_state_t& context = this->state(tok);
+    const size_t quota = context.quota_.idents_;
+    std::unique_ptr<cmd_expr_imp_t> state;
+    bool known = false;
+    // evaluate() leaves a single result, resolved while values can be read
+    const auto evaluate = [&]() {
+        state.reset(new cmd_expr_imp_t(context.idents_, quota ? quota : SIZE_MAX));
+        if (!state->evaluate(expr)) {
+            return false;
+        }
+        exp_token_t& val = state->stack_.front();
+        if (val.type_ == exp_token_t::e_identifier) {
+            known = state->lookup(val.ident_, val.value_);
+        }
+        return true;
+    };
+    // concurrent evaluations share a read lock
+    bool ok;
+    {
+        std::shared_lock<std::shared_mutex> lock(context.idents_mux_);
+        ok = evaluate();
+    }
+    // assignments evaluate again under the write lock so they are atomic
+    if (ok && !state->writes_.empty()) {
+        std::unique_lock<std::shared_mutex> lock(context.idents_mux_);
+        ok = evaluate();
+        for (const auto& itt : state->writes_) {
+            context.idents_[itt.first] = itt.second;
+        }
+    }
+    if (!ok) {
+        return state->error_.print(out), false;
     }
     indent.add(2);
-    // print results
-    for (const exp_token_t& val : state.stack_) {
-        switch (val.type_) {
-        case exp_token_t::e_identifier: {
-            auto& idents = state.idents_;
-            auto itt = idents.find(val.ident_);
-            if (itt == idents.end()) {
-                // unknown identifier
-                cmd_locale_t::unknown_ident(out, val.ident_.c_str());
-            } else {
-                // print key value pair
-                const std::string& key = itt->first;
-                const uint64_t& value = itt->second;
-                out.println("%s = 0x%llx", key.c_str(), value);
+    // print result
+    const exp_token_t& val = state->stack_.front();
+    switch (val.type_) {
+    case exp_token_t::e_identifier:
+        if (!known) {
+            return cmd_locale_t::unknown_ident(out, val.ident_.c_str()), true;
+        }
+        // print key value pair
+        out.value(val.ident_.c_str(), val.value_, CMD_FMT("{} = 0x{x}"), val.ident_, val.value_);
+        return true;
+    case exp_token_t::e_value:
+        out.value("value", val.value_, CMD_FMT("0x{x}"), val.value_);
+        return true;
+    default:
+        return cmd_locale_t::not_val_or_ident(out), false;
+    }
+}
+
+bool cmd_expr_t::cmd_expr_eval_t::on_access(const cmd_tokens_t& tok, cmd_access_t& access) const
+{
+    // join as on_execute() does, $ident arguments are read by the caller
+    std::string expr;
+    for (const cmd_token_t& token : tok.tokens.raw_) {
+        const std::string_view str = token.get();
+        if (str.size() > 1 && str[0] == '$') {
+            expr.append("0 ");
+        } else {
+            expr.append(str).append(1, ' ');
+        }
+    }
+    cmd_exp_lexer_t lexer;
+    std::deque<exp_token_t> input;
+    if (!lexer.tokenize(expr, input)) {
+        return false;
+    }
+    // only a leading 'ident = ...' is known to assign after everything else
+    // has succeeded, anything else must run in order
+    bool assign = false;
+    for (size_t i = 0; i < input.size(); ++i) {
+        const exp_token_t& in = input[i];
+        if (in.type_ == exp_token_t::e_operator && in.op_ == exp_token_t::e_op_assign) {
+            if (i != 1 || input[0].type_ != exp_token_t::e_identifier) {
+                return false;
             }
-            break;
+            assign = true;
         }
-        case exp_token_t::e_value:
-            out.println("0x%llx", val.value_);
-            break;
-        default:
-            return cmd_locale_t::not_val_or_ident(out), false;
+    }
+    for (size_t i = 0; i < input.size(); ++i) {
+        const exp_token_t& in = input[i];
+        if (in.type_ != exp_token_t::e_identifier) {
+            continue;
+        }
+        if (i == 0 && assign) {
+            access.writes_.push_back(in.ident_);
+        } else {
+            access.reads_.push_back(in.ident_);
         }
     }
     return true;
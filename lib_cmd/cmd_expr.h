@@ -9,11 +9,13 @@
 #include "cmd.h"
 
 struct cmd_expr_t : public cmd_t {
+    static constexpr const char* NAME = "expr";
 
     struct cmd_expr_set_t : public cmd_t {
+        static constexpr const char* NAME = "set";
 
         cmd_expr_set_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("set", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             usage_ = "[identifier] [value]";
             desc_ = "assign an identifier a value";
@@ -23,7 +25,7 @@ struct cmd_expr_t : public cmd_t {
         {
             (void)user;
             cmd_output_t::indent_t indent = out.indent(2);
-            cmd_idents_t& idents = parser_.idents_;
+            cmd_state_t& context = state(tok);
             // parse identifier name
             std::string name;
             if (!tok.tokens.get(name)) {
@@ -35,15 +37,32 @@ struct cmd_expr_t : public cmd_t {
             if (!tok.tokens.get(value)) {
                 return out.println("value required"), false;
             }
-            // set the identifier
-            return (idents[name] = value), true;
+            // set the identifier, only holding the write lock to do so
+            {
+                std::unique_lock<std::shared_mutex> lock(context.idents_mux_);
+                if (context.ident_room(name)) {
+                    context.idents_[name] = value;
+                    return true;
+                }
+            }
+            return out.println("identifier quota exceeded"), false;
+        }
+
+        virtual bool on_access(const cmd_tokens_t& tok, cmd_access_t& access) const override
+        {
+            if (tok.tokens.empty()) {
+                return false;
+            }
+            access.writes_.emplace_back(tok.tokens.front().get());
+            return true;
         }
     };
 
     struct cmd_expr_remove_t : public cmd_t {
+        static constexpr const char* NAME = "remove";
 
         cmd_expr_remove_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("remove", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             usage_ = "[identifier]";
             desc_ = "erase an identifier";
@@ -53,7 +72,7 @@ struct cmd_expr_t : public cmd_t {
         {
             (void)user;
             cmd_output_t::indent_t indent = out.indent(2);
-            cmd_idents_t& idents = parser_.idents_;
+            cmd_state_t& context = state(tok);
             // parse identifier name
             std::string name;
             if (!tok.tokens.get(name)) {
@@ -61,20 +80,23 @@ struct cmd_expr_t : public cmd_t {
             }
             assert(!name.empty());
             // erase the identifier
-            auto itt = idents.find(name);
-            if (itt != idents.end()) {
-                idents.erase(itt);
-            } else {
-                out.println("unable to find identifier '%s'", name.c_str());
+            size_t erased;
+            {
+                std::unique_lock<std::shared_mutex> lock(context.idents_mux_);
+                erased = context.idents_.erase(name);
+            }
+            if (!erased) {
+                out.println(CMD_FMT("unable to find identifier '{}'"), name);
             }
             return true;
         }
     };
 
     struct cmd_expr_eval_t : public cmd_t {
+        static constexpr const char* NAME = "eval";
 
         cmd_expr_eval_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("eval", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             usage_ = "[expression]";
             desc_ = "evaluate an algabreic expression";
@@ -92,36 +114,50 @@ struct cmd_expr_t : public cmd_t {
         }
 
         virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override;
+
+        virtual bool on_access(const cmd_tokens_t& tok, cmd_access_t& access) const override;
     };
 
     struct cmd_expr_list_t : public cmd_t {
+        static constexpr const char* NAME = "list";
 
         cmd_expr_list_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("list", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             desc_ = "list all identifiers";
+            concurrent_ = true;
+        }
+
+        virtual bool on_access(const cmd_tokens_t& tok, cmd_access_t& access) const override
+        {
+            (void)tok;
+            access.all_ = true;
+            return true;
         }
 
         virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
         {
             cmd_output_t::indent_t indent = out.indent(2);
-            const cmd_idents_t& idents = parser_.idents_;
-            out.println("%lld variables:", (uint64_t)idents.size());
+            cmd_state_t& context = state(tok);
+            std::shared_lock<std::shared_mutex> lock(context.idents_mux_);
+            const cmd_idents_t& idents = context.idents_;
+            out.list_begin("variables", CMD_FMT("{} variables:"), idents.size());
             indent.add(2);
             for (const auto& itt : idents) {
-                out.println("%8s 0x%llx", itt.first.c_str(), itt.second);
+                out.value(itt.first.c_str(), itt.second, CMD_FMT("{8} 0x{x}"), itt.first, itt.second);
             }
+            out.list_end();
             return true;
         }
     };
 
     cmd_expr_t(cmd_parser_t& cli, cmd_t* parent, void* user)
-        : cmd_t("expr", cli, parent, user)
+        : cmd_t(NAME, cli, parent, user)
     {
-        add_sub_command<cmd_expr_eval_t>();
-        add_sub_command<cmd_expr_list_t>();
-        add_sub_command<cmd_expr_set_t>();
-        add_sub_command<cmd_expr_remove_t>();
+        add_sub_commands<cmd_expr_eval_t,
+            cmd_expr_list_t,
+            cmd_expr_set_t,
+            cmd_expr_remove_t>();
         desc_ = "expression evaluation";
     }
 };
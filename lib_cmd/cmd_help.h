@@ -2,12 +2,16 @@
 #include "cmd.h"
 
 struct cmd_help_t : public cmd_t {
+    static constexpr const char* NAME = "help";
 
     struct cmd_help_tree_t : public cmd_t {
+        static constexpr const char* NAME = "tree";
+
         cmd_help_tree_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-            : cmd_t("tree", cli, parent, user)
+            : cmd_t(NAME, cli, parent, user)
         {
             desc_ = "list all commands and their sub commands";
+            concurrent_ = true;
             parser_.history_.push_back("help");
         }
 
@@ -15,7 +19,7 @@ struct cmd_help_t : public cmd_t {
         {
             auto indent = out.indent(2);
             for (const auto& cmd : list) {
-                out.println(cmd->name_);
+                out.println(CMD_FMT("{}"), cmd->name_);
                 assert(cmd);
                 if (!cmd->sub_.empty()) {
                     walk(cmd->sub_, out);
@@ -26,21 +30,24 @@ struct cmd_help_t : public cmd_t {
         virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
         {
             (void)user;
+            const auto lock = parser_.write_lock();
             walk(parser_.sub_, out);
             return true;
         }
     };
 
     cmd_help_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-        : cmd_t("help", cli, parent, user)
+        : cmd_t(NAME, cli, parent, user)
     {
         desc_ = "list all root commands";
-        add_sub_command<cmd_help_tree_t>();
+        concurrent_ = true;
+        add_sub_commands<cmd_help_tree_t>();
     }
 
     virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
     {
         (void)user;
+        const auto lock = parser_.write_lock();
         print_cmd_list(parser_.sub_, out);
         return true;
     }
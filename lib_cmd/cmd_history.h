@@ -2,9 +2,10 @@
 #include "cmd.h"
 
 struct cmd_history_t : public cmd_t {
+    static constexpr const char* NAME = "history";
 
     cmd_history_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
-        : cmd_t("history", cli, parent, user)
+        : cmd_t(NAME, cli, parent, user)
     {
         desc_ = "show all previously executed commands";
     }
@@ -13,14 +14,17 @@ struct cmd_history_t : public cmd_t {
     {
         (void)user;
         auto indent = out.indent(2);
-        size_t num = parser_.history_.size();
+        cmd_state_t& context = state(tok);
+        std::lock_guard<std::mutex> lock(context.history_mux_);
+        const auto& history = context.history_;
+        size_t num = history.size();
         num ? --num : 0;
-        for (const auto& itt : parser_.history_) {
+        for (const auto& itt : history) {
             // dont print last thing
-            if (&itt != &parser_.history_.back()) {
+            if (&itt != &history.back()) {
                 break;
             }
-            out.println("(-%02d) %s", (uint32_t)num, itt.c_str());
+            out.println(CMD_FMT("(-{02}) {}"), num, itt);
             --num;
         }
         return true;
@@ -0,0 +1,105 @@
+#pragma once
+#include "cmd.h"
+
+// read the remaining tokens as job ids, reporting any that are not numbers
+inline bool cmd_job_ids(cmd_tokens_t& tok, cmd_output_t& out, std::vector<uint64_t>& ids)
+{
+    bool ret = true;
+    while (!tok.tokens.empty()) {
+        uint64_t id;
+        if (tok.tokens.get(id)) {
+            ids.push_back(id);
+            continue;
+        }
+        std::string arg;
+        tok.tokens.get(arg);
+        cmd_locale_t::invalid_job(out, arg.c_str());
+        ret = false;
+    }
+    return ret;
+}
+
+// jobs are started by lines ending in '&' on a concurrent parser
+struct cmd_jobs_t : public cmd_t {
+    static constexpr const char* NAME = "jobs";
+
+    cmd_jobs_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        desc_ = "list background jobs";
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)tok, (void)user;
+        std::vector<cmd_job_table_t::status_t> jobs;
+        parser_.jobs().list(jobs);
+        if (jobs.empty()) {
+            return out.println("no jobs"), true;
+        }
+        for (const auto& job : jobs) {
+            const char* status = job.killed_ ? "killed" : (job.done_ ? "done" : "running");
+            cmd_locale_t::job_status(out, job.id_, status, job.line_.c_str());
+        }
+        return true;
+    }
+};
+
+struct cmd_wait_t : public cmd_t {
+    static constexpr const char* NAME = "wait";
+
+    cmd_wait_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        usage_ = "[id ...]";
+        desc_ = "wait for background jobs, all of them by default";
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        if (tok.tokens.empty()) {
+            return parser_.jobs().wait_all(out);
+        }
+        std::vector<uint64_t> ids;
+        if (!cmd_job_ids(tok, out, ids)) {
+            return false;
+        }
+        bool ret = true;
+        for (const uint64_t id : ids) {
+            ret &= parser_.jobs().wait(id, out);
+        }
+        return ret;
+    }
+};
+
+struct cmd_kill_t : public cmd_t {
+    static constexpr const char* NAME = "kill";
+
+    cmd_kill_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        usage_ = "id [id ...]";
+        desc_ = "cancel running background jobs";
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        if (tok.tokens.empty()) {
+            return on_usage(out, user), false;
+        }
+        std::vector<uint64_t> ids;
+        if (!cmd_job_ids(tok, out, ids)) {
+            return false;
+        }
+        bool ret = true;
+        for (const uint64_t id : ids) {
+            if (!parser_.jobs().kill(id)) {
+                cmd_locale_t::no_job(out, id);
+                ret = false;
+            }
+        }
+        return ret;
+    }
+};
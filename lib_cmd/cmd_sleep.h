@@ -0,0 +1,60 @@
+#pragma once
+#include "cmd.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+struct cmd_sleep_t : public cmd_t {
+    static constexpr const char* NAME = "sleep";
+
+    cmd_sleep_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        usage_ = "ms";
+        desc_ = "wait for a number of milliseconds";
+        concurrent_ = true;
+    }
+
+    /// @brief sleep in slices so that a cancelled sleep returns promptly.
+    ///
+    /// @return false if cancelled.
+    static bool sleep(uint64_t ms, const cmd_cancel_t* cancel)
+    {
+        const auto slice = std::chrono::milliseconds(10);
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        for (auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now()) {
+            if (cancel && cancel->cancelled()) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(end - now, slice));
+        }
+        return true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        uint64_t ms;
+        if (!tok.tokens.get(ms)) {
+            return on_usage(out, user), false;
+        }
+        return sleep(ms, tok.cancel_);
+    }
+
+    virtual std::future<bool> on_execute_async(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        uint64_t ms;
+        if (!tok.tokens.get(ms)) {
+            return cmd_t::on_execute_async(tok, out, user);
+        }
+        // wait off the calling thread, the output stream and the cancel
+        // token outlive the future
+        const cmd_cancel_t* cancel = tok.cancel_;
+        return std::async(std::launch::async, [ms, cancel, &out]() {
+            if (!sleep(ms, cancel)) {
+                return false;
+            }
+            out.println(CMD_FMT("slept {} ms"), ms);
+            return true;
+        });
+    }
+};
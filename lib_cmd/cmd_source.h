@@ -0,0 +1,115 @@
+#pragma once
+#include "cmd.h"
+#include <chrono>
+
+struct cmd_source_t : public cmd_t {
+    static constexpr const char* NAME = "source";
+
+    /// @brief limit on scripts sourcing scripts.
+    static const uint32_t MAX_DEPTH = 16;
+
+    cmd_source_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+        , depth_(0)
+    {
+        usage_ = "file [-c] [-p]";
+        desc_ = "execute each line of a script, -c to continue after errors, -p to run in parallel";
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        // '-c file' is tokenized as a pair, 'file -c' as a flag
+        cmd_token_t path;
+        const bool cont = tok.pairs.get("-c", path) || tok.flags.get("-c");
+        const bool para = tok.pairs.get("-p", path) || tok.flags.get("-p");
+        if (path.get().empty()) {
+            if (tok.tokens.empty()) {
+                return on_usage(out, user);
+            }
+            path = tok.tokens.front();
+        }
+        if (depth_ >= MAX_DEPTH) {
+            cmd_locale_t::error(out, "scripts nested too deeply");
+            return false;
+        }
+        cmd_file_map_t file;
+        if (!file.open(path.c_str())) {
+            cmd_locale_t::unable_to_open(out, path.c_str());
+            return false;
+        }
+        ++depth_;
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t executed = 0;
+        // the executor is not reentrant so nested scripts run serially, as
+        // do scripts sourced by a session since the executor uses the parser
+        cmd_state_t& context = state(tok);
+        const bool ret = (para && depth_ == 1 && &context == &parser_) ?
+            run_parallel(file.view(), path.c_str(), out, user, executed) :
+            run_serial(file.view(), path.c_str(), cont, context, tok.cancel_, out, user, executed);
+        --depth_;
+        const auto end = std::chrono::steady_clock::now();
+        const double secs = std::chrono::duration<double>(end - start).count();
+        cmd_locale_t::script_summary(out, executed, secs);
+        return ret;
+    }
+
+protected:
+    uint32_t depth_;
+    std::unique_ptr<cmd_executor_t> executor_;
+
+    /// @brief return true if a line should be skipped.
+    static bool is_blank(std::string_view line)
+    {
+        // skip blank lines and comments
+        const size_t first = line.find_first_not_of(" \r\t");
+        return first == line.npos || line[first] == '#';
+    }
+
+    bool run_serial(std::string_view text, const char* path, bool cont,
+        cmd_state_t& context, cmd_cancel_t* cancel, cmd_output_t& out, cmd_baton_t user, uint64_t& executed)
+    {
+        uint64_t line_num = 0;
+        bool ret = true;
+        for (size_t ix = 0; ix < text.size();) {
+            size_t next = text.find('\n', ix);
+            next = (next == text.npos) ? text.size() : next;
+            const std::string_view line = text.substr(ix, next - ix);
+            ix = next + 1;
+            ++line_num;
+            if (is_blank(line)) {
+                continue;
+            }
+            ++executed;
+            // nested lines share the scripts token, so stop with them
+            if (!parser_.execute_line(line, &out, user, &context, cancel)) {
+                cmd_locale_t::script_error(out, path, line_num);
+                ret = false;
+                if (!cont || (cancel && cancel->cancelled())) {
+                    break;
+                }
+            }
+        }
+        return ret;
+    }
+
+    // parallel scripts always continue after errors
+    bool run_parallel(std::string_view text, const char* path,
+        cmd_output_t& out, cmd_baton_t user, uint64_t& executed)
+    {
+        std::vector<std::string_view> lines;
+        for (size_t ix = 0; ix < text.size();) {
+            size_t next = text.find('\n', ix);
+            next = (next == text.npos) ? text.size() : next;
+            const std::string_view line = text.substr(ix, next - ix);
+            ix = next + 1;
+            // keep blank entries so indices match line numbers
+            lines.push_back(is_blank(line) ? std::string_view() : line);
+            executed += lines.back().empty() ? 0 : 1;
+        }
+        if (!executor_) {
+            executor_.reset(new cmd_executor_t(parser_));
+        }
+        // errors are reported in line order along with the output
+        return executor_->execute_lines(lines.data(), lines.size(), out, user, nullptr, path);
+    }
+};
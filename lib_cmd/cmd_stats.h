@@ -0,0 +1,73 @@
+#pragma once
+#include "cmd.h"
+
+struct cmd_stats_t : public cmd_t {
+    static constexpr const char* NAME = "stats";
+
+    struct cmd_stats_reset_t : public cmd_t {
+        static constexpr const char* NAME = "reset";
+
+        cmd_stats_reset_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+            : cmd_t(NAME, cli, parent, user)
+        {
+            desc_ = "clear the statistics of all commands";
+            concurrent_ = true;
+        }
+
+        void walk(const cmd_list_t& list)
+        {
+            for (const auto& cmd : list) {
+                cmd->stats_.reset();
+                walk(cmd->sub_);
+            }
+        }
+
+        virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+        {
+            (void)tok, (void)out, (void)user;
+            const auto lock = parser_.write_lock();
+            walk(parser_.sub_);
+            return true;
+        }
+    };
+
+    cmd_stats_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        desc_ = "list execution statistics of all commands";
+        concurrent_ = true;
+        add_sub_commands<cmd_stats_reset_t>();
+    }
+
+    void walk(const cmd_list_t& list, cmd_output_t& out)
+    {
+        auto indent = out.indent(2);
+        for (const auto& cmd : list) {
+            assert(cmd);
+            const cmd_counters_t& stats = cmd->stats_;
+            const uint64_t calls = stats.calls_.load(std::memory_order_relaxed);
+            if (calls) {
+                const cmd_histogram_t& latency = stats.latency_ns_;
+                cmd_locale_t::command_stats(out, cmd->name_, calls,
+                    stats.failures_.load(std::memory_order_relaxed),
+                    double(stats.total_ns_.load(std::memory_order_relaxed)) / 1e6,
+                    double(latency.percentile(0.5)) / 1e3,
+                    double(latency.percentile(0.99)) / 1e3,
+                    double(latency.max()) / 1e3);
+            } else {
+                out.println(CMD_FMT("{}"), cmd->name_);
+            }
+            if (!cmd->sub_.empty()) {
+                walk(cmd->sub_, out);
+            }
+        }
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)tok, (void)user;
+        const auto lock = parser_.write_lock();
+        walk(parser_.sub_, out);
+        return true;
+    }
+};
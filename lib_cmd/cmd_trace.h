@@ -0,0 +1,83 @@
+#pragma once
+#include "cmd.h"
+
+struct cmd_trace_t : public cmd_t {
+    static constexpr const char* NAME = "trace";
+
+    struct cmd_trace_start_t : public cmd_t {
+        static constexpr const char* NAME = "start";
+
+        cmd_trace_start_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+            : cmd_t(NAME, cli, parent, user)
+        {
+            desc_ = "start recording execution spans";
+        }
+
+        virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+        {
+            (void)tok, (void)out, (void)user;
+            parser_.set_tracer(&static_cast<cmd_trace_t*>(parent_)->tracer_);
+            return true;
+        }
+    };
+
+    struct cmd_trace_stop_t : public cmd_t {
+        static constexpr const char* NAME = "stop";
+
+        cmd_trace_stop_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+            : cmd_t(NAME, cli, parent, user)
+        {
+            desc_ = "stop recording execution spans";
+        }
+
+        virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+        {
+            (void)tok, (void)out, (void)user;
+            if (parser_.tracer() == &static_cast<cmd_trace_t*>(parent_)->tracer_) {
+                parser_.set_tracer(nullptr);
+            }
+            return true;
+        }
+    };
+
+    struct cmd_trace_dump_t : public cmd_t {
+        static constexpr const char* NAME = "dump";
+
+        cmd_trace_dump_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+            : cmd_t(NAME, cli, parent, user)
+        {
+            usage_ = "file";
+            desc_ = "write recorded spans as Chrome trace JSON";
+        }
+
+        virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+        {
+            std::string path;
+            if (!tok.tokens.get(path)) {
+                return on_usage(out, user), false;
+            }
+            if (!static_cast<cmd_trace_t*>(parent_)->tracer_.dump(path.c_str())) {
+                return cmd_locale_t::unable_to_open(out, path.c_str()), false;
+            }
+            return true;
+        }
+    };
+
+    cmd_trace_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        desc_ = "record execution spans for chrome://tracing or Perfetto";
+        add_sub_commands<cmd_trace_start_t, cmd_trace_stop_t, cmd_trace_dump_t>();
+    }
+
+    ~cmd_trace_t()
+    {
+        // the parser must not record into a destroyed tracer
+        if (parser_.tracer() == &tracer_) {
+            parser_.set_tracer(nullptr);
+        }
+    }
+
+    /// @brief spans recorded while started.
+    cmd_tracer_t tracer_;
+};
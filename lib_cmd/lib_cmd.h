@@ -5,3 +5,8 @@
 #include "cmd_expr.h"
 #include "cmd_help.h"
 #include "cmd_history.h"
+#include "cmd_jobs.h"
+#include "cmd_sleep.h"
+#include "cmd_source.h"
+#include "cmd_stats.h"
+#include "cmd_trace.h"
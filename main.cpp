@@ -1,10 +1,13 @@
 #include "lib_cmd/cmd_echo.h"
 #include "lib_cmd/lib_cmd.h"
 #include <array>
+#include <cstring>
 
 struct cmd_exit_t : public cmd_t {
+    static constexpr const char* NAME = "exit";
+
     cmd_exit_t(cmd_parser_t& parser, cmd_t* parent, cmd_baton_t user)
-        : cmd_t("exit", parser, parent, user)
+        : cmd_t(NAME, parser, parent, user)
     {
         desc_ = "exit the program";
     }
@@ -12,11 +15,20 @@ struct cmd_exit_t : public cmd_t {
     bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
     {
         (void)user;
+        // output of the line so far is still buffered
+        out.flush();
         exit(0);
         return false;
     }
 };
 
+// print the prompt, written out when the guard is released
+static void prompt(cmd_output_t& out)
+{
+    const auto guard = out.guard();
+    out.print<false>("> ");
+}
+
 int main(const int argc, const char** args)
 {
     // input stream buffer
@@ -24,16 +36,32 @@ int main(const int argc, const char** args)
     buffer.fill('\0');
     // create command parser and register command
     cmd_parser_t parser;
-    parser.add_command<cmd_exit_t>();
-    parser.add_command<cmd_help_t>();
-    parser.add_command<cmd_alias_t>();
-    parser.add_command<cmd_echo_t>();
-    parser.add_command<cmd_expr_t>();
-    parser.add_command<cmd_history_t>();
-    // create output stream
-    std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_stdio(stdout));
+    parser.add_commands<cmd_exit_t,
+        cmd_help_t,
+        cmd_alias_t,
+        cmd_echo_t,
+        cmd_expr_t,
+        cmd_history_t,
+        cmd_jobs_t,
+        cmd_kill_t,
+        cmd_sleep_t,
+        cmd_source_t,
+        cmd_stats_t,
+        cmd_trace_t,
+        cmd_wait_t>();
+    // allow lines ending in '&' to run as background jobs
+    parser.set_concurrent();
+    // create output stream, written once per command
+    std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_buffered(stdout));
+    // run any script passed on the command line
+    if (argc > 1) {
+        const std::string source = std::string(cmd_source_t::NAME) + " " + args[1];
+        return parser.execute(source, out.get(), nullptr) ? 0 : 1;
+    }
+    // commands can complete while waiting for more input
+    cmd_async_t async(parser);
     // REPL (read-eval-print loop)
-    out->print<false>("> ");
+    prompt(*out);
     while (fgets(buffer.data(), buffer.size(), stdin)) {
         const size_t size = strnlen(buffer.data(), buffer.size());
         buffer.data()[size ? size - 1 : 0] = '\0';
@@ -41,9 +69,14 @@ int main(const int argc, const char** args)
         if (string.empty()) {
             break;
         }
-        if (!parser.execute(string, out.get(), nullptr)) {
-        }
-        out->print<false>("> ");
+        async.execute(string, out.get(), nullptr);
+        prompt(*out);
+    }
+    async.wait(out.get());
+    {
+        // background jobs write to the output stream
+        const auto guard = out->guard();
+        parser.jobs().wait_all(*out);
     }
     // exit
     return 0;
@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../lib_cmd/cmd.h"
+
+// output collecting everything printed, for use from one thread at a time
+struct cmd_output_text_t : public cmd_output_t {
+    std::string text_;
+
+    virtual void lock() override {}
+    virtual void unlock() override {}
+
+    virtual void print(bool ind, const char* fmt, va_list& args) override
+    {
+        if (ind) {
+            text_.append(indent_, ' ');
+        }
+        va_list copy;
+        va_copy(copy, args);
+        const int len = vsnprintf(nullptr, 0, fmt, copy);
+        va_end(copy);
+        const size_t old = text_.size();
+        text_.resize(old + len + 1);
+        vsnprintf(&text_[old], len + 1, fmt, args);
+        text_.resize(old + len);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        print(ind, fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        text_.push_back('\n');
+    }
+};
+
+// text output shared with other threads through its guard
+struct cmd_output_shared_t : public cmd_output_text_t {
+    std::mutex mux_;
+
+    virtual void lock() override
+    {
+        mux_.lock();
+    }
+
+    virtual bool try_lock() override
+    {
+        return mux_.try_lock();
+    }
+
+    virtual void unlock() override
+    {
+        mux_.unlock();
+    }
+
+    std::string take()
+    {
+        const auto lock = guard();
+        std::string text;
+        text.swap(text_);
+        return text;
+    }
+
+    // wait until the output holds a string
+    bool wait_for(const char* str)
+    {
+        for (int i = 0; i < 2000; ++i) {
+            {
+                const auto lock = guard();
+                if (text_.find(str) != std::string::npos) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+};
+
+// output discarding everything printed
+struct cmd_output_null_t : public cmd_output_t {
+    virtual void lock() override {}
+    virtual void unlock() override {}
+    virtual void print(bool, const char*, va_list&) override {}
+    virtual void println(bool, const char*, va_list&) override {}
+    virtual void eol() override {}
+};
+
+// concurrent command counting its executions
+struct cmd_count_t : public cmd_t {
+    static constexpr const char* NAME = "count";
+    std::atomic<uint32_t> exec_;
+
+    cmd_count_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_count_t(cli, NAME, parent, user)
+    {
+    }
+
+    cmd_count_t(cmd_parser_t& cli, const char* name, cmd_t* parent = nullptr, cmd_baton_t user = nullptr)
+        : cmd_t(name, cli, parent, user)
+        , exec_(0)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)tok, (void)out, (void)user;
+        ++exec_;
+        return true;
+    }
+};
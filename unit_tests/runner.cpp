@@ -14,6 +14,26 @@ void init() {
     TEST(init_test_1);
     TEST(init_test_2);
     TEST(init_test_strtoll);
+    TEST(init_test_tokens);
+    TEST(init_test_arena);
+    TEST(init_test_trie);
+    TEST(init_test_static);
+    TEST(init_test_cache);
+    TEST(init_test_fuzzy);
+    TEST(init_test_levenshtein);
+    TEST(init_test_prepared);
+    TEST(init_test_batch);
+    TEST(init_test_source);
+    TEST(init_test_executor);
+    TEST(init_test_dag);
+    TEST(init_test_concurrent);
+    TEST(init_test_session);
+    TEST(init_test_async);
+    TEST(init_test_cancel);
+    TEST(init_test_jobs);
+    TEST(init_test_stats);
+    TEST(init_test_trace);
+    TEST(init_test_output);
 }
 
 int main(int argc, char** args)
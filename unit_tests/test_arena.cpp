@@ -0,0 +1,79 @@
+#include "runner.h"
+
+namespace {
+struct cmd_args_t : public cmd_t {
+
+    uint32_t calls_;
+
+    cmd_args_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("args", cli, parent, user)
+        , calls_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        calls_ += tok.tokens.size() == 3 && tok.flags.get("-v") ? 1 : 0;
+        return true;
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_arena() const
+    {
+        cmd_arena_t arena(64);
+        const auto mark = arena.mark();
+        void* a = arena.alloc(3, 1);
+        void* b = arena.alloc(8, 8);
+        CHECK(a && b && (uintptr_t(b) & 7) == 0);
+        // force a second block
+        CHECK(arena.alloc(256, 16));
+        CHECK(arena.num_allocs() == 2);
+        // rewinding should reuse the same memory
+        arena.rewind(mark);
+        CHECK(arena.alloc(3, 1) == a);
+        arena.reset();
+        CHECK(arena.alloc(256, 16));
+        CHECK(arena.num_allocs() == 2);
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_arena());
+
+        cmd_parser_t parser;
+        cmd_args_t* cmd = parser.add_command<cmd_args_t>();
+        cmd_output_t* output = cmd_output_t::create_output_dummy();
+        parser.idents_["some_identifier"] = 42;
+
+        const char* line = "args one two -key value $some_identifier -v";
+        // warm up the token pool
+        for (int i = 0; i < 4; ++i) {
+            CHECK(parser.execute(line, output, nullptr));
+        }
+        const uint64_t allocs = parser.tokens_pool_.num_allocs();
+        CHECK(allocs > 0);
+        for (int i = 0; i < 1000; ++i) {
+            CHECK(parser.execute(line, output, nullptr));
+        }
+        CHECK(cmd->calls_ == 1004);
+        // nothing should have been allocated after warm up
+        CHECK(parser.tokens_pool_.num_allocs() == allocs);
+        delete output;
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_arena()
+{
+    return new test_t();
+}
@@ -0,0 +1,145 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_sleep.h"
+
+namespace {
+// command completing when the test opens its gate
+struct cmd_gate_t : public cmd_t {
+    static constexpr const char* NAME = "gate";
+
+    struct pending_t {
+        std::string arg_;
+        cmd_output_t* out_;
+        std::promise<bool> done_;
+    };
+    std::vector<pending_t> pending_;
+
+    cmd_gate_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+    }
+
+    virtual std::future<bool> on_execute_async(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        pending_.emplace_back();
+        pending_t& pending = pending_.back();
+        pending.arg_ = tok.tokens.empty() ? "" : tok.tokens.front().get();
+        pending.out_ = &out;
+        out.println("%s started", pending.arg_.c_str());
+        return pending.done_.get_future();
+    }
+
+    void open(const std::string& arg, bool ok)
+    {
+        for (pending_t& pending : pending_) {
+            if (pending.arg_ == arg && pending.out_) {
+                pending.out_->println("%s finished", arg.c_str());
+                pending.out_ = nullptr;
+                pending.done_.set_value(ok);
+            }
+        }
+    }
+
+    // releases anything still waiting so a failed test can not hang
+    struct release_t {
+        cmd_gate_t& gate_;
+
+        release_t(cmd_gate_t& gate)
+            : gate_(gate)
+        {
+        }
+
+        ~release_t()
+        {
+            for (pending_t& pending : gate_.pending_) {
+                if (pending.out_) {
+                    pending.out_ = nullptr;
+                    pending.done_.set_value(false);
+                }
+            }
+        }
+    };
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_gate_t* gate = parser.add_command<cmd_gate_t>();
+        parser.add_commands<cmd_echo_t, cmd_sleep_t>();
+        cmd_output_shared_t out;
+        cmd_async_t async(parser);
+        cmd_gate_t::release_t release(*gate);
+
+        // commands that complete at once are delivered without a banner
+        CHECK(async.execute("gate a; echo now; gate b", &out, nullptr) == 3);
+        CHECK(async.num_pending() == 2);
+        CHECK(out.text_.find("now") != std::string::npos);
+        CHECK(out.text_.find("started") == std::string::npos);
+        CHECK(async.poll(&out) == 0);
+
+        // output is delivered in completion order, whole and attributed,
+        // without waiting for the next poll
+        out.take();
+        gate->open("b", true);
+        CHECK(out.wait_for("[3] done: gate b"));
+        CHECK(out.take() == "  b started\n  b finished\n  [3] done: gate b\n");
+        CHECK(async.num_pending() == 2);
+        gate->open("a", false);
+        CHECK(!async.wait(&out));
+        CHECK(out.text_.find("  a started\n  a finished\n") == 0);
+        CHECK(out.text_.find("[1] failed: gate a") != std::string::npos);
+        CHECK(async.num_pending() == 0);
+
+        // resolution errors complete immediately
+        out.text_.clear();
+        async.execute("bogus", &out, nullptr);
+        CHECK(async.num_pending() == 0);
+        CHECK(out.text_.find("command failed") != std::string::npos);
+        CHECK(parser.history_.back() == "bogus");
+
+        // nothing after the end of a line buffer is executed
+        out.text_.clear();
+        const std::string buffer("echo new\0; echo old", 19);
+        async.execute(buffer, &out, nullptr);
+        CHECK(out.text_.find("new") != std::string::npos);
+        CHECK(out.text_.find("old") == std::string::npos);
+
+        // several commands wait at the same time
+        out.text_.clear();
+        const auto start = std::chrono::steady_clock::now();
+        async.execute("sleep 100; sleep 100; sleep 100", &out, nullptr);
+        CHECK(async.wait(&out));
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        CHECK(elapsed < std::chrono::milliseconds(250));
+        size_t slept = 0;
+        for (size_t ix = 0; (ix = out.text_.find("slept 100 ms", ix)) != std::string::npos; ++ix) {
+            ++slept;
+        }
+        CHECK(slept == 3);
+
+        // commands still running are cancelled when the tasks are dropped
+        const auto begin = std::chrono::steady_clock::now();
+        {
+            cmd_async_t dropped(parser);
+            dropped.execute("sleep 100000", &out, nullptr);
+            CHECK(dropped.num_pending() == 1);
+        }
+        CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds(5));
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_async()
+{
+    return new test_t();
+}
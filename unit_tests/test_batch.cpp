@@ -0,0 +1,91 @@
+#include "runner.h"
+
+namespace {
+struct cmd_check_t : public cmd_t {
+    uint32_t exec_;
+
+    cmd_check_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("check", cli, parent, user)
+        , exec_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out;
+        (void)user;
+        ++exec_;
+        // succeed only when asked to
+        return tok.tokens.size() == 1 && tok.tokens.front() == "ok";
+    }
+};
+
+struct cmd_output_count_t : public cmd_output_t {
+    uint32_t locks_;
+    uint32_t flushes_;
+
+    cmd_output_count_t()
+        : locks_(0)
+        , flushes_(0)
+    {
+    }
+
+    virtual void lock() override { ++locks_; }
+    virtual void unlock() override {}
+    virtual void print(bool, const char*, va_list&) override {}
+    virtual void println(bool, const char*, va_list&) override {}
+    virtual void eol() override {}
+    virtual void flush() override { ++flushes_; }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_check_t* check = parser.add_command<cmd_check_t>();
+        cmd_output_count_t output;
+        std::vector<bool> status;
+
+        // per line status for a span of lines
+        const std::string_view lines[] = {
+            "check ok",
+            "check fail",
+            "",
+            "check ok; check ok",
+            "check ok; check fail; check ok",
+            "bogus",
+        };
+        CHECK(!parser.execute_batch(lines, 6, &output, nullptr, &status));
+        CHECK(status.size() == 6);
+        CHECK(status[0] && !status[1] && status[2] && status[3] && !status[4] && !status[5]);
+        // the expression after a failure on the same line is not executed
+        CHECK(check->exec_ == 6);
+        CHECK(output.locks_ == 1 && output.flushes_ == 1);
+        CHECK(parser.history_.back() == "bogus");
+
+        // a buffer is split into lines, blank lines do not repeat commands
+        const std::string buffer = "check ok\n\n  \r\ncheck ok\r\ncheck fail";
+        CHECK(!parser.execute_batch(buffer, &output, nullptr, &status));
+        CHECK(status.size() == 5);
+        CHECK(status[0] && status[1] && status[2] && status[3] && !status[4]);
+        CHECK(check->exec_ == 9);
+        CHECK(output.locks_ == 2 && output.flushes_ == 2);
+
+        // all lines succeeding
+        CHECK(parser.execute_batch("check ok\ncheck ok\n", &output, nullptr, &status));
+        CHECK(status.size() == 2);
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_batch()
+{
+    return new test_t();
+}
@@ -0,0 +1,88 @@
+#include "runner.h"
+
+namespace {
+struct cmd_leaf_t : public cmd_t {
+    uint32_t exec_;
+
+    cmd_leaf_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("leaf", cli, parent, user)
+        , exec_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        // arguments must still arrive with the path removed
+        exec_ += (tok.tokens.size() == 1 && tok.tokens.front() == "arg") ? 1 : 0;
+        return true;
+    }
+};
+
+struct cmd_stat_t : public cmd_t {
+    cmd_leaf_t* leaf_;
+
+    cmd_stat_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("stat", cli, parent, user)
+    {
+        leaf_ = add_sub_command<cmd_leaf_t>();
+    }
+};
+
+struct cmd_store_t : public cmd_t {
+    cmd_store_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("store", cli, parent, user)
+    {
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_stat_t* stat = parser.add_command<cmd_stat_t>();
+        cmd_output_t* output = cmd_output_t::create_output_dummy();
+        cmd_path_cache_t& cache = parser.path_cache_;
+
+        // first execution resolves and caches "st" and "st le"
+        CHECK(parser.execute("st le arg", output, nullptr));
+        CHECK(cache.size() == 2 && cache.misses_ == 1);
+        for (int i = 0; i < 10; ++i) {
+            CHECK(parser.execute("st le arg", output, nullptr));
+        }
+        CHECK(cache.hits_ == 10 && stat->leaf_->exec_ == 11);
+
+        // aliases are cached like any other path
+        CHECK(parser.alias_add(stat->leaf_, "l"));
+        CHECK(cache.size() == 0);
+        CHECK(parser.execute("l arg; l arg", output, nullptr));
+        CHECK(cache.hits_ == 11 && stat->leaf_->exec_ == 13);
+        CHECK(parser.alias_remove("l"));
+        CHECK(!parser.execute("l arg", output, nullptr));
+
+        // adding a command must make "st" ambiguous again
+        CHECK(parser.execute("st le arg", output, nullptr));
+        parser.add_command<cmd_store_t>();
+        CHECK(!parser.execute("st le arg", output, nullptr));
+        CHECK(stat->leaf_->exec_ == 14);
+
+        // the cache is bounded
+        cache.capacity_ = 1;
+        CHECK(parser.execute("stat leaf arg", output, nullptr));
+        CHECK(cache.size() == 1);
+        delete output;
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_cache()
+{
+    return new test_t();
+}
@@ -0,0 +1,264 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_sleep.h"
+
+namespace {
+// command running until it is cancelled
+struct cmd_spin_t : public cmd_t {
+    static constexpr const char* NAME = "spin";
+    std::atomic<uint32_t> running_;
+
+    cmd_spin_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+        , running_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out, (void)user;
+        if (!tok.cancel_) {
+            return false;
+        }
+        ++running_;
+        while (!tok.cancelled()) {
+            std::this_thread::yield();
+        }
+        return false;
+    }
+};
+
+// command ignoring its token until the test releases it
+struct cmd_stuck_t : public cmd_t {
+    static constexpr const char* NAME = "stuck";
+    std::atomic<bool> running_;
+    std::atomic<bool> release_;
+
+    cmd_stuck_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+        , running_(false)
+        , release_(false)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)tok, (void)out, (void)user;
+        running_ = true;
+        // gives up eventually so a failing test can not hang
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (!release_ && std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+};
+
+// command cancelling its own execution
+struct cmd_stop_t : public cmd_t {
+    static constexpr const char* NAME = "stop";
+
+    cmd_stop_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out, (void)user;
+        if (tok.cancel_) {
+            tok.cancel_->cancel();
+        }
+        return true;
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_token()
+    {
+        cmd_cancel_t token;
+        CHECK(!token.has_deadline());
+        CHECK(!token.cancelled());
+        token.cancel();
+        CHECK(token.cancelled());
+        cmd_cancel_t timeout(std::chrono::milliseconds(20));
+        CHECK(timeout.has_deadline());
+        CHECK(!timeout.cancelled());
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        CHECK(timeout.cancelled());
+        return true;
+    }
+
+    bool test_execute()
+    {
+        cmd_parser_t parser;
+        cmd_spin_t* spin = parser.add_command<cmd_spin_t>();
+        parser.add_commands<cmd_echo_t, cmd_stop_t, cmd_sleep_t>();
+        cmd_output_text_t out;
+
+        // without a token a command can not be cancelled
+        CHECK(!parser.execute("spin", &out, nullptr));
+        CHECK(spin->running_ == 0);
+
+        // a deadline stops the command and the rest of the line
+        out.text_.clear();
+        cmd_cancel_t deadline(std::chrono::milliseconds(20));
+        CHECK(!parser.execute("spin; echo after", &out, nullptr, &deadline));
+        CHECK(spin->running_ == 1);
+        CHECK(out.text_.find("command cancelled: 'spin'") != std::string::npos);
+        CHECK(out.text_.find("after") == std::string::npos);
+
+        // a token cancelled from another thread
+        cmd_cancel_t token;
+        std::thread canceller([&]() {
+            while (spin->running_ != 2) {
+                std::this_thread::yield();
+            }
+            token.cancel();
+        });
+        CHECK(!parser.execute("spin", &out, nullptr, &token));
+        canceller.join();
+
+        // cancelled batches fail their remaining lines
+        out.text_.clear();
+        cmd_cancel_t batch;
+        std::vector<bool> status;
+        CHECK(!parser.execute_batch("echo one\nstop\necho two\necho three\n", &out, nullptr, &status, &batch));
+        CHECK(status.size() == 4 && status[0] && status[1] && !status[2] && !status[3]);
+        CHECK(out.text_.find("one") != std::string::npos);
+        CHECK(out.text_.find("command cancelled: 'echo two'") != std::string::npos);
+        CHECK(out.text_.find("two\n") == std::string::npos);
+
+        // prepared commands see the token too
+        cmd_prepared_t prepared;
+        CHECK(parser.prepare("sleep 5000", prepared, &out));
+        cmd_cancel_t sleep(std::chrono::milliseconds(20));
+        const auto start = std::chrono::steady_clock::now();
+        CHECK(!parser.execute(prepared, &out, nullptr, nullptr, nullptr, 0, &sleep));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+        return true;
+    }
+
+    bool test_watchdog()
+    {
+        cmd_parser_t parser;
+        cmd_spin_t* spin = parser.add_command<cmd_spin_t>();
+        parser.add_commands<cmd_echo_t, cmd_sleep_t>();
+        cmd_output_text_t out, report;
+        {
+            cmd_watchdog_t watchdog(&report, std::chrono::milliseconds(20));
+            parser.set_watchdog(&watchdog);
+
+            // commands that finish in time are not reported
+            CHECK(parser.execute("echo fast", &out, nullptr));
+            CHECK(watchdog.num_overruns() == 0);
+
+            // commands that overrun are cancelled, even without a token
+            CHECK(!parser.execute("spin", &out, nullptr));
+            CHECK(spin->running_ == 1);
+            CHECK(watchdog.num_overruns() == 1);
+            CHECK(out.text_.find("command timed out: 'spin'") != std::string::npos);
+
+            // an earlier token deadline takes precedence over the limit
+            cmd_cancel_t token(std::chrono::milliseconds(5));
+            const auto start = std::chrono::steady_clock::now();
+            CHECK(!parser.execute("sleep 5000", &out, nullptr, &token));
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+            CHECK(watchdog.num_watched() == 0);
+
+            // asynchronous work is watched until it completes
+            const uint64_t overruns = watchdog.num_overruns();
+            {
+                cmd_async_t async(parser);
+                async.execute("sleep 100000", &out, nullptr);
+                CHECK(watchdog.num_watched() == 1);
+                CHECK(!async.wait(&out));
+            }
+            CHECK(watchdog.num_overruns() == overruns + 1);
+            CHECK(watchdog.num_watched() == 0);
+            CHECK(out.text_.find("command timed out: 'sleep 100000'") != std::string::npos);
+            parser.set_watchdog(nullptr);
+        }
+        {
+            // work completing in time is unwatched without being polled
+            cmd_watchdog_t watchdog(&report, std::chrono::milliseconds(100));
+            parser.set_watchdog(&watchdog);
+            {
+                cmd_async_t async(parser);
+                async.execute("sleep 10", &out, nullptr);
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                CHECK(watchdog.num_watched() == 0);
+                CHECK(async.wait(&out));
+            }
+            CHECK(watchdog.num_overruns() == 0);
+            parser.set_watchdog(nullptr);
+        }
+        CHECK(report.text_.find("overran its deadline: 'spin'") != std::string::npos);
+        CHECK(report.text_.find("echo") == std::string::npos);
+        return true;
+    }
+
+    bool test_stuck()
+    {
+        cmd_parser_t parser;
+        cmd_stuck_t* stuck = parser.add_command<cmd_stuck_t>();
+        parser.add_commands<cmd_sleep_t>();
+        parser.set_concurrent();
+        cmd_output_shared_t shared;
+        cmd_output_null_t out;
+        {
+            cmd_watchdog_t watchdog(&shared, std::chrono::milliseconds(50));
+            parser.set_watchdog(&watchdog);
+
+            // a command ignoring its token holds the report streams guard
+            std::thread holder([&]() {
+                parser.execute("stuck", &shared, nullptr);
+            });
+            while (!stuck->running_) {
+                std::this_thread::yield();
+            }
+            // so that its overrun is reported on its own
+            std::this_thread::sleep_for(std::chrono::milliseconds(25));
+
+            // other deadlines are still enforced meanwhile
+            const auto start = std::chrono::steady_clock::now();
+            const bool ok = parser.execute("sleep 5000", &out, nullptr);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const uint64_t overruns = watchdog.num_overruns();
+
+            // the reports are written once the guard is free
+            stuck->release_ = true;
+            holder.join();
+            CHECK(!ok);
+            CHECK(elapsed < std::chrono::seconds(1));
+            CHECK(overruns == 2);
+            CHECK(shared.wait_for("overran its deadline: 'sleep 5000'"));
+            CHECK(shared.wait_for("overran its deadline: 'stuck'"));
+            parser.set_watchdog(nullptr);
+        }
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_token());
+        CHECK(test_execute());
+        CHECK(test_watchdog());
+        CHECK(test_stuck());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_cancel()
+{
+    return new test_t();
+}
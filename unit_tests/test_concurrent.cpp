@@ -0,0 +1,232 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_expr.h"
+
+namespace {
+// object recording when it is freed
+struct tracked_t {
+    std::atomic<uint32_t>& freed_;
+
+    tracked_t(std::atomic<uint32_t>& freed)
+        : freed_(freed)
+    {
+    }
+
+    ~tracked_t()
+    {
+        ++freed_;
+    }
+};
+
+// command executing itself again until a depth is reached
+struct cmd_nest_t : public cmd_t {
+    uint32_t depth_;
+    uint32_t max_depth_;
+
+    cmd_nest_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("nest", cli, parent, user)
+        , depth_(0)
+        , max_depth_(0)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)tok;
+        max_depth_ = std::max(max_depth_, ++depth_);
+        const bool ok = depth_ >= 100 || parser_.execute("nest", &out, user);
+        --depth_;
+        return ok;
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_epoch()
+    {
+        cmd_epoch_t epoch;
+        std::atomic<uint32_t> freed(0);
+        // objects stay alive while a reader could see them
+        const size_t slot = epoch.enter();
+        epoch.retire(new tracked_t(freed));
+        CHECK(freed == 0);
+        CHECK(epoch.num_retired() == 1);
+        epoch.exit(slot);
+        CHECK(epoch.reclaim() == 1);
+        CHECK(freed == 1);
+        // later readers do not hold back earlier objects
+        const size_t late = epoch.enter();
+        epoch.retire(new tracked_t(freed));
+        epoch.exit(late);
+        const size_t after = epoch.enter();
+        epoch.retire(new tracked_t(freed));
+        CHECK(freed == 2);
+        epoch.exit(after);
+        epoch.reclaim();
+        CHECK(freed == 3);
+        CHECK(epoch.num_retired() == 0);
+        return true;
+    }
+
+    bool test_overflow()
+    {
+        cmd_epoch_t epoch;
+        std::atomic<uint32_t> freed(0);
+        // entering more sections than slots never waits
+        std::vector<size_t> slots;
+        for (size_t i = 0; i < cmd_epoch_t::MAX_READERS; ++i) {
+            slots.push_back(epoch.enter());
+            CHECK(slots.back() != cmd_epoch_t::OVERFLOW_SLOT);
+        }
+        const size_t extra = epoch.enter();
+        CHECK(extra == cmd_epoch_t::OVERFLOW_SLOT);
+        epoch.retire(new tracked_t(freed));
+        for (const size_t slot : slots) {
+            epoch.exit(slot);
+        }
+        // the overflow section still holds the object back
+        CHECK(epoch.reclaim() == 0);
+        CHECK(freed == 0);
+        epoch.exit(extra);
+        CHECK(epoch.reclaim() == 1);
+        CHECK(freed == 1);
+
+        // nested executions on one thread beyond the slot count
+        cmd_parser_t parser;
+        parser.set_concurrent();
+        cmd_nest_t* nest = parser.add_command<cmd_nest_t>();
+        cmd_output_null_t out;
+        CHECK(parser.execute("nest", &out, nullptr));
+        CHECK(nest->max_depth_ == 100);
+        return true;
+    }
+
+    bool test_parser()
+    {
+        static const size_t NUM_CMDS = 48;
+        static const size_t NUM_READERS = 3;
+        static const size_t NUM_EXECS = 3000;
+
+        cmd_parser_t parser;
+        parser.add_command<cmd_expr_t>();
+        parser.set_concurrent();
+        CHECK(parser.concurrent());
+
+        std::vector<std::string> names;
+        for (size_t i = 0; i < NUM_CMDS; ++i) {
+            names.push_back("cmd" + std::to_string(i));
+        }
+        std::vector<cmd_count_t*> cmds(NUM_CMDS, nullptr);
+        std::atomic<size_t> added(0);
+
+        // add commands and aliases while others execute
+        std::thread writer([&]() {
+            for (size_t i = 0; i < NUM_CMDS; ++i) {
+                cmd_t* cmd = new cmd_count_t(parser, names[i].c_str());
+                cmds[i] = (cmd_count_t*)parser.add_command(cmd);
+                parser.alias_add(cmds[i], "a" + std::to_string(i));
+                added.store(i + 1);
+                std::this_thread::yield();
+            }
+        });
+
+        std::vector<std::vector<uint32_t>> expect(NUM_READERS);
+        std::vector<uint32_t> failed(NUM_READERS, 0);
+        std::vector<std::thread> readers;
+        for (size_t r = 0; r < NUM_READERS; ++r) {
+            readers.emplace_back([&, r]() {
+                cmd_output_null_t out;
+                expect[r].assign(NUM_CMDS, 0);
+                const std::string var = "v" + std::to_string(r);
+                for (size_t i = 0; i < NUM_EXECS; ++i) {
+                    const size_t num = added.load();
+                    if (num == 0) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    const size_t k = (i * 7 + r) % num;
+                    std::string line = (i & 1) ? names[k] : "a" + std::to_string(k);
+                    // identifiers are written and read under their lock
+                    line += "; expr set " + var + " " + std::to_string(i);
+                    line += "; expr eval " + var + " + 1";
+                    failed[r] += !parser.execute(line, &out, nullptr);
+                    ++expect[r][k];
+                    // unknown names print suggestions from the snapshot
+                    if (i % 100 == 0) {
+                        failed[r] += parser.execute("cmdx", &out, nullptr);
+                    }
+                }
+            });
+        }
+        writer.join();
+        for (auto& thread : readers) {
+            thread.join();
+        }
+        for (size_t r = 0; r < NUM_READERS; ++r) {
+            CHECK(failed[r] == 0);
+        }
+        for (size_t k = 0; k < NUM_CMDS; ++k) {
+            uint32_t total = 0;
+            for (size_t r = 0; r < NUM_READERS; ++r) {
+                total += expect[r][k];
+            }
+            CHECK(cmds[k]->exec_ == total);
+        }
+        CHECK(parser.idents_.size() == NUM_READERS);
+        // late additions are visible to the next execution
+        cmd_output_null_t out;
+        CHECK(parser.execute("cmd47", &out, nullptr));
+        CHECK(parser.alias_remove("a47"));
+        CHECK(!parser.execute("a47", &out, nullptr));
+        return true;
+    }
+
+    bool test_idents()
+    {
+        cmd_parser_t parser;
+        parser.add_command<cmd_expr_t>();
+        parser.set_concurrent();
+        cmd_output_null_t out;
+        CHECK(parser.execute("expr set n 0", &out, nullptr));
+
+        // evaluations share a read lock, assignments stay atomic
+        std::vector<std::thread> threads;
+        std::atomic<uint32_t> failed(0);
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&, i]() {
+                cmd_output_null_t out;
+                for (int j = 0; j < 500; ++j) {
+                    const char* line = (i & 1) ? "expr eval n = n + 1" : "expr eval n * 2";
+                    failed += !parser.execute(line, &out, nullptr);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(failed == 0);
+        CHECK(parser.idents_["n"] == 1000);
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_epoch());
+        CHECK(test_overflow());
+        CHECK(test_parser());
+        CHECK(test_idents());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_concurrent()
+{
+    return new test_t();
+}
@@ -0,0 +1,93 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_expr.h"
+
+namespace {
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    // produce a script mixing independent and dependent expressions
+    static std::string make_script(uint32_t lines)
+    {
+        uint32_t seed = 12345;
+        auto rand = [&seed](uint32_t max) {
+            seed = seed * 1103515245u + 12345u;
+            return (seed >> 8) % max;
+        };
+        std::string script;
+        for (uint32_t i = 0; i < lines; ++i) {
+            const std::string a = "v" + std::to_string(rand(64));
+            const std::string b = "v" + std::to_string(rand(64));
+            const std::string c = std::to_string(rand(4));
+            switch (rand(20)) {
+            case 0:
+                script += "expr list";
+                break;
+            case 1:
+                script += "expr remove " + a;
+                break;
+            case 2:
+                script += "expr set " + a + " " + c;
+                break;
+            case 3:
+                script += "echo $" + a + " " + c;
+                break;
+            case 4:
+                script += "expr eval (" + a + " = 1) + " + c;
+                break;
+            case 5:
+                script += "expr eval " + a + " = " + b + " / " + c;
+                break;
+            case 6:
+                script += "expr eval " + a + " + $" + b;
+                break;
+            case 7:
+                script += "expr eval " + a + " = 1; expr eval " + b + " = " + a + " + 1";
+                break;
+            default:
+                script += "expr eval " + a + " = " + b + " + " + c;
+                break;
+            }
+            script += "\n";
+        }
+        return script;
+    }
+
+    virtual bool run() override
+    {
+        const std::string script = make_script(5000);
+
+        // serial reference
+        cmd_parser_t serial;
+        serial.add_commands<cmd_expr_t, cmd_echo_t>();
+        cmd_output_text_t serial_out;
+        std::vector<bool> serial_status;
+        serial.execute_batch(script, &serial_out, nullptr, &serial_status);
+
+        // the same script on the executor must be indistinguishable
+        cmd_parser_t parser;
+        parser.add_commands<cmd_expr_t, cmd_echo_t>();
+        cmd_output_text_t output;
+        std::vector<bool> status;
+        {
+            cmd_executor_t executor(parser, 4);
+            executor.execute(script, &output, nullptr, &status);
+        }
+        CHECK(status == serial_status);
+        CHECK(output.text_ == serial_out.text_);
+        CHECK(parser.idents_ == serial.idents_);
+        CHECK(parser.history_ == serial.history_);
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_dag()
+{
+    return new test_t();
+}
@@ -0,0 +1,102 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_expr.h"
+
+namespace {
+// concurrency safe command printing its arguments
+struct cmd_put_t : public cmd_t {
+    std::atomic<uint32_t> exec_;
+
+    cmd_put_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("put", cli, parent, user)
+        , exec_(0)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        ++exec_;
+        for (const cmd_token_t& token : tok.tokens.tokens_) {
+            // spin a little so that lines finish out of order
+            volatile uint32_t spin = uint32_t(token.get().size()) * 1000;
+            while (spin) {
+                spin = spin - 1;
+            }
+            out.print<false>("%s ", token.c_str());
+        }
+        out.eol();
+        return !tok.tokens.find("fail");
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_put_t* put = parser.add_command<cmd_put_t>();
+        parser.add_command<cmd_expr_t>();
+        cmd_executor_t executor(parser, 4);
+        CHECK(executor.num_threads() == 4);
+        std::vector<bool> status;
+
+        // output is emitted in line order regardless of completion order
+        {
+            std::string script, expect;
+            for (int i = 0; i < 3000; ++i) {
+                const std::string arg = std::string(i % 7, 'x') + std::to_string(i);
+                script.append("put " + arg + "\n");
+                expect.append(arg + " \n");
+            }
+            cmd_output_text_t output;
+            CHECK(executor.execute(script, &output, nullptr, &status));
+            CHECK(status.size() == 3000 && put->exec_ == 3000);
+            CHECK(output.text_ == expect);
+            CHECK(parser.history_.back() == "put xxx2999");
+        }
+
+        // non concurrent lines are barriers observing program order
+        {
+            const std::string_view lines[] = {
+                "expr set x 1",
+                "put $x; put a",
+                "expr set x 2",
+                "put $x fail",
+                "",
+                "bogus",
+                "put $x",
+            };
+            cmd_output_text_t output;
+            CHECK(!executor.execute(lines, 7, &output, nullptr, &status));
+            CHECK(status.size() == 7);
+            CHECK(status[0] && status[1] && status[2] && !status[3] && status[4] && !status[5] && status[6]);
+            const size_t one = output.text_.find("1 \na \n");
+            const size_t fail = output.text_.find("2 fail \n");
+            const size_t bogus = output.text_.find("invalid command");
+            const size_t two = output.text_.rfind("2 \n");
+            CHECK(one != std::string::npos && one < fail && fail < bogus && bogus < two);
+        }
+
+        // a single thread runs everything inline
+        {
+            cmd_executor_t inline_executor(parser, 1);
+            cmd_output_text_t output;
+            CHECK(inline_executor.execute("put a\nput b; put c\n", &output, nullptr, &status));
+            CHECK(output.text_ == "a \nb \nc \n");
+        }
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_executor()
+{
+    return new test_t();
+}
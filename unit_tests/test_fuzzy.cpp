@@ -0,0 +1,64 @@
+#include "runner.h"
+
+namespace {
+struct cmd_named_t : public cmd_t {
+    cmd_named_t(const char* name, cmd_parser_t& cli)
+        : cmd_t(name, cli, nullptr, nullptr)
+    {
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < 500; ++i) {
+            names.push_back("reg" + std::to_string((i * 7919) % 1000));
+        }
+        names.push_back("status");
+        names.push_back("start");
+        names.push_back("stop");
+        std::vector<std::unique_ptr<cmd_t>> cmds;
+        cmd_fuzzy_index_t index;
+        for (const std::string& name : names) {
+            cmds.emplace_back(new cmd_named_t(name.c_str(), parser));
+            index.insert(cmds.back()->name_, cmds.back().get(), false);
+        }
+        index.insert("stp", cmds.back().get(), true);
+
+        const char* queries[] = { "reg1", "reg99", "rg500", "stat", "sotp", "xyzzy", "stp" };
+        std::vector<cmd_fuzzy_index_t::match_t> found;
+        for (const char* q : queries) {
+            // brute force reference
+            size_t expect = 0;
+            for (const std::string& name : names) {
+                expect += cmd_util_t::levenshtein(name.c_str(), q) < 3 ? 1 : 0;
+            }
+            expect += cmd_util_t::levenshtein("stp", q) < 3 ? 1 : 0;
+            CHECK(index.find(q, cmd_fuzzy_index_t::FUZZYNESS, SIZE_MAX, found) == expect);
+            for (size_t i = 1; i < found.size(); ++i) {
+                CHECK(found[i - 1].distance_ <= found[i].distance_);
+            }
+        }
+        // results are limited and nearest first
+        CHECK(index.find("stp", 3, 2, found) == 2);
+        CHECK(found[0].distance_ == 0 && found[0].alias_ != nullptr);
+        index.remove_alias("stp");
+        CHECK(index.find("stp", 3, 2, found) == 1);
+        CHECK(found[0].distance_ == 1 && found[0].alias_ == nullptr);
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_fuzzy()
+{
+    return new test_t();
+}
@@ -0,0 +1,119 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_jobs.h"
+#include "../lib_cmd/cmd_sleep.h"
+
+namespace {
+// command running until it is cancelled
+struct cmd_spin_t : public cmd_t {
+    static constexpr const char* NAME = "spin";
+
+    cmd_spin_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out, (void)user;
+        while (!tok.cancelled()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        // jobs write to the output stream until the parser is destroyed
+        cmd_output_shared_t out;
+        cmd_parser_t parser;
+        parser.add_commands<cmd_echo_t, cmd_jobs_t, cmd_kill_t, cmd_sleep_t, cmd_spin_t, cmd_wait_t>();
+
+        // jobs need a parser that was made concurrent by its owner
+        CHECK(!parser.execute("echo no &", &out, nullptr));
+        CHECK(out.take() == "  background jobs need a concurrent parser\n");
+        parser.set_concurrent();
+
+        // a trailing '&' returns at once
+        CHECK(parser.execute("sleep 50; echo one &", &out, nullptr));
+        std::string text = out.take();
+        CHECK(text == "  [1] running: sleep 50; echo one\n");
+        CHECK(parser.execute("jobs", &out, nullptr));
+        CHECK(out.take().find("[1] running: sleep 50; echo one") != std::string::npos);
+
+        // waiting delivers the jobs output to the waiter
+        CHECK(parser.execute("wait 1", &out, nullptr));
+        text = out.take();
+        CHECK(text.find("one") != std::string::npos);
+        CHECK(text.find("[1] done: sleep 50; echo one") != std::string::npos);
+        CHECK(!parser.execute("wait 1", &out, nullptr));
+        CHECK(out.take().find("no job 1") != std::string::npos);
+
+        // killed jobs are cancelled and fail
+        CHECK(parser.execute("spin &", &out, nullptr));
+        CHECK(parser.execute("kill 2", &out, nullptr));
+        CHECK(!parser.execute("wait 2", &out, nullptr));
+        CHECK(out.take().find("[2] killed: spin") != std::string::npos);
+        CHECK(!parser.execute("kill 2", &out, nullptr));
+
+        // jobs deliver their own output when nobody waits
+        CHECK(parser.execute("echo bg &", &out, nullptr));
+        CHECK(out.wait_for("[3] done: echo bg"));
+        out.take();
+        CHECK(parser.execute("jobs", &out, nullptr));
+        CHECK(out.take().find("no jobs") != std::string::npos);
+
+        // a job can not wait for itself
+        CHECK(parser.execute("wait &", &out, nullptr));
+        CHECK(out.wait_for("[4] done: wait"));
+
+        // the REPL starts jobs through cmd_async_t
+        {
+            cmd_async_t async(parser);
+            CHECK(async.execute("sleep 20; echo async &", &out, nullptr) == 0);
+            CHECK(async.num_pending() == 0);
+            const auto guard = out.guard();
+            CHECK(parser.jobs().wait_all(out));
+        }
+        text = out.take();
+        CHECK(text.find("[5] running: sleep 20; echo async") != std::string::npos);
+        CHECK(text.find("[5] done: sleep 20; echo async") != std::string::npos);
+
+        // ids that are not numbers fail before any job is touched
+        CHECK(!parser.execute("wait x", &out, nullptr));
+        CHECK(out.take().find("invalid job id 'x'") != std::string::npos);
+        CHECK(parser.execute("spin &", &out, nullptr));
+        CHECK(!parser.execute("kill 6 x", &out, nullptr));
+        CHECK(out.take().find("invalid job id 'x'") != std::string::npos);
+        CHECK(parser.execute("jobs", &out, nullptr));
+        CHECK(out.take().find("[6] running: spin") != std::string::npos);
+        CHECK(parser.execute("kill 6", &out, nullptr));
+
+        // the parser cancels jobs still running when destroyed
+        const auto start = std::chrono::steady_clock::now();
+        {
+            cmd_parser_t other;
+            other.add_commands<cmd_sleep_t>();
+            other.set_concurrent();
+            CHECK(other.execute("sleep 100000 &", &out, nullptr));
+        }
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_jobs()
+{
+    return new test_t();
+}
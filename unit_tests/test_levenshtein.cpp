@@ -0,0 +1,95 @@
+#include "runner.h"
+
+#include <algorithm>
+
+namespace {
+
+// reference full matrix edit distance
+uint32_t reference(const std::string& a, const std::string& b)
+{
+    std::vector<uint32_t> prev(b.size() + 1), next(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        prev[j] = uint32_t(j);
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        next[0] = uint32_t(i);
+        for (size_t j = 1; j <= b.size(); ++j) {
+            const uint32_t sub = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            next[j] = std::min({ prev[j] + 1, next[j - 1] + 1, sub });
+        }
+        std::swap(prev, next);
+    }
+    return prev[b.size()];
+}
+
+struct test_t : public test_base_t {
+
+    uint32_t seed_;
+
+    test_t()
+        : test_base_t(__FILE__)
+        , seed_(12345)
+    {
+    }
+
+    uint32_t rand()
+    {
+        seed_ = seed_ * 1103515245 + 12345;
+        return (seed_ >> 16) & 0x7fff;
+    }
+
+    std::string random_string(size_t max_len)
+    {
+        std::string out(rand() % (max_len + 1), ' ');
+        for (char& ch : out) {
+            ch = "abcde_"[rand() % 6];
+        }
+        return out;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(cmd_util_t::levenshtein("kitten", "sitting") == 3);
+        CHECK(cmd_util_t::levenshtein("", "abc") == 3);
+        CHECK(cmd_util_t::levenshtein("abc", "") == 3);
+        CHECK(cmd_util_t::levenshtein("same", "same") == 0);
+        CHECK(cmd_util_t::levenshtein("kitten", "sitting", 2) == 2);
+
+        for (int i = 0; i < 2000; ++i) {
+            // mix of short, word sized and longer than 64 char strings
+            const size_t len = (i % 10 == 0) ? 100 : 12;
+            const std::string a = random_string(len);
+            const std::string b = random_string(len);
+            const uint32_t expect = reference(a, b);
+            CHECK(cmd_util_t::levenshtein(a.c_str(), b.c_str()) == expect);
+            const uint32_t max = rand() % 6;
+            CHECK(cmd_util_t::levenshtein(a.c_str(), b.c_str(), max) == std::min(expect, max));
+        }
+
+        // batch mode must agree with the scalar version, including odd counts
+        std::vector<std::string> names;
+        for (int i = 0; i < 37; ++i) {
+            names.push_back(random_string(i % 5 == 0 ? 80 : 10));
+        }
+        std::vector<const char*> ptrs;
+        for (const std::string& name : names) {
+            ptrs.push_back(name.c_str());
+        }
+        std::vector<uint32_t> dist(names.size());
+        for (int i = 0; i < 20; ++i) {
+            const std::string q = random_string(10);
+            const uint32_t max = 1 + rand() % 8;
+            cmd_util_t::levenshtein(q.c_str(), ptrs.data(), ptrs.size(), max, dist.data());
+            for (size_t j = 0; j < names.size(); ++j) {
+                CHECK(dist[j] == std::min(reference(q, names[j]), max));
+            }
+        }
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_levenshtein()
+{
+    return new test_t();
+}
@@ -0,0 +1,529 @@
+#include "runner.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_expr.h"
+#include "../lib_cmd/cmd_jobs.h"
+#include <algorithm>
+#include <unistd.h>
+
+namespace {
+// read everything written to a file so far
+std::string contents(FILE* fd)
+{
+    std::string text;
+    fflush(fd);
+    rewind(fd);
+    char buf[4096];
+    size_t size;
+    while ((size = fread(buf, 1, sizeof(buf), fd)) != 0) {
+        text.append(buf, size);
+    }
+    fseek(fd, 0, SEEK_END);
+    return text;
+}
+
+// split text into lines
+std::vector<std::string> lines(const std::string& text)
+{
+    std::vector<std::string> out;
+    size_t ix = 0, next;
+    while ((next = text.find('\n', ix)) != std::string::npos) {
+        out.push_back(text.substr(ix, next - ix));
+        ix = next + 1;
+    }
+    return out;
+}
+
+// pipe whose read end is drained on a thread once started
+struct pipe_t {
+    pipe_t()
+    {
+        int fds[2] = { -1, -1 };
+        if (::pipe(fds) == 0) {
+            read_ = fds[0];
+            write_ = fdopen(fds[1], "wb");
+        }
+    }
+
+    ~pipe_t()
+    {
+        close();
+        if (reader_.joinable()) {
+            reader_.join();
+        }
+        ::close(read_);
+    }
+
+    void start()
+    {
+        reader_ = std::thread([this]() {
+            char buf[4096];
+            ssize_t size;
+            while ((size = ::read(read_, buf, sizeof(buf))) > 0) {
+                text_.append(buf, size_t(size));
+            }
+        });
+    }
+
+    // close the write end and return everything read
+    std::string finish()
+    {
+        close();
+        reader_.join();
+        return text_;
+    }
+
+    void close()
+    {
+        if (write_) {
+            fclose(write_);
+            write_ = nullptr;
+        }
+    }
+
+    int read_ = -1;
+    FILE* write_ = nullptr;
+    std::thread reader_;
+    std::string text_;
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_buffered()
+    {
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_buffered(fd));
+
+        // nothing is written until the guard is released
+        {
+            const auto guard = out->guard();
+            out->println("one %d", 1);
+            auto indent = out->indent(2);
+            out->print("two");
+            out->print<false>(" %s", "three");
+            out->eol();
+            CHECK(contents(fd).empty());
+        }
+        CHECK(contents(fd) == "  one 1\n    two three\n");
+
+        // or flush() is called
+        out->print<false>("> ");
+        CHECK(contents(fd) == "  one 1\n    two three\n");
+        out->flush();
+        CHECK(contents(fd) == "  one 1\n    two three\n> ");
+
+        // lines spanning chunks and longer than a chunk are kept whole
+        std::string expect = contents(fd);
+        {
+            const auto guard = out->guard();
+            const std::string line(300, 'x');
+            const std::string large(10000, 'y');
+            for (int i = 0; i < 100; ++i) {
+                out->println<false>("%d %s", i, line.c_str());
+                expect += std::to_string(i) + " " + line + "\n";
+            }
+            out->println<false>("%s", large.c_str());
+            expect += large + "\n";
+            // deep indentation is longer than the run it is copied from
+            auto indent = out->indent(100);
+            out->println("z");
+            expect += std::string(102, ' ') + "z\n";
+        }
+        CHECK(contents(fd) == expect);
+
+        // enough output to write out early while a guard is held
+        {
+            const auto guard = out->guard();
+            const std::string line(1000, 'w');
+            for (int i = 0; i < 1000; ++i) {
+                out->println<false>("%s", line.c_str());
+                expect += line + "\n";
+            }
+            CHECK(contents(fd).size() > expect.size() - 1000 * 1001);
+        }
+        CHECK(contents(fd) == expect);
+        out.reset();
+        fclose(fd);
+        return true;
+    }
+
+    bool test_parser()
+    {
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_buffered(fd));
+        cmd_parser_t parser;
+        parser.add_command<cmd_echo_t>();
+
+        // written once each command or batch completes
+        std::string expect = "    tokens: hello \n       raw: hello \n"
+                             "    tokens: world \n       raw: world \n";
+        CHECK(parser.execute("echo hello; echo world", out.get(), nullptr));
+        CHECK(contents(fd) == expect);
+        expect += "    tokens: a \n       raw: a \n    tokens: b \n       raw: b \n";
+        CHECK(parser.execute_batch("echo a\necho b\n", out.get(), nullptr));
+        CHECK(contents(fd) == expect);
+        out.reset();
+        fclose(fd);
+        return true;
+    }
+
+    bool test_async()
+    {
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_async(fd));
+
+        // guarded output stays together and in order per thread
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&out, t]() {
+                for (int c = 0; c < 100; ++c) {
+                    const auto guard = out->guard();
+                    for (int l = 0; l < 3; ++l) {
+                        out->println<false>("%d %d %d", t, c, l);
+                    }
+                }
+                // unguarded calls are whole
+                for (int c = 100; c < 200; ++c) {
+                    out->println<false>("%d %d x", t, c);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        // threads that exit hand back their output, and may outlive a stream
+        for (int t = 0; t < 64; ++t) {
+            std::thread([&out, t]() {
+                out->println<false>("%d exited", t);
+                std::unique_ptr<cmd_output_t> temp(cmd_output_t::create_output_async(stderr));
+                temp->flush();
+            }).join();
+        }
+        out.reset();
+        std::vector<std::string> all = lines(contents(fd));
+        fclose(fd);
+        CHECK(all.size() == 4 * (300 + 100) + 64);
+        for (int t = 0; t < 64; ++t) {
+            CHECK(std::find(all.begin(), all.end(), std::to_string(t) + " exited") != all.end());
+        }
+        all.erase(std::remove_if(all.begin(), all.end(), [](const std::string& line) {
+            return line.find("exited") != std::string::npos;
+        }), all.end());
+        std::array<int, 4> next = { 0, 0, 0, 0 };
+        for (size_t i = 0; i < all.size(); ++i) {
+            int t, c, l;
+            if (sscanf(all[i].c_str(), "%d %d %d", &t, &c, &l) == 3) {
+                CHECK(t >= 0 && t < 4 && c < 100 && l == 0);
+                CHECK(c == next[t]);
+                next[t] = c + 1;
+                for (int j = 1; j < 3; ++j) {
+                    CHECK(all[i + j] == std::to_string(t) + " " + std::to_string(c) + " " + std::to_string(j));
+                }
+                i += 2;
+            } else {
+                CHECK(sscanf(all[i].c_str(), "%d %d", &t, &c) == 2);
+                CHECK(all[i] == std::to_string(t) + " " + std::to_string(c) + " x");
+            }
+        }
+        return true;
+    }
+
+    bool test_backpressure()
+    {
+        // the writer stalls on a full pipe until its reader is started
+        const std::string line(1000, 'z');
+        const int LINES = 200;
+        std::string expect;
+        for (int i = 0; i < LINES; ++i) {
+            expect += std::to_string(i) + line + "\n";
+        }
+        const auto fill = [&](cmd_output_t& out) {
+            for (int i = 0; i < LINES; ++i) {
+                out.println<false>("%d%s", i, line.c_str());
+            }
+        };
+        {
+            // blocked writes wait for room
+            pipe_t pipe;
+            CHECK(pipe.write_);
+            pipe.start();
+            std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_async(pipe.write_, cmd_output_t::e_block, 2));
+            fill(*out);
+            out.reset();
+            CHECK(pipe.finish() == expect);
+        }
+        {
+            // the queue grows past its capacity
+            pipe_t pipe;
+            CHECK(pipe.write_);
+            std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_async(pipe.write_, cmd_output_t::e_grow, 2));
+            fill(*out);
+            pipe.start();
+            out.reset();
+            CHECK(pipe.finish() == expect);
+        }
+        {
+            // lines that do not fit are dropped and counted
+            pipe_t pipe;
+            CHECK(pipe.write_);
+            std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_async(pipe.write_, cmd_output_t::e_drop, 2));
+            fill(*out);
+            pipe.start();
+            out.reset();
+            const std::vector<std::string> all = lines(pipe.finish());
+            size_t written = 0, dropped = 0;
+            for (const std::string& text : all) {
+                if (text.find(" lines dropped") != std::string::npos) {
+                    dropped += strtoull(text.c_str() + 4, nullptr, 10);
+                } else {
+                    ++written;
+                }
+            }
+            CHECK(written && dropped && written + dropped == size_t(LINES));
+        }
+        return true;
+    }
+
+    bool test_json()
+    {
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_json(fd));
+        cmd_parser_t parser;
+        parser.add_commands<cmd_expr_t, cmd_kill_t>();
+
+        // typed results replace the text
+        CHECK(parser.execute("expr set x 10; expr eval x + 1; expr eval x", out.get(), nullptr));
+        CHECK(contents(fd) == "{\"value\":11}\n{\"x\":10}\n");
+        std::string expect = contents(fd) + "{\"list\":\"variables\",\"items\":[{\"x\":10},{\"y\":2}]}\n";
+        CHECK(parser.execute("expr set y 2; expr list", out.get(), nullptr));
+        CHECK(contents(fd) == expect);
+
+        // errors carry a code and the message without its layout
+        CHECK(!parser.execute("kill 7", out.get(), nullptr));
+        expect = contents(fd);
+        CHECK(expect.find("{\"error\":\"no_job\",\"message\":\"no job 7\"}\n") != std::string::npos);
+        CHECK(expect.find("{\"error\":\"command_failed\",\"message\":\"command failed: 'kill 7'\"}\n") != std::string::npos);
+
+        // free text and rows are written as objects
+        out->print("a \"quoted\"\t");
+        out->row("test", { "n", "neg", "ratio", "name", "ok" }, "%u %d %f %s %d", 1u, -2, 0.5, "z", true);
+        out->flush();
+        CHECK(contents(fd).substr(expect.size()) ==
+            "{\"text\":\"a \\\"quoted\\\"\\t\"}\n"
+            "{\"row\":\"test\",\"n\":1,\"neg\":-2,\"ratio\":0.5,\"name\":\"z\",\"ok\":true}\n");
+        out.reset();
+        fclose(fd);
+        return true;
+    }
+
+    bool test_binary()
+    {
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_binary(fd));
+        out->value("x", uint64_t(258), "x = %d", 258);
+        out->error(cmd_output_t::e_no_job, "  no job %d", 3);
+        out->list_begin("l", "heading");
+        out->list_end();
+        out->flush();
+        const std::string bytes = contents(fd);
+        const std::string expect(
+            // e_value, size 14, e_uint, "x", 258
+            "\x02\x0e\0\0\0"
+            "\0\x01\0\0\0x\x02\x01\0\0\0\0\0\0"
+            // e_error, size 16, e_no_job, "no job 3"
+            "\x06\x10\0\0\0"
+            "\x0c\0\0\0\x08\0\0\0no job 3"
+            // e_list_begin "l", e_list_end
+            "\x04\x05\0\0\0\x01\0\0\0l"
+            "\x05\0\0\0\0",
+            5 + 14 + 5 + 16 + 5 + 5 + 5);
+        CHECK(bytes == expect);
+        out.reset();
+        fclose(fd);
+        return true;
+    }
+
+    bool test_format()
+    {
+        // format strings are checked and split at compile time
+        static_assert(cmd_format_t::split("a {} b", nullptr) == 3, "");
+        static_assert(cmd_format_t::split("{{}}", nullptr) == 2, "");
+        static_assert(cmd_format_t::split("{", nullptr) < 0, "");
+        static_assert(cmd_format_t::split("}", nullptr) < 0, "");
+        static_assert(cmd_format_t::split("{8.x}", nullptr) < 0, "");
+        static_assert(cmd_format_t::num_args("{} {{ {x}") == 2, "");
+        constexpr cmd_format_t::kind_t ints[] = { cmd_format_t::e_int, cmd_format_t::e_uint };
+        constexpr cmd_format_t::kind_t text[] = { cmd_format_t::e_string };
+        static_assert(cmd_format_t::suits("{x} {08}", ints), "");
+        static_assert(!cmd_format_t::suits("{x}", text), "");
+        static_assert(!cmd_format_t::suits("{.2}", ints), "");
+        static_assert(cmd_format_t::kind_of<const char (&)[3]>() == cmd_format_t::e_string, "");
+        static_assert(cmd_format_t::kind_of<std::vector<int>>() == cmd_format_t::e_none, "");
+
+        FILE* fd = tmpfile();
+        CHECK(fd);
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_buffered(fd));
+        out->println(CMD_FMT("{} {} {} {}"), -12, uint64_t(~0ull), int8_t(-1), uint8_t(200));
+        out->println(CMD_FMT("{x} {x} {04x}"), 255u, int64_t(-1), 10);
+        out->println(CMD_FMT("[{5}] [{-5}] [{05}] [{05}]"), "ab", std::string("cd"), 42, -42);
+        out->println(CMD_FMT("{} {.2} {.0} {}"), 0.5, 3.14159, 2.5, 1e300);
+        out->println(CMD_FMT("{} {} {} {}"), true, 'c', std::string_view("view"), (const char*)nullptr);
+        out->println<false>(CMD_FMT("{{{}}} }}"), 1);
+        {
+            auto indent = out->indent(2);
+            out->print(CMD_FMT("{}"), "in");
+            out->println<false>(CMD_FMT("dented"));
+        }
+        // lines longer than the stack buffer
+        const std::string line(1000, 'z');
+        out->println<false>(CMD_FMT("{}|{}"), line, line);
+        out->flush();
+        std::vector<std::string> expect = {
+            "  -12 18446744073709551615 -1 200",
+            "  ff ffffffffffffffff 000a",
+            "  [   ab] [cd   ] [00042] [-0042]",
+            "  0.5 3.14 2 1e+300",
+            "  true c view ",
+            "{1} }",
+            "    indented",
+            line + "|" + line,
+        };
+        CHECK(lines(contents(fd)) == expect);
+
+        // every output accepts formatted lines
+        std::unique_ptr<cmd_output_t> json(cmd_output_t::create_output_json(fd));
+        const size_t size = contents(fd).size();
+        json->print(CMD_FMT("{} "), "a");
+        json->println(CMD_FMT("{}"), 1);
+        json->flush();
+        CHECK(contents(fd).substr(size) == "{\"text\":\"a 1\"}\n");
+
+        // typed records render their text through checked formats too
+        const std::string name("n");
+        out->value("v", 7, CMD_FMT("{} = {x}"), name, 255);
+        out->row("r", { "name", "n" }, CMD_FMT("{-3}|{03}"), name, 5);
+        out->list_begin("l", CMD_FMT("{} items"), 2);
+        out->list_end();
+        out->error(cmd_output_t::e_no_job, CMD_FMT("no job {}"), name);
+        out->flush();
+        expect = { "  n = ff", "  n  |005", "  2 items", "  no job n" };
+        const std::vector<std::string> all = lines(contents(fd));
+        CHECK(std::vector<std::string>(all.end() - 4, all.end()) == expect);
+        const size_t before = contents(fd).size();
+        json->row("r", { "name", "n" }, CMD_FMT("{} {}"), name, 5);
+        json->flush();
+        CHECK(contents(fd).substr(before) == "{\"row\":\"r\",\"name\":\"n\",\"n\":5}\n");
+        out.reset();
+        json.reset();
+        fclose(fd);
+        return true;
+    }
+
+    bool test_buffer()
+    {
+        cmd_parser_t parser;
+        parser.add_commands<cmd_echo_t, cmd_expr_t>();
+        std::string text;
+        std::vector<size_t> offsets;
+        std::unique_ptr<cmd_output_t> out(cmd_output_t::create_output_buffer(text, &offsets, false));
+        const auto slice = [&](size_t ix) {
+            const size_t end = ix + 1 < offsets.size() ? offsets[ix + 1] : text.size();
+            return text.substr(offsets[ix], end - offsets[ix]);
+        };
+
+        // one offset per line of a batch, blank lines included
+        std::vector<bool> status;
+        CHECK(!parser.execute_batch("expr eval 1\n\nbogus\nexpr eval 2", out.get(), nullptr, &status));
+        CHECK(offsets.size() == 4);
+        CHECK(slice(0) == "      0x1\n");
+        CHECK(slice(1).empty());
+        CHECK(slice(2) == "  invalid command\n    command failed: 'bogus'\n");
+        CHECK(slice(3) == "      0x2\n");
+        CHECK(status == std::vector<bool>({ true, true, false, true }));
+
+        // single commands are marked too, and clearing keeps the capacity
+        const size_t capacity = text.capacity();
+        text.clear();
+        offsets.clear();
+        CHECK(parser.execute("expr eval 3", out.get(), nullptr));
+        CHECK(parser.execute("echo hi", out.get(), nullptr));
+        CHECK(offsets.size() == 2);
+        CHECK(slice(0) == "      0x3\n");
+        CHECK(slice(1) == "    tokens: hi \n       raw: hi \n");
+        CHECK(text.capacity() == capacity);
+
+        // the executor marks per line, cmd_async_t as each task is delivered
+        text.clear();
+        offsets.clear();
+        {
+            cmd_executor_t executor(parser, 2);
+            CHECK(!executor.execute("expr eval 4\n\nbogus\necho hi", out.get(), nullptr));
+        }
+        CHECK(offsets.size() == 4);
+        CHECK(slice(0) == "      0x4\n");
+        CHECK(slice(1).empty());
+        CHECK(slice(2) == "  invalid command\n    command failed: 'bogus'\n");
+        CHECK(slice(3) == "    tokens: hi \n       raw: hi \n");
+        text.clear();
+        offsets.clear();
+        {
+            cmd_async_t async(parser);
+            async.execute("expr eval 5; echo hi", out.get(), nullptr);
+            CHECK(async.wait(out.get()));
+        }
+        CHECK(offsets.size() == 2);
+        CHECK(slice(0) == "      0x5\n");
+        CHECK(slice(1) == "    tokens: hi \n       raw: hi \n");
+
+        // the guard serializes commands executed concurrently
+        std::string shared;
+        std::vector<size_t> marks;
+        std::unique_ptr<cmd_output_t> locked(cmd_output_t::create_output_buffer(shared, &marks));
+        parser.set_concurrent();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&]() {
+                for (int j = 0; j < 200; ++j) {
+                    parser.execute("echo hi", locked.get(), nullptr);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(marks.size() == 800);
+        for (size_t i = 0; i < marks.size(); ++i) {
+            const size_t end = i + 1 < marks.size() ? marks[i + 1] : shared.size();
+            CHECK(shared.compare(marks[i], end - marks[i], "    tokens: hi \n       raw: hi \n") == 0);
+        }
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_buffered());
+        CHECK(test_parser());
+        CHECK(test_async());
+        CHECK(test_backpressure());
+        CHECK(test_json());
+        CHECK(test_binary());
+        CHECK(test_format());
+        CHECK(test_buffer());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_output()
+{
+    return new test_t();
+}
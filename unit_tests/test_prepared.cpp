@@ -0,0 +1,98 @@
+#include "runner.h"
+
+namespace {
+struct cmd_add_t : public cmd_t {
+    uint64_t sum_;
+    uint32_t exec_;
+
+    cmd_add_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("add", cli, parent, user)
+        , sum_(0)
+        , exec_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out;
+        (void)user;
+        ++exec_;
+        sum_ = 0;
+        for (const cmd_token_t& arg : tok.tokens.tokens_) {
+            uint64_t val = 0;
+            bool neg = false;
+            if (!cmd_util_t::strtoll(arg.c_str(), val, neg)) {
+                return false;
+            }
+            sum_ += neg ? -val : val;
+        }
+        return true;
+    }
+};
+
+struct cmd_math_t : public cmd_t {
+    cmd_add_t* add_;
+
+    cmd_math_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("math", cli, parent, user)
+    {
+        add_ = add_sub_command<cmd_add_t>();
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_math_t* math = parser.add_command<cmd_math_t>();
+        cmd_output_t* output = cmd_output_t::create_output_dummy();
+        const size_t history = parser.history_.size();
+
+        // unknown commands fail to prepare
+        cmd_prepared_t prepared;
+        CHECK(!parser.prepare("nothing 1", prepared, output));
+        CHECK(!prepared.valid());
+
+        // the path is resolved once and the argument template kept
+        CHECK(parser.prepare("ma ad 1 $x", prepared, output));
+        CHECK(prepared.valid() && prepared.cmd_ == math->add_);
+        CHECK(prepared.args_ == "1 $x");
+
+        // identifiers are bound at execution
+        parser.idents_["x"] = 2;
+        CHECK(parser.execute(prepared, output, nullptr));
+        CHECK(math->add_->sum_ == 3);
+
+        // bindings take precedence over parser identifiers
+        const cmd_idents_t binds = { { "x", 10 } };
+        CHECK(parser.execute(prepared, output, nullptr, &binds));
+        CHECK(math->add_->sum_ == 11);
+
+        // extra arguments follow the template
+        const char* args[] = { "100", "$x" };
+        CHECK(parser.execute(prepared, output, nullptr, &binds, args, 2));
+        CHECK(math->add_->sum_ == 121);
+
+        // unbound identifiers are passed through as is
+        parser.idents_.clear();
+        CHECK(!parser.execute(prepared, output, nullptr));
+
+        // prepared commands never touch the history
+        CHECK(math->add_->exec_ == 4);
+        CHECK(parser.history_.size() == history);
+        delete output;
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_prepared()
+{
+    return new test_t();
+}
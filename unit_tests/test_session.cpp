@@ -0,0 +1,156 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_alias.h"
+#include "../lib_cmd/cmd_expr.h"
+#include "../lib_cmd/cmd_history.h"
+
+namespace {
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_isolation()
+    {
+        cmd_parser_t parser;
+        cmd_count_t* count = parser.add_command<cmd_count_t>();
+        parser.add_commands<cmd_alias_t, cmd_expr_t, cmd_history_t>();
+        cmd_session_t one(parser), two(parser);
+        cmd_output_text_t out;
+
+        // identifiers and history are private to a session
+        CHECK(one.execute("expr set x 1", &out, nullptr));
+        CHECK(two.execute("expr set x 2", &out, nullptr));
+        CHECK(one.idents_.at("x") == 1);
+        CHECK(two.idents_.at("x") == 2);
+        CHECK(parser.idents_.empty());
+        CHECK(parser.history_.empty());
+        CHECK(one.history_.back() == "expr set x 1");
+        out.text_.clear();
+        CHECK(one.execute("expr eval x + $x", &out, nullptr));
+        CHECK(out.text_.find("0x2") != std::string::npos);
+
+        // session aliases take precedence over parser aliases
+        CHECK(one.execute("alias add p count", &out, nullptr));
+        CHECK(one.execute("p", &out, nullptr));
+        CHECK(count->exec_ == 1);
+        out.text_.clear();
+        CHECK(two.execute("p 3 * 3", &out, nullptr));
+        CHECK(out.text_.find("0x9") != std::string::npos);
+        CHECK(count->exec_ == 1);
+        CHECK(parser.alias_find("p") != count);
+        CHECK(one.execute("alias remove p", &out, nullptr));
+        CHECK(one.execute("p 1", &out, nullptr));
+        CHECK(count->exec_ == 1);
+
+        // blank input repeats the sessions own last command
+        CHECK(one.execute("count", &out, nullptr));
+        CHECK(one.execute(" ", &out, nullptr));
+        CHECK(count->exec_ == 3);
+        // as does the REPLs '\0' padded line buffer
+        CHECK(one.execute(std::string(" \0\0x", 4), &out, nullptr));
+        CHECK(count->exec_ == 4);
+        CHECK(parser.execute("count", &out, nullptr));
+        CHECK(parser.execute(std::string(64, '\0'), &out, nullptr));
+        CHECK(count->exec_ == 6);
+
+        // prepared commands bind session identifiers
+        cmd_prepared_t prepared;
+        CHECK(two.prepare("expr eval $x + 1", prepared, &out));
+        out.text_.clear();
+        CHECK(two.execute(prepared, &out, nullptr));
+        CHECK(out.text_.find("0x3") != std::string::npos);
+
+        // batches run in the session too
+        std::vector<bool> status;
+        CHECK(!two.execute_batch("expr set y 5\nbogus\n", &out, nullptr, &status));
+        CHECK(status.size() == 2 && status[0] && !status[1]);
+        CHECK(two.idents_.at("y") == 5);
+        CHECK(two.memory_usage() < 4096);
+        return true;
+    }
+
+    bool test_quota()
+    {
+        cmd_parser_t parser;
+        parser.add_commands<cmd_count_t, cmd_alias_t, cmd_expr_t>();
+        cmd_session_t session(parser, cmd_state_t::quota_t{ 64, 2, 1 });
+        cmd_output_text_t out;
+
+        CHECK(session.execute("expr set a 1", &out, nullptr));
+        CHECK(session.execute("expr eval b = 2", &out, nullptr));
+        CHECK(!session.execute("expr set c 3", &out, nullptr));
+        CHECK(!session.execute("expr eval d = 4", &out, nullptr));
+        CHECK(session.execute("expr set a 5", &out, nullptr));
+        CHECK(session.idents_.size() == 2);
+
+        CHECK(session.execute("alias add c count", &out, nullptr));
+        CHECK(!session.execute("alias add d count", &out, nullptr));
+        CHECK(session.alias_.size() == 1);
+
+        // old history is dropped to stay within the quota
+        for (int i = 0; i < 100; ++i) {
+            CHECK(session.execute("count " + std::to_string(i), &out, nullptr));
+        }
+        size_t bytes = 0;
+        for (const std::string& expr : session.history_) {
+            bytes += expr.size();
+        }
+        CHECK(bytes <= 64);
+        CHECK(session.history_.back() == "count 99");
+        return true;
+    }
+
+    bool test_concurrent()
+    {
+        static const size_t NUM_SESSIONS = 4;
+        cmd_parser_t parser;
+        cmd_count_t* count = parser.add_command<cmd_count_t>();
+        parser.add_commands<cmd_alias_t, cmd_expr_t>();
+        parser.set_concurrent();
+
+        std::vector<std::unique_ptr<cmd_session_t>> sessions;
+        std::vector<std::thread> threads;
+        std::vector<uint32_t> failed(NUM_SESSIONS, 0);
+        for (size_t i = 0; i < NUM_SESSIONS; ++i) {
+            sessions.emplace_back(new cmd_session_t(parser));
+        }
+        for (size_t i = 0; i < NUM_SESSIONS; ++i) {
+            threads.emplace_back([&, i]() {
+                cmd_session_t& session = *sessions[i];
+                cmd_output_text_t out;
+                failed[i] += !session.execute("alias add c count", &out, nullptr);
+                for (size_t j = 0; j < 500; ++j) {
+                    const std::string line = "expr set v " + std::to_string(j) + "; c";
+                    failed[i] += !session.execute(line, &out, nullptr);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (size_t i = 0; i < NUM_SESSIONS; ++i) {
+            CHECK(failed[i] == 0);
+            CHECK(sessions[i]->idents_.at("v") == 499);
+        }
+        CHECK(count->exec_ == NUM_SESSIONS * 500);
+        CHECK(parser.alias_.size() == 1);
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_isolation());
+        CHECK(test_quota());
+        CHECK(test_concurrent());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_session()
+{
+    return new test_t();
+}
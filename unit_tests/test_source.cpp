@@ -0,0 +1,168 @@
+#include "runner.h"
+#include "../lib_cmd/cmd_source.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+struct cmd_count_t : public cmd_t {
+    uint32_t exec_;
+    std::string last_;
+
+    cmd_count_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("count", cli, parent, user)
+        , exec_(0)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out;
+        (void)user;
+        ++exec_;
+        last_ = tok.tokens.empty() ? "" : tok.tokens.front().c_str();
+        return last_ != "fail";
+    }
+};
+
+// concurrent command printing its argument, failing on "fail"
+struct cmd_say_t : public cmd_t {
+    cmd_say_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("say", cli, parent, user)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        const char* text = tok.tokens.empty() ? "" : tok.tokens.front().c_str();
+        out.println(CMD_FMT("said {}"), text);
+        return strcmp(text, "fail") != 0;
+    }
+};
+
+struct cmd_output_lines_t : public cmd_output_t {
+    std::vector<std::string> lines_;
+    std::string line_;
+
+    virtual void lock() override {}
+    virtual void unlock() override {}
+
+    virtual void print(bool, const char* fmt, va_list& args) override
+    {
+        char buf[256];
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        line_.append(buf);
+    }
+
+    virtual void println(bool ind, const char* fmt, va_list& args) override
+    {
+        print(ind, fmt, args);
+        eol();
+    }
+
+    virtual void eol() override
+    {
+        lines_.push_back(line_);
+        line_.clear();
+    }
+
+    bool contains(const char* str) const
+    {
+        for (const std::string& line : lines_) {
+            if (line.find(str) != line.npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+bool write_file(const char* path, const char* text)
+{
+    FILE* fd = fopen(path, "wb");
+    if (!fd) {
+        return false;
+    }
+    fputs(text, fd);
+    fclose(fd);
+    return true;
+}
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_count_t* count = parser.add_command<cmd_count_t>();
+        parser.add_command<cmd_source_t>();
+        cmd_output_lines_t output;
+        const char* path = "test_source.script";
+
+        // comments and blank lines are skipped, ';' and aliases work as usual
+        CHECK(parser.alias_add(count, "c"));
+        CHECK(write_file(path, "# comment\ncount a\n\n  \r\ncou b; c c\r\n  c d"));
+        CHECK(parser.execute(std::string("source ") + path, &output, nullptr));
+        CHECK(count->exec_ == 4 && count->last_ == "d");
+        CHECK(output.contains("3 lines in"));
+
+        // stop on the first error and report its line
+        CHECK(write_file(path, "count a\ncount fail\ncount b\n"));
+        CHECK(!parser.execute(std::string("source ") + path, &output, nullptr));
+        CHECK(count->exec_ == 6 && count->last_ == "fail");
+        CHECK(output.contains("test_source.script:2: error"));
+
+        // or continue past it
+        CHECK(!parser.execute(std::string("source -c ") + path, &output, nullptr));
+        CHECK(count->exec_ == 9 && count->last_ == "b");
+        CHECK(!parser.execute(std::string("source ") + path + " -c", &output, nullptr));
+        CHECK(count->exec_ == 12);
+
+        // parallel scripts report errors in line order
+        parser.add_command<cmd_say_t>();
+        CHECK(write_file(path, "say a\nsay fail\nsay b\ncount fail\nsay c\n"));
+        output.lines_.clear();
+        CHECK(!parser.execute(std::string("source -p ") + path, &output, nullptr));
+        const std::vector<std::string> expect = {
+            "said a", "said fail", "test_source.script:2: error", "said b",
+            "test_source.script:4: error", "said c",
+        };
+        // relayed output arrives as text holding several lines
+        std::string text;
+        for (const std::string& line : output.lines_) {
+            text += line + "\n";
+        }
+        std::vector<std::string> got;
+        for (size_t ix = 0, next; (next = text.find('\n', ix)) != text.npos; ix = next + 1) {
+            const size_t first = text.find_first_not_of(' ', ix);
+            if (first < next && (text.compare(first, 4, "said") == 0 || text.compare(first, 11, "test_source") == 0)) {
+                got.push_back(text.substr(first, next - first));
+            }
+        }
+        CHECK(got == expect);
+
+        // a script sourcing itself is bounded
+        CHECK(write_file(path, "source test_source.script\n"));
+        CHECK(!parser.execute(std::string("source ") + path, &output, nullptr));
+        CHECK(output.contains("nested too deeply"));
+
+        // empty and missing files
+        CHECK(write_file(path, ""));
+        CHECK(parser.execute(std::string("source ") + path, &output, nullptr));
+        remove(path);
+        CHECK(!parser.execute(std::string("source ") + path, &output, nullptr));
+        CHECK(output.contains("unable to open"));
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_source()
+{
+    return new test_t();
+}
@@ -0,0 +1,95 @@
+#include "runner.h"
+
+namespace {
+template <int ID>
+struct cmd_count_t : public cmd_t {
+    static constexpr const char* NAME = ID == 0 ? "status" : ID == 1 ? "stat" : "store";
+    static uint32_t exec;
+
+    cmd_count_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        ++exec;
+        return true;
+    }
+};
+
+template <int ID>
+uint32_t cmd_count_t<ID>::exec = 0;
+
+struct cmd_dynamic_t : public cmd_t {
+    static uint32_t exec;
+
+    cmd_dynamic_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t("storage", cli, parent, user)
+    {
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)user;
+        ++exec;
+        return true;
+    }
+};
+
+uint32_t cmd_dynamic_t::exec = 0;
+
+typedef cmd_static_table_t<cmd_count_t<0>, cmd_count_t<1>, cmd_count_t<2>> table_t;
+
+constexpr bool is_sorted()
+{
+    for (size_t i = 1; i < table_t::SIZE; ++i) {
+        if (table_t::table_[i - 1].hash_ > table_t::table_[i].hash_) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(table_t::SIZE == 3, "unexpected table size");
+static_assert(is_sorted(), "dispatch table must be sorted at compile time");
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        parser.add_commands<cmd_count_t<0>, cmd_count_t<1>, cmd_count_t<2>>();
+        parser.add_command<cmd_dynamic_t>();
+        cmd_output_t* output = cmd_output_t::create_output_dummy();
+
+        CHECK(parser.sub_.find_static("stat") == parser.sub_[1].get());
+        CHECK(parser.sub_.find_static("store") == parser.sub_[2].get());
+        CHECK(parser.sub_.find_static("sta") == nullptr);
+        CHECK(parser.sub_.find_static("storage") == nullptr);
+
+        // exact static names
+        CHECK(parser.execute("status; stat; store", output, nullptr));
+        CHECK(cmd_count_t<0>::exec == 1 && cmd_count_t<1>::exec == 1 && cmd_count_t<2>::exec == 1);
+        // unique prefixes still resolve through the trie
+        CHECK(parser.execute("statu; stora", output, nullptr));
+        CHECK(cmd_count_t<0>::exec == 2 && cmd_dynamic_t::exec == 1);
+        // ambiguous prefixes still fail
+        CHECK(!parser.execute("sto", output, nullptr));
+        CHECK(cmd_count_t<2>::exec == 1 && cmd_dynamic_t::exec == 1);
+        delete output;
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_static()
+{
+    return new test_t();
+}
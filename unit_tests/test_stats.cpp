@@ -0,0 +1,135 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_expr.h"
+#include "../lib_cmd/cmd_stats.h"
+
+namespace {
+// command succeeding when passed "ok"
+struct cmd_check_t : public cmd_t {
+    static constexpr const char* NAME = "check";
+
+    cmd_check_t(cmd_parser_t& cli, cmd_t* parent, cmd_baton_t user)
+        : cmd_t(NAME, cli, parent, user)
+    {
+        concurrent_ = true;
+    }
+
+    virtual bool on_execute(cmd_tokens_t& tok, cmd_output_t& out, cmd_baton_t user) override
+    {
+        (void)out, (void)user;
+        return tok.tokens.find("ok");
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_histogram()
+    {
+        // every value falls within its buckets bounds
+        uint32_t prev = 0;
+        for (uint64_t value = 0; value < (uint64_t(1) << 20); value += 1 + value / 64) {
+            const uint32_t ix = cmd_histogram_t::index(value);
+            CHECK(ix >= prev);
+            CHECK(value <= cmd_histogram_t::highest(ix));
+            CHECK(ix == 0 || value > cmd_histogram_t::highest(ix - 1));
+            prev = ix;
+        }
+        CHECK(cmd_histogram_t::index(~uint64_t(0)) == cmd_histogram_t::NUM_BUCKETS - 1);
+
+        cmd_histogram_t hist;
+        CHECK(hist.count() == 0 && hist.percentile(0.5) == 0);
+        for (uint64_t value = 1; value <= 1000; ++value) {
+            hist.record(value * 1000);
+        }
+        CHECK(hist.count() == 1000);
+        CHECK(hist.max() == 1000000);
+        // within the precision of a bucket
+        const uint64_t p50 = hist.percentile(0.5);
+        CHECK(p50 >= 500000 && p50 <= 500000 + 500000 / cmd_histogram_t::SUB_BUCKETS);
+        const uint64_t p99 = hist.percentile(0.99);
+        CHECK(p99 >= 990000 && p99 <= 1000000);
+        CHECK(hist.percentile(1.0) == 1000000);
+        hist.reset();
+        CHECK(hist.count() == 0 && hist.max() == 0);
+        return true;
+    }
+
+    bool test_parser()
+    {
+        cmd_parser_t parser;
+        cmd_check_t* check = parser.add_command<cmd_check_t>();
+        cmd_stats_t* stats = parser.add_command<cmd_stats_t>();
+        parser.add_command<cmd_expr_t>();
+        cmd_output_text_t out;
+
+        // calls and failures are counted per command
+        CHECK(parser.execute("check ok; check ok", &out, nullptr));
+        CHECK(!parser.execute("check fail", &out, nullptr));
+        CHECK(check->stats_.calls_ == 3);
+        CHECK(check->stats_.failures_ == 1);
+        CHECK(check->stats_.latency_ns_.count() == 3);
+        CHECK(check->stats_.total_ns_ >= check->stats_.latency_ns_.max());
+
+        // sub commands and prepared commands are recorded on their node
+        cmd_t* eval = parser.sub_.find_exact("expr")->sub_.find_exact("eval");
+        CHECK(eval);
+        cmd_prepared_t prepared;
+        CHECK(parser.prepare("expr eval 1 + 2", prepared, &out));
+        CHECK(parser.execute(prepared, &out, nullptr));
+        CHECK(parser.execute("expr eval 3", &out, nullptr));
+        CHECK(eval->stats_.calls_ == 2);
+
+        // printed as a tree, with only the name of commands never called
+        out.text_.clear();
+        CHECK(parser.execute("stats", &out, nullptr));
+        CHECK(out.text_.find("    check: 3 calls, 1 failed,") != std::string::npos);
+        CHECK(out.text_.find("    expr\n      eval: 2 calls, 0 failed,") != std::string::npos);
+        CHECK(out.text_.find("    stats\n      reset\n") != std::string::npos);
+
+        // statistics can be cleared and turned off
+        CHECK(parser.execute("stats reset", &out, nullptr));
+        CHECK(check->stats_.calls_ == 0 && eval->stats_.calls_ == 0);
+        CHECK(stats->stats_.calls_ == 0);
+        parser.set_stats(false);
+        CHECK(parser.execute("check ok", &out, nullptr));
+        CHECK(check->stats_.calls_ == 0);
+        parser.set_stats(true);
+
+        // counters are exact when executing concurrently
+        parser.set_concurrent();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&parser]() {
+                cmd_output_text_t text;
+                for (int j = 0; j < 500; ++j) {
+                    parser.execute(j & 1 ? "check ok" : "check fail", &text, nullptr);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(check->stats_.calls_ == 2000);
+        CHECK(check->stats_.failures_ == 1000);
+        CHECK(check->stats_.latency_ns_.count() == 2000);
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_histogram());
+        CHECK(test_parser());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_stats()
+{
+    return new test_t();
+}
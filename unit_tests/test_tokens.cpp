@@ -0,0 +1,64 @@
+#include "runner.h"
+
+namespace {
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    // all tokens should be views into the same line buffer
+    bool check_shared(const cmd_tokens_t& tok, size_t size) const
+    {
+        const char* lo = tok.tokens.raw_.front().c_str();
+        for (const cmd_token_t& token : tok.tokens.tokens_) {
+            if (token.c_str() < lo || token.c_str() >= lo + size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        cmd_idents_t idents;
+        idents["a_long_identifier_name"] = 1234;
+        {
+            cmd_tokens_t tok(&idents);
+            const char* line = "  cmd\tsub -f  -k value arg $a_long_identifier_name -z";
+            CHECK(tok.tokenize(line) == 4);
+            CHECK(tok.tokens.raw_.size() == 8);
+            CHECK(check_shared(tok, strlen(line) + 32));
+            CHECK(tok.tokens.front() == "cmd");
+            CHECK(tok.tokens.back() == "1234");
+            CHECK(tok.flags.get("-f"));
+            CHECK(tok.flags.get("-z"));
+            CHECK(!tok.flags.get("-k"));
+            cmd_token_t value;
+            CHECK(tok.pairs.get("-k", value) && value == "value");
+            // copies of a token still view the same line
+            cmd_token_t copy = tok.tokens.front();
+            CHECK(copy.c_str() == tok.tokens.front().c_str());
+            CHECK(tok.tokens.pop());
+            CHECK(tok.tokens.front() == "sub");
+            uint64_t val = 0;
+            CHECK(tok.tokens.back().get(val) && val == 1234);
+        }
+        {
+            // owning tokens must survive copies of themselves
+            cmd_token_t a(std::string("a token that wont fit in sso"));
+            cmd_token_t b = a;
+            CHECK(b == "a token that wont fit in sso");
+            CHECK(b.c_str() != a.c_str());
+        }
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_tokens()
+{
+    return new test_t();
+}
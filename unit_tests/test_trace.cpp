@@ -0,0 +1,200 @@
+#include "runner.h"
+#include "fixtures.h"
+#include "../lib_cmd/cmd_alias.h"
+#include "../lib_cmd/cmd_echo.h"
+#include "../lib_cmd/cmd_source.h"
+#include "../lib_cmd/cmd_trace.h"
+
+namespace {
+// one recorded event parsed back out of the JSON
+struct event_t {
+    std::string name_;
+    char phase_;
+    uint32_t tid_;
+};
+
+// parse the events written by cmd_tracer_t::dump(), one per line
+std::vector<event_t> parse(const std::string& json)
+{
+    std::vector<event_t> events;
+    size_t ix = 0;
+    while ((ix = json.find("{\"name\":\"", ix)) != std::string::npos) {
+        event_t event;
+        ix += 9;
+        const size_t end = json.find('"', ix);
+        event.name_ = json.substr(ix, end - ix);
+        const size_t ph = json.find("\"ph\":\"", end);
+        event.phase_ = json[ph + 6];
+        const size_t tid = json.find("\"tid\":", end);
+        event.tid_ = uint32_t(strtoul(json.c_str() + tid + 6, nullptr, 10));
+        events.push_back(event);
+        ix = end;
+    }
+    return events;
+}
+
+// render events of one thread as "name(child(...))" nesting
+std::string nesting(const std::vector<event_t>& events, uint32_t tid)
+{
+    std::string out;
+    for (const event_t& event : events) {
+        if (event.tid_ == tid) {
+            out += event.phase_ == 'B' ? event.name_ + "(" : ")";
+        }
+    }
+    return out;
+}
+
+bool write_file(const char* path, const char* text)
+{
+    FILE* fd = fopen(path, "wb");
+    if (!fd) {
+        return false;
+    }
+    fputs(text, fd);
+    fclose(fd);
+    return true;
+}
+
+std::string read_file(const char* path)
+{
+    std::string text;
+    FILE* fd = fopen(path, "rb");
+    if (fd) {
+        char buf[4096];
+        size_t size;
+        while ((size = fread(buf, 1, sizeof(buf), fd)) != 0) {
+            text.append(buf, size);
+        }
+        fclose(fd);
+    }
+    return text;
+}
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    bool test_ring()
+    {
+        // the oldest events are dropped, along with ends missing a begin
+        cmd_tracer_t tracer(4);
+        tracer.begin("a");
+        tracer.begin("b");
+        tracer.end("b");
+        tracer.begin("c");
+        tracer.end("c");
+        tracer.end("a");
+        std::string json;
+        CHECK(tracer.dump(json) == 2);
+        CHECK(json.find("{\"traceEvents\":[") == 0);
+        const std::vector<event_t> events = parse(json);
+        CHECK(nesting(events, 1) == "c()");
+
+        // threads record into their own rings, even while dumping
+        cmd_tracer_t shared;
+        std::vector<std::thread> threads;
+        std::atomic<bool> stop(false);
+        std::atomic<int> started(0);
+        for (int i = 0; i < 3; ++i) {
+            threads.emplace_back([&shared, &started]() {
+                for (int j = 0; j < 1000; ++j) {
+                    const cmd_tracer_t::span_t outer(&shared, "outer");
+                    const cmd_tracer_t::span_t inner(&shared, "inner");
+                }
+                // stay alive so that no thread reuses the ring of another
+                ++started;
+                while (started < 3) {
+                    std::this_thread::yield();
+                }
+            });
+        }
+        std::thread dumper([&]() {
+            while (!stop) {
+                std::string temp;
+                shared.dump(temp);
+            }
+        });
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        stop = true;
+        dumper.join();
+        json.clear();
+        CHECK(shared.dump(json) == 3 * 4000);
+        const std::vector<event_t> all = parse(json);
+        for (uint32_t tid = 1; tid <= 3; ++tid) {
+            std::string expect;
+            for (int j = 0; j < 1000; ++j) {
+                expect += "outer(inner())";
+            }
+            CHECK(nesting(all, tid) == expect);
+        }
+
+        // threads that have exited hand their rings to new threads
+        std::thread([&shared]() {
+            const cmd_tracer_t::span_t span(&shared, "reused");
+        }).join();
+        json.clear();
+        CHECK(shared.dump(json) == 3 * 4000 + 2);
+        uint32_t max_tid = 0;
+        for (const event_t& event : parse(json)) {
+            max_tid = std::max(max_tid, event.tid_);
+        }
+        CHECK(max_tid == 3);
+        return true;
+    }
+
+    bool test_parser()
+    {
+        cmd_parser_t parser;
+        parser.add_commands<cmd_alias_t, cmd_echo_t, cmd_source_t, cmd_trace_t>();
+        cmd_output_null_t out;
+        const char* script = "test_trace.script";
+        const char* path = "test_trace.json";
+        CHECK(write_file(script, "e nested\n"));
+
+        // nothing is recorded until started
+        CHECK(parser.execute("alias add e echo", &out, nullptr));
+        CHECK(parser.tracer() == nullptr);
+        CHECK(parser.execute("trace start", &out, nullptr));
+        CHECK(parser.tracer() != nullptr);
+        CHECK(parser.execute("e top", &out, nullptr));
+        CHECK(parser.execute(std::string("source ") + script, &out, nullptr));
+        CHECK(parser.execute("trace stop", &out, nullptr));
+        CHECK(parser.tracer() == nullptr);
+        CHECK(parser.execute("echo untraced", &out, nullptr));
+        CHECK(parser.execute(std::string("trace dump ") + path, &out, nullptr));
+
+        // scripts and aliases show up as nested spans
+        const std::vector<event_t> events = parse(read_file(path));
+        CHECK(!events.empty());
+        const std::string expect =
+            "execute(tokenize()alias()walk()echo())"
+            "execute(tokenize()alias()walk()source("
+            "execute(tokenize()alias()walk()echo())"
+            "))"
+            "execute(tokenize()alias()walk()stop())";
+        CHECK(nesting(events, events.front().tid_) == expect);
+        CHECK(!parser.execute("trace dump /nonexistent/dir/trace.json", &out, nullptr));
+        remove(script);
+        remove(path);
+        return true;
+    }
+
+    virtual bool run() override
+    {
+        CHECK(test_ring());
+        CHECK(test_parser());
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_trace()
+{
+    return new test_t();
+}
@@ -0,0 +1,74 @@
+#include "runner.h"
+
+namespace {
+struct cmd_named_t : public cmd_t {
+    cmd_named_t(const char* name, cmd_parser_t& cli)
+        : cmd_t(name, cli, nullptr, nullptr)
+    {
+    }
+};
+
+struct test_t : public test_base_t {
+
+    test_t()
+        : test_base_t(__FILE__)
+    {
+    }
+
+    // reference implementation using a linear scan
+    static void find_linear(const cmd_list_t& list, const char* sub, std::vector<cmd_t*>& vec)
+    {
+        int32_t score = 0;
+        for (auto& item : list) {
+            int32_t val = cmd_util_t::str_match(item->name_, sub);
+            if (val > score) {
+                vec.clear();
+                vec.push_back(item.get());
+                score = val;
+            } else if (val == score) {
+                vec.push_back(item.get());
+            }
+        }
+    }
+
+    virtual bool run() override
+    {
+        cmd_parser_t parser;
+        cmd_list_t list;
+        std::vector<std::string> names;
+        // a generated register style tree with lots of shared prefixes
+        for (uint32_t i = 0; i < 2000; ++i) {
+            names.push_back("reg" + std::to_string((i * 7919) % 2000));
+        }
+        names.push_back("re");
+        names.push_back("status");
+        names.push_back("stat");
+        names.push_back("store");
+        names.push_back("reg7");
+        for (const std::string& name : names) {
+            list.push_back(std::unique_ptr<cmd_t>(new cmd_named_t(name.c_str(), parser)));
+        }
+        const char* queries[] = {
+            "r", "re", "reg", "reg1", "reg19", "reg199", "reg1999", "reg7",
+            "s", "st", "sta", "stat", "statu", "status", "statusx", "sto", "x", ""
+        };
+        std::vector<cmd_t*> a, b;
+        for (const char* q : queries) {
+            a.clear();
+            b.clear();
+            list.find(q, a);
+            find_linear(list, q, b);
+            CHECK(a == b);
+        }
+        CHECK(list.find_exact("stat") == list[2002].get());
+        CHECK(list.find_exact("reg7")->name_ == std::string("reg7"));
+        CHECK(list.find_exact("sta") == nullptr);
+        return true;
+    }
+};
+} // namespace {}
+
+test_base_t* init_test_trie()
+{
+    return new test_t();
+}